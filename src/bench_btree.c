@@ -0,0 +1,209 @@
+/**
+ * bench_btree.c
+ *
+ * Measures B-tree point lookups (descend to the first entry >= a key and
+ * read its position) against the node layout the tree used before leaves
+ * and internal nodes were split: one 8KB node type holding values, size_t
+ * positions and children, searched recursively. Both trees are built over
+ * the same sorted column, the legacy one with every node full, which only
+ * flatters it. Build times are those of a single-threaded bottom-up load
+ * for the legacy tree and of build_btree on the thread pool into a
+ * scratch file. Open times that of open_btree on the synced file, which
+ * is all a restart pays for the tree.
+ *
+ * Usage: make bench O=3 && ./bench_btree [rows] [lookups]
+ **/
+#define _POSIX_C_SOURCE 199309L
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "btree.h"
+#include "thread_pool.h"
+#include "utils.h"
+
+#define VALUE_RANGE 1000000000
+#define LEGACY_FANOUT 408
+#define BENCH_FILE "bench_btree.pages"
+
+typedef struct LegacyNode {
+  bool is_leaf;
+  int vals[LEGACY_FANOUT];
+  size_t idxs[LEGACY_FANOUT];
+  size_t length;
+  struct LegacyNode* children[LEGACY_FANOUT + 1];
+  struct LegacyNode* next;
+} LegacyNode;
+
+static double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int compare_ints(const void* a, const void* b) {
+  int x = *(const int*)a, y = *(const int*)b;
+  return (x > y) - (x < y);
+}
+
+/*=== Legacy Tree ===*/
+
+static LegacyNode* legacy_build(int* vals, size_t* idxs, size_t length,
+                                size_t* num_nodes) {
+  size_t num = (length + LEGACY_FANOUT - 1) / LEGACY_FANOUT;
+  LegacyNode** level = malloc(sizeof(LegacyNode*) * num);
+  int* mins = malloc(sizeof(int) * num);
+  for (size_t i = 0; i < num; i++) {
+    size_t start = i * LEGACY_FANOUT;
+    LegacyNode* leaf = calloc(sizeof(LegacyNode), 1);
+    leaf->is_leaf = true;
+    leaf->length = length - start < LEGACY_FANOUT ? length - start
+                                                  : LEGACY_FANOUT;
+    memcpy(leaf->vals, vals + start, sizeof(int) * leaf->length);
+    memcpy(leaf->idxs, idxs + start, sizeof(size_t) * leaf->length);
+    if (i > 0) level[i - 1]->next = leaf;
+    level[i] = leaf;
+    mins[i] = leaf->vals[0];
+  }
+  *num_nodes = num;
+
+  while (num > 1) {
+    size_t parents = (num + LEGACY_FANOUT) / (LEGACY_FANOUT + 1);
+    for (size_t p = 0; p < parents; p++) {
+      size_t first = p * (LEGACY_FANOUT + 1);
+      size_t count = num - first < LEGACY_FANOUT + 1 ? num - first
+                                                     : LEGACY_FANOUT + 1;
+      LegacyNode* node = calloc(sizeof(LegacyNode), 1);
+      node->length = count - 1;
+      for (size_t c = 0; c < count; c++) {
+        node->children[c] = level[first + c];
+        if (c > 0) node->vals[c - 1] = mins[first + c];
+      }
+      int min = mins[first];
+      level[p] = node;
+      mins[p] = min;
+    }
+    *num_nodes += parents;
+    num = parents;
+  }
+  LegacyNode* root = level[0];
+  free(level);
+  free(mins);
+  return root;
+}
+
+static LegacyNode* legacy_search(LegacyNode* node, int val) {
+  while (node && node->is_leaf == false) {
+    size_t pos = binary_search(node->vals, node->length, val);
+    if (val > node->vals[pos]) pos++;
+    return legacy_search(node->children[pos], val);
+  }
+  return node;
+}
+
+static void legacy_free(LegacyNode* node) {
+  if (!node->is_leaf)
+    for (size_t i = 0; i <= node->length; i++) legacy_free(node->children[i]);
+  free(node);
+}
+
+/*=== Lookups ===*/
+
+static size_t legacy_lookups(LegacyNode* root, int* keys, size_t num) {
+  size_t sum = 0;
+  for (size_t k = 0; k < num; k++) {
+    LegacyNode* cur = legacy_search(root, keys[k]);
+    while (cur) {
+      size_t i = 0;
+      while (i < cur->length && cur->vals[i] < keys[k]) i++;
+      if (i < cur->length) {
+        sum += cur->idxs[i];
+        break;
+      }
+      cur = cur->next;
+    }
+  }
+  return sum;
+}
+
+static size_t btree_lookups(BTree* tree, int* keys, size_t num) {
+  size_t sum = 0;
+  for (size_t k = 0; k < num; k++) {
+    size_t i;
+    BTreeLeaf* cur = btree_search(tree, keys[k], &i);
+    for (; cur; cur = btree_next_leaf(tree, cur), i = 0) {
+      if (i < cur->header.length) {
+        sum += cur->idxs[i];
+        break;
+      }
+    }
+  }
+  return sum;
+}
+
+int main(int argc, char** argv) {
+  size_t rows = argc > 1 ? strtoul(argv[1], NULL, 10) : 10000000;
+  size_t lookups = argc > 2 ? strtoul(argv[2], NULL, 10) : 5000000;
+
+  int* vals = malloc(sizeof(int) * rows);
+  size_t* idxs = malloc(sizeof(size_t) * rows);
+  srand(165);
+  for (size_t i = 0; i < rows; i++) vals[i] = rand() % VALUE_RANGE;
+  qsort(vals, rows, sizeof(int), compare_ints);
+  for (size_t i = 0; i < rows; i++) idxs[i] = i;
+
+  int* keys = malloc(sizeof(int) * lookups);
+  for (size_t k = 0; k < lookups; k++) keys[k] = rand() % VALUE_RANGE;
+
+  init_thread_pool();
+  size_t legacy_nodes;
+  double b0 = now();
+  LegacyNode* legacy = legacy_build(vals, idxs, rows, &legacy_nodes);
+  double b1 = now();
+  BTree tree;
+  open_btree(&tree, open(BENCH_FILE, O_CREAT | O_RDWR | O_TRUNC, 0600));
+  build_btree(&tree, vals, idxs, rows);
+  double b2 = now();
+  double legacy_mb = legacy_nodes * sizeof(LegacyNode) / 1e6;
+  double tree_mb = btree_memory(&tree) / 1e6;
+
+  sync_btree(&tree);
+  double o0 = now();
+  open_btree(&tree, open(BENCH_FILE, O_RDWR));
+  double o1 = now();
+
+  double t0 = now();
+  size_t legacy_sum = legacy_lookups(legacy, keys, lookups);
+  double t1 = now();
+  size_t tree_sum = btree_lookups(&tree, keys, lookups);
+  double t2 = now();
+
+  if (legacy_sum != tree_sum) {
+    fprintf(stderr, "lookup mismatch: %zu vs %zu\n", legacy_sum, tree_sum);
+    return 1;
+  }
+
+  printf("rows = %zu, lookups = %zu, workers = %zu\n\n", rows, lookups,
+         thread_pool_size());
+  printf("| Tree   | Build ms | Memory MB | Bytes/row | Mlookups/s |\n");
+  printf("| ------ | -------- | --------- | --------- | ---------- |\n");
+  printf("| legacy | %8.1f | %9.1f | %9.1f | %10.2f |\n", (b1 - b0) * 1e3,
+         legacy_mb, legacy_mb * 1e6 / rows, lookups / (t1 - t0) / 1e6);
+  printf("| btree  | %8.1f | %9.1f | %9.1f | %10.2f |\n", (b2 - b1) * 1e3,
+         tree_mb, tree_mb * 1e6 / rows, lookups / (t2 - t1) / 1e6);
+  printf("\nspeedup %.2fx, open %.3f ms\n", (t1 - t0) / (t2 - t1),
+         (o1 - o0) * 1e3);
+
+  legacy_free(legacy);
+  sync_btree(&tree);
+  unlink(BENCH_FILE);
+  free(vals);
+  free(idxs);
+  free(keys);
+  shutdown_thread_pool();
+  return 0;
+}
@@ -0,0 +1,175 @@
+/**
+ * bench_crack.c
+ *
+ * Measures the cumulative time of a sequence of range selects answered by
+ * a cracked index against the two extremes it sits between: scanning the
+ * whole column for every select, and sorting a copy of it up front (the
+ * sort is charged to the first select) and binary searching the copy.
+ * Cracking runs both plain and stochastic (a random crack first in any
+ * piece of at least CRACK_RANDOM_PIECE values).
+ *
+ * Two workloads of selects of the same width: random, which starts each
+ * range anywhere, and sequential, which sweeps the value domain from the
+ * bottom up, the pattern that leaves plain cracking a large unpartitioned
+ * piece to reorganize on every select.
+ *
+ * Usage: make bench O=3 && ./bench_crack [rows] [selects] [selectivity]
+ **/
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cracker.h"
+#include "scan.h"
+#include "utils.h"
+
+#define VALUE_RANGE 100000000
+#define NUM_STRATEGIES 4
+#define NUM_CHECKPOINTS 5
+
+typedef enum Strategy { SCAN, SORT, CRACK, STOCHASTIC } Strategy;
+
+static const char* strategy_names[NUM_STRATEGIES] = {"scan", "sort", "crack",
+                                                     "stochastic"};
+
+static double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Runs the selects [lows[q], lows[q] + width] on vals with strategy s,
+ * writing the cumulative time after each select to elapsed. Returns
+ * the number of positions all selects found.
+ **/
+static size_t run_selects(Strategy s, int* vals, uint32_t* ids, size_t rows,
+                          int* lows, int width, size_t selects,
+                          double* elapsed) {
+  size_t found = 0;
+  size_t capacity = rows + SCAN_PADDING;
+  int* output = malloc(sizeof(int) * capacity);
+  int* sorted = NULL;
+  size_t* sorted_ids = NULL;
+  CrackerIndex* index = NULL;
+
+  double start = now();
+  if (s == SORT) {
+    sorted = malloc(sizeof(int) * rows);
+    sorted_ids = malloc(sizeof(size_t) * rows);
+    memcpy(sorted, vals, sizeof(int) * rows);
+    for (size_t i = 0; i < rows; i++) sorted_ids[i] = i;
+    merge_sort(sorted, sorted_ids, 0, rows - 1);
+  } else if (s == CRACK || s == STOCHASTIC) {
+    index = build_cracker_index(vals, ids, rows);
+    if (s == CRACK) index->random_piece = SIZE_MAX;
+  }
+
+  for (size_t q = 0; q < selects; q++) {
+    int low = lows[q];
+    int high = low + width;
+    size_t res_size = 0;
+    switch (s) {
+      case SCAN:
+        res_size = scan_range(vals, rows, low, high, 0, output);
+        break;
+      case SORT: {
+        size_t first = binary_search(sorted, rows, low);
+        if (first < rows && sorted[first] < low) first++;
+        for (size_t i = first; i < rows && sorted[i] <= high; i++)
+          output[res_size++] = sorted_ids[i];
+        break;
+      }
+      case CRACK:
+      case STOCHASTIC:
+        cracker_select(index, ids, low, high, &output, &res_size, &capacity);
+        break;
+    }
+    found += res_size;
+    elapsed[q] = now() - start;
+  }
+
+  free(output);
+  free(sorted);
+  free(sorted_ids);
+  if (index) free_cracker_index(index);
+  return found;
+}
+
+static void report(const char* workload, double elapsed[][NUM_STRATEGIES],
+                   size_t selects) {
+  printf("%s workload, cumulative ms after n selects:\n\n", workload);
+  printf("| n        |");
+  for (int s = 0; s < NUM_STRATEGIES; s++)
+    printf(" %10s |", strategy_names[s]);
+  printf("\n| -------- |");
+  for (int s = 0; s < NUM_STRATEGIES; s++) printf(" ---------- |");
+  printf("\n");
+  for (size_t n = 1, c = 0; c < NUM_CHECKPOINTS; n *= 10, c++) {
+    if (n > selects) n = selects;
+    printf("| %8zu |", n);
+    for (int s = 0; s < NUM_STRATEGIES; s++)
+      printf(" %10.1f |", elapsed[n - 1][s] * 1e3);
+    printf("\n");
+    if (n == selects) break;
+  }
+  printf("\n");
+}
+
+int main(int argc, char** argv) {
+  size_t rows = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+  size_t selects = argc > 2 ? strtoul(argv[2], NULL, 10) : 10000;
+  double selectivity = argc > 3 ? atof(argv[3]) : 0.001;
+  int width = (int)(selectivity * VALUE_RANGE);
+
+  int* vals = malloc(sizeof(int) * rows);
+  uint32_t* ids = malloc(sizeof(uint32_t) * rows);
+  srand(165);
+  for (size_t i = 0; i < rows; i++) {
+    vals[i] = rand() % VALUE_RANGE;
+    ids[i] = i;
+  }
+
+  int* random_lows = malloc(sizeof(int) * selects);
+  int* sequential_lows = malloc(sizeof(int) * selects);
+  int step = (VALUE_RANGE - width) / (int)selects;
+  for (size_t q = 0; q < selects; q++) {
+    random_lows[q] = rand() % (VALUE_RANGE - width);
+    sequential_lows[q] = (int)q * (step > 0 ? step : 1);
+  }
+
+  printf("rows = %zu, selects = %zu, selectivity = %g\n\n", rows, selects,
+         selectivity);
+  const char* workloads[2] = {"random", "sequential"};
+  int* lows[2] = {random_lows, sequential_lows};
+  double(*elapsed)[NUM_STRATEGIES] =
+      malloc(sizeof(double) * NUM_STRATEGIES * selects);
+  double* times = malloc(sizeof(double) * selects);
+  for (int w = 0; w < 2; w++) {
+    size_t expected = 0;
+    for (int s = 0; s < NUM_STRATEGIES; s++) {
+      size_t found = run_selects((Strategy)s, vals, ids, rows, lows[w], width,
+                                 selects, times);
+      if (s == SCAN) expected = found;
+      if (found != expected) {
+        fprintf(stderr, "%s %s: found %zu positions, scan %zu\n",
+                workloads[w], strategy_names[s], found, expected);
+        return 1;
+      }
+      for (size_t q = 0; q < selects; q++) elapsed[q][s] = times[q];
+    }
+    report(workloads[w], elapsed, selects);
+  }
+
+  free(vals);
+  free(ids);
+  free(random_lows);
+  free(sequential_lows);
+  free(elapsed);
+  free(times);
+  return 0;
+}
@@ -0,0 +1,119 @@
+/**
+ * bench_select.c
+ *
+ * Measures full-column range select throughput of the scan kernels in
+ * scan.c against the original branchy select loop, for a range of
+ * selectivities. Throughput is input bytes scanned per second. The
+ * branching column is the scalar kernel choose_scan_kernel falls back to
+ * for very selective predicates on hardware without vector kernels.
+ *
+ * Usage: make bench O=3 && ./bench_select [rows] [runs]
+ **/
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "scan.h"
+#include "utils.h"
+
+#define VALUE_RANGE 1000000
+
+static double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// The select loop as it was before the scan kernels.
+static size_t legacy_select(int* input, size_t input_size, int p_low,
+                            int p_high, int** result) {
+  size_t res_size = 0;
+  size_t res_capacity = DEFAULT_CAPACITY;
+  int* output = malloc(sizeof(int) * res_capacity);
+  for (size_t i = 0; i < input_size; i++) {
+    if (res_size >= res_capacity) resize_array(&output, &res_capacity);
+    if (input[i] >= p_low && input[i] < p_high) output[res_size++] = i;
+  }
+  *result = output;
+  return res_size;
+}
+
+static size_t kernel_select(int* input, size_t input_size, int p_low,
+                            int p_high, ScanKernel kernel, int** result) {
+  int* output = malloc(sizeof(int) * (input_size + SCAN_PADDING));
+  size_t res_size =
+      kernel == BRANCHING
+          ? scan_range_branching(input, input_size, p_low, p_high - 1, 0,
+                                 output)
+          : scan_range(input, input_size, p_low, p_high - 1, 0, output);
+  *result = realloc(output, sizeof(int) * (res_size + 1));
+  return res_size;
+}
+
+int main(int argc, char** argv) {
+  size_t rows = argc > 1 ? strtoul(argv[1], NULL, 10) : 10000000;
+  int runs = argc > 2 ? atoi(argv[2]) : 5;
+
+  int* data = malloc(sizeof(int) * rows);
+  srand(165);
+  for (size_t i = 0; i < rows; i++) data[i] = rand() % VALUE_RANGE;
+
+  double selectivity[] = {0.001, 0.01, 0.1, 0.5, 0.9, 1.0};
+  size_t num_sel = sizeof(selectivity) / sizeof(selectivity[0]);
+  double gbytes = (double)rows * sizeof(int) / 1e9;
+
+  printf("rows = %zu, runs = %d, kernel = %s\n\n", rows, runs,
+         scan_kernel_name(PREDICATED));
+  printf("| Selectivity | Legacy GB/s | Branching GB/s | Kernel GB/s | "
+         "Speedup |\n");
+  printf("| ----------- | ----------- | -------------- | ----------- | "
+         "------- |\n");
+
+  for (size_t s = 0; s < num_sel; s++) {
+    int p_high = (int)(selectivity[s] * VALUE_RANGE);
+    double legacy = 0, branching = 0, kernel = 0;
+
+    for (int r = 0; r < runs; r++) {
+      int* out_legacy;
+      int* out_branching;
+      int* out_kernel;
+
+      double t0 = now();
+      size_t n_legacy = legacy_select(data, rows, 0, p_high, &out_legacy);
+      double t1 = now();
+      kernel_select(data, rows, 0, p_high, BRANCHING, &out_branching);
+      double t2 = now();
+      size_t n_kernel =
+          kernel_select(data, rows, 0, p_high, PREDICATED, &out_kernel);
+      double t3 = now();
+
+      legacy += t1 - t0;
+      branching += t2 - t1;
+      kernel += t3 - t2;
+      free(out_branching);
+
+      if (n_legacy != n_kernel) {
+        fprintf(stderr, "result size mismatch: %zu vs %zu\n", n_legacy,
+                n_kernel);
+        return 1;
+      }
+      for (size_t i = 0; i < n_legacy; i++)
+        if (out_legacy[i] != out_kernel[i]) {
+          fprintf(stderr, "result mismatch at %zu\n", i);
+          return 1;
+        }
+      free(out_legacy);
+      free(out_kernel);
+    }
+
+    printf("| %10.1f%% | %11.2f | %14.2f | %11.2f | %6.2fx |\n",
+           selectivity[s] * 100, gbytes * runs / legacy,
+           gbytes * runs / branching, gbytes * runs / kernel,
+           legacy / kernel);
+  }
+
+  free(data);
+  return 0;
+}
@@ -0,0 +1,257 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "bitmap.h"
+
+/*=== WAH ===*/
+
+static void wah_init(WahBitmap* bm) {
+  bm->words = NULL;
+  bm->num_words = 0;
+  bm->capacity = 0;
+  bm->groups = 0;
+  bm->count = 0;
+}
+
+static void wah_push(WahBitmap* bm, uint32_t word) {
+  if (bm->num_words == bm->capacity) {
+    bm->capacity = bm->capacity ? 2 * bm->capacity : 4;
+    bm->words = realloc(bm->words, sizeof(uint32_t) * bm->capacity);
+  }
+  bm->words[bm->num_words++] = word;
+}
+
+// Appends a run of groups groups, all ones or all zeros.
+static void wah_fill(WahBitmap* bm, size_t groups, bool ones) {
+  uint32_t kind = WAH_FILL | (ones ? WAH_ONES : 0);
+  if (bm->num_words > 0) {
+    uint32_t* last = bm->words + bm->num_words - 1;
+    if ((*last & ~WAH_RUN_MASK) == kind) {
+      size_t run = (*last & WAH_RUN_MASK) + groups;
+      if (run <= WAH_RUN_MASK) {
+        *last = kind | (uint32_t)run;
+        bm->groups += groups;
+        return;
+      }
+    }
+  }
+  wah_push(bm, kind | (uint32_t)groups);
+  bm->groups += groups;
+}
+
+/**
+ * Sets pos, which must lie past every position set so far. A literal that
+ * fills up is turned into a one fill (joining a fill right before it).
+ **/
+static void wah_append(WahBitmap* bm, size_t pos) {
+  size_t group = pos / WAH_GROUP;
+  uint32_t bit = UINT32_C(1) << (pos % WAH_GROUP);
+  bm->count++;
+
+  if (group + 1 == bm->groups && !(bm->words[bm->num_words - 1] & WAH_FILL)) {
+    uint32_t* last = bm->words + bm->num_words - 1;
+    *last |= bit;
+    if (*last == WAH_LITERAL_MASK) {
+      bm->num_words--;
+      bm->groups--;
+      wah_fill(bm, 1, true);
+    }
+    return;
+  }
+  if (group > bm->groups) wah_fill(bm, group - bm->groups, false);
+  wah_push(bm, bit);
+  bm->groups++;
+}
+
+// ORs the bitmap into bv, which must cover every position it sets.
+void wah_or(WahBitmap* bm, BitVector* bv) {
+  size_t num_words = BITVECTOR_WORDS(bv->length);
+  size_t start = 0;
+  for (size_t i = 0; i < bm->num_words; i++) {
+    uint32_t word = bm->words[i];
+    if (word & WAH_FILL) {
+      size_t end = start + (word & WAH_RUN_MASK) * WAH_GROUP;
+      if (word & WAH_ONES) bitvector_set_range(bv, start, end);
+      start = end;
+      continue;
+    }
+    size_t w = start / 64, offset = start % 64;
+    bv->words[w] |= (uint64_t)word << offset;
+    if (offset > 64 - WAH_GROUP && w + 1 < num_words)
+      bv->words[w + 1] |= (uint64_t)word >> (64 - offset);
+    start += WAH_GROUP;
+  }
+}
+
+// Writes the set positions in ascending order, returning their number.
+size_t wah_positions(WahBitmap* bm, int* output) {
+  size_t n = 0;
+  size_t start = 0;
+  for (size_t i = 0; i < bm->num_words; i++) {
+    uint32_t word = bm->words[i];
+    if (word & WAH_FILL) {
+      size_t end = start + (word & WAH_RUN_MASK) * WAH_GROUP;
+      if (word & WAH_ONES)
+        for (size_t pos = start; pos < end; pos++) output[n++] = pos;
+      start = end;
+      continue;
+    }
+    while (word) {
+      output[n++] = start + __builtin_ctz(word);
+      word &= word - 1;
+    }
+    start += WAH_GROUP;
+  }
+  return n;
+}
+
+/**
+ * Re-encodes bm with position drop removed (if drop < SIZE_MAX) and every
+ * position at or past from moved by shift. Runs before from are copied as
+ * they are.
+ **/
+static void wah_shift(WahBitmap* bm, size_t from, size_t drop, int shift) {
+  int* positions = malloc(sizeof(int) * (bm->count + 1));
+  size_t num = wah_positions(bm, positions);
+  free(bm->words);
+  wah_init(bm);
+  for (size_t i = 0; i < num; i++) {
+    size_t pos = positions[i];
+    if (pos == drop) continue;
+    wah_append(bm, pos >= from ? pos + shift : pos);
+  }
+  free(positions);
+}
+
+/*=== Index ===*/
+
+size_t bitmap_lower_bound(BitmapIndex* index, int val) {
+  size_t low = 0;
+  size_t high = index->num_values;
+  while (low < high) {
+    size_t mid = low + (high - low) / 2;
+    if (index->values[mid] < val)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  return low;
+}
+
+// Index of val's bitmap, added (empty) if val is new.
+static size_t bitmap_of(BitmapIndex* index, int val) {
+  size_t v = bitmap_lower_bound(index, val);
+  if (v < index->num_values && index->values[v] == val) return v;
+
+  if (index->num_values == index->capacity) {
+    index->capacity = index->capacity ? 2 * index->capacity : 16;
+    index->values = realloc(index->values, sizeof(int) * index->capacity);
+    index->bitmaps =
+        realloc(index->bitmaps, sizeof(WahBitmap) * index->capacity);
+  }
+  size_t tail = index->num_values - v;
+  memmove(index->values + v + 1, index->values + v, sizeof(int) * tail);
+  memmove(index->bitmaps + v + 1, index->bitmaps + v,
+          sizeof(WahBitmap) * tail);
+  index->values[v] = val;
+  wah_init(index->bitmaps + v);
+  index->num_values++;
+  return v;
+}
+
+BitmapIndex* build_bitmap_index(int* data, size_t length) {
+  BitmapIndex* index = calloc(sizeof(BitmapIndex), 1);
+  for (size_t i = 0; i < length; i++) {
+    size_t v = bitmap_of(index, data[i]);
+    wah_append(index->bitmaps + v, i);
+  }
+  return index;
+}
+
+void free_bitmap_index(BitmapIndex* index) {
+  if (index == NULL) return;
+  for (size_t v = 0; v < index->num_values; v++)
+    free(index->bitmaps[v].words);
+  free(index->values);
+  free(index->bitmaps);
+  free(index);
+}
+
+/**
+ * An insert at the end of the column only appends to the value's bitmap;
+ * anywhere else, every bitmap holding later positions is re-encoded with
+ * them moved up by one.
+ **/
+void bitmap_insert(BitmapIndex* index, int val, size_t pos, size_t length) {
+  size_t v = bitmap_of(index, val);
+  if (pos < length) {
+    for (size_t i = 0; i < index->num_values; i++) {
+      WahBitmap* bm = index->bitmaps + i;
+      if (bm->groups * WAH_GROUP > pos) wah_shift(bm, pos, SIZE_MAX, 1);
+    }
+    if (index->bitmaps[v].groups * WAH_GROUP > pos) {
+      // pos now sits before later positions of the same value.
+      WahBitmap* bm = index->bitmaps + v;
+      int* positions = malloc(sizeof(int) * (bm->count + 2));
+      size_t num = wah_positions(bm, positions);
+      free(bm->words);
+      wah_init(bm);
+      size_t i = 0;
+      for (; i < num && (size_t)positions[i] < pos; i++)
+        wah_append(bm, positions[i]);
+      wah_append(bm, pos);
+      for (; i < num; i++) wah_append(bm, positions[i]);
+      free(positions);
+      return;
+    }
+  }
+  wah_append(index->bitmaps + v, pos);
+}
+
+void bitmap_delete(BitmapIndex* index, size_t pos) {
+  size_t v = 0;
+  for (size_t i = 0; i < index->num_values; i++) {
+    WahBitmap* bm = index->bitmaps + i;
+    if (bm->groups * WAH_GROUP > pos) wah_shift(bm, pos + 1, pos, -1);
+    if (bm->count == 0) {
+      free(bm->words);
+      continue;
+    }
+    index->values[v] = index->values[i];
+    index->bitmaps[v++] = *bm;
+  }
+  index->num_values = v;
+}
+
+/*=== Persistence ===*/
+
+void sync_bitmap_index(BitmapIndex* index, FILE* fp) {
+  fwrite(&index->num_values, sizeof(size_t), 1, fp);
+  for (size_t v = 0; v < index->num_values; v++) {
+    WahBitmap* bm = index->bitmaps + v;
+    fwrite(index->values + v, sizeof(int), 1, fp);
+    fwrite(&bm->count, sizeof(size_t), 1, fp);
+    fwrite(&bm->groups, sizeof(size_t), 1, fp);
+    fwrite(&bm->num_words, sizeof(size_t), 1, fp);
+    fwrite(bm->words, sizeof(uint32_t), bm->num_words, fp);
+  }
+}
+
+BitmapIndex* load_bitmap_index(FILE* fp) {
+  BitmapIndex* index = calloc(sizeof(BitmapIndex), 1);
+  fread(&index->num_values, sizeof(size_t), 1, fp);
+  index->capacity = index->num_values;
+  index->values = malloc(sizeof(int) * (index->capacity + 1));
+  index->bitmaps = malloc(sizeof(WahBitmap) * (index->capacity + 1));
+  for (size_t v = 0; v < index->num_values; v++) {
+    WahBitmap* bm = index->bitmaps + v;
+    fread(index->values + v, sizeof(int), 1, fp);
+    fread(&bm->count, sizeof(size_t), 1, fp);
+    fread(&bm->groups, sizeof(size_t), 1, fp);
+    fread(&bm->num_words, sizeof(size_t), 1, fp);
+    bm->capacity = bm->num_words;
+    bm->words = malloc(sizeof(uint32_t) * (bm->capacity + 1));
+    fread(bm->words, sizeof(uint32_t), bm->num_words, fp);
+  }
+  return index;
+}
@@ -0,0 +1,208 @@
+#include <immintrin.h>
+#include <pthread.h>
+#include <string.h>
+
+#include "byteslice.h"
+#include "cs165_api.h"
+
+/**
+ * A value is split by flipping its sign bit (so unsigned order matches int
+ * order) and then flipping the top bit of every byte (so signed byte
+ * compares match unsigned byte order). Blocks are compared with AVX2 when
+ * the CPU has it and as two SSE2 halves otherwise.
+ **/
+
+// Fills one match mask per block for num_blocks blocks from value i on.
+typedef void (*MaskKernel)(const ByteSlices*, size_t, size_t, const int8_t*,
+                           const int8_t*, uint32_t*);
+
+// Blocks whose masks a scan collects before reading them off.
+#define MASK_RUN 64
+
+static MaskKernel mask_kernel;
+static pthread_once_t kernel_once = PTHREAD_ONCE_INIT;
+
+static void encode(int val, int8_t* out) {
+  uint32_t bits = (uint32_t)val ^ 0x80000000u;
+  for (int k = 0; k < BYTESLICE_BYTES; k++)
+    out[k] = (int8_t)(((bits >> (24 - 8 * k)) & 0xff) ^ 0x80);
+}
+
+/*=== Maintenance ===*/
+
+void init_byteslices(ByteSlices* slices) {
+  slices->capacity = 0;
+  for (int k = 0; k < BYTESLICE_BYTES; k++) slices->bytes[k] = NULL;
+}
+
+void free_byteslices(ByteSlices* slices) {
+  for (int k = 0; k < BYTESLICE_BYTES; k++) free(slices->bytes[k]);
+  init_byteslices(slices);
+}
+
+/**
+ * Re-encodes the values of col from position from to the end. Capacity
+ * stays a multiple of 64 past the column size so a scan can always read
+ * whole blocks.
+ **/
+void refresh_byteslices(Column* col, size_t from) {
+  if (!col->byte_sliced) return;
+  ByteSlices* slices = &col->slices;
+  if (col->size + 2 * BYTESLICE_BLOCK > slices->capacity) {
+    size_t capacity = slices->capacity ? slices->capacity : DEFAULT_CAPACITY;
+    while (capacity < col->size + 2 * BYTESLICE_BLOCK) capacity *= 2;
+    capacity = (capacity + 63) / 64 * 64;
+    for (int k = 0; k < BYTESLICE_BYTES; k++)
+      slices->bytes[k] = realloc(slices->bytes[k], capacity);
+    slices->capacity = capacity;
+  }
+
+  int8_t encoded[BYTESLICE_BYTES];
+  for (size_t i = from; i < col->size; i++) {
+    encode(col->data[i], encoded);
+    for (int k = 0; k < BYTESLICE_BYTES; k++)
+      slices->bytes[k][i] = encoded[k];
+  }
+}
+
+/*=== Block Kernels ===*/
+
+__attribute__((target("avx2"))) static void masks_avx2(
+    const ByteSlices* slices, size_t i, size_t num_blocks, const int8_t* low,
+    const int8_t* high, uint32_t* masks) {
+  __m256i l[BYTESLICE_BYTES], h[BYTESLICE_BYTES];
+  for (int k = 0; k < BYTESLICE_BYTES; k++) {
+    l[k] = _mm256_set1_epi8(low[k]);
+    h[k] = _mm256_set1_epi8(high[k]);
+  }
+  for (size_t b = 0; b < num_blocks; b++, i += BYTESLICE_BLOCK) {
+    __m256i eq_low = _mm256_set1_epi8(-1);
+    __m256i eq_high = eq_low;
+    __m256i gt_low = _mm256_setzero_si256();
+    __m256i lt_high = gt_low;
+    for (int k = 0; k < BYTESLICE_BYTES; k++) {
+      __m256i vals =
+          _mm256_loadu_si256((const __m256i*)(slices->bytes[k] + i));
+      gt_low = _mm256_or_si256(
+          gt_low, _mm256_and_si256(eq_low, _mm256_cmpgt_epi8(vals, l[k])));
+      lt_high = _mm256_or_si256(
+          lt_high, _mm256_and_si256(eq_high, _mm256_cmpgt_epi8(h[k], vals)));
+      eq_low = _mm256_and_si256(eq_low, _mm256_cmpeq_epi8(vals, l[k]));
+      eq_high = _mm256_and_si256(eq_high, _mm256_cmpeq_epi8(vals, h[k]));
+      __m256i undecided = _mm256_or_si256(eq_low, eq_high);
+      if (k + 1 >= BYTESLICE_EAGER && _mm256_testz_si256(undecided, undecided))
+        break;
+    }
+    __m256i hit = _mm256_and_si256(_mm256_or_si256(gt_low, eq_low),
+                                   _mm256_or_si256(lt_high, eq_high));
+    masks[b] = (uint32_t)_mm256_movemask_epi8(hit);
+  }
+}
+
+static void masks_sse2(const ByteSlices* slices, size_t i, size_t num_blocks,
+                       const int8_t* low, const int8_t* high,
+                       uint32_t* masks) {
+  __m128i l[BYTESLICE_BYTES], h[BYTESLICE_BYTES];
+  for (int k = 0; k < BYTESLICE_BYTES; k++) {
+    l[k] = _mm_set1_epi8(low[k]);
+    h[k] = _mm_set1_epi8(high[k]);
+  }
+  for (size_t b = 0; b < 2 * num_blocks; b++, i += BYTESLICE_BLOCK / 2) {
+    __m128i eq_low = _mm_set1_epi8(-1);
+    __m128i eq_high = eq_low;
+    __m128i gt_low = _mm_setzero_si128();
+    __m128i lt_high = gt_low;
+    for (int k = 0; k < BYTESLICE_BYTES; k++) {
+      __m128i vals = _mm_loadu_si128((const __m128i*)(slices->bytes[k] + i));
+      gt_low = _mm_or_si128(gt_low,
+                            _mm_and_si128(eq_low, _mm_cmpgt_epi8(vals, l[k])));
+      lt_high = _mm_or_si128(
+          lt_high, _mm_and_si128(eq_high, _mm_cmpgt_epi8(h[k], vals)));
+      eq_low = _mm_and_si128(eq_low, _mm_cmpeq_epi8(vals, l[k]));
+      eq_high = _mm_and_si128(eq_high, _mm_cmpeq_epi8(vals, h[k]));
+      if (k + 1 >= BYTESLICE_EAGER &&
+          _mm_movemask_epi8(_mm_or_si128(eq_low, eq_high)) == 0)
+        break;
+    }
+    __m128i hit = _mm_and_si128(_mm_or_si128(gt_low, eq_low),
+                                _mm_or_si128(lt_high, eq_high));
+    uint32_t half = (uint32_t)_mm_movemask_epi8(hit);
+    if (b % 2)
+      masks[b / 2] |= half << 16;
+    else
+      masks[b / 2] = half;
+  }
+}
+
+static void init_kernels() {
+  __builtin_cpu_init();
+  mask_kernel = __builtin_cpu_supports("avx2") ? masks_avx2 : masks_sse2;
+}
+
+/*=== Scan ===*/
+
+/**
+ * Computes the masks of the blocks covering values [start + i, start +
+ * length) (at most MASK_RUN of them), clearing the bits past length.
+ * Returns the number of blocks.
+ **/
+static size_t run_masks(const ByteSlices* slices, size_t start, size_t i,
+                        size_t length, const int8_t* low, const int8_t* high,
+                        uint32_t* masks) {
+  size_t remaining = length - i;
+  size_t num_blocks = (remaining + BYTESLICE_BLOCK - 1) / BYTESLICE_BLOCK;
+  if (num_blocks > MASK_RUN) num_blocks = MASK_RUN;
+  mask_kernel(slices, start + i, num_blocks, low, high, masks);
+  if (remaining < num_blocks * BYTESLICE_BLOCK)
+    masks[num_blocks - 1] &=
+        (uint32_t)((UINT64_C(1) << (remaining % BYTESLICE_BLOCK)) - 1);
+  return num_blocks;
+}
+
+size_t scan_byteslices(const ByteSlices* slices, size_t start, size_t length,
+                       int low, int high, int* output) {
+  pthread_once(&kernel_once, init_kernels);
+  int8_t low_bytes[BYTESLICE_BYTES], high_bytes[BYTESLICE_BYTES];
+  encode(low, low_bytes);
+  encode(high, high_bytes);
+
+  uint32_t masks[MASK_RUN];
+  size_t n = 0;
+  for (size_t i = 0; i < length; i += MASK_RUN * BYTESLICE_BLOCK) {
+    size_t num_blocks =
+        run_masks(slices, start, i, length, low_bytes, high_bytes, masks);
+    for (size_t b = 0; b < num_blocks; b++) {
+      uint32_t mask = masks[b];
+      size_t base = start + i + b * BYTESLICE_BLOCK;
+      while (mask) {
+        output[n++] = base + __builtin_ctz(mask);
+        mask &= mask - 1;
+      }
+    }
+  }
+  return n;
+}
+
+size_t scan_byteslices_bits(const ByteSlices* slices, size_t start,
+                            size_t length, int low, int high,
+                            uint64_t* words) {
+  pthread_once(&kernel_once, init_kernels);
+  int8_t low_bytes[BYTESLICE_BYTES], high_bytes[BYTESLICE_BYTES];
+  encode(low, low_bytes);
+  encode(high, high_bytes);
+
+  uint32_t masks[MASK_RUN];
+  size_t n = 0;
+  for (size_t i = 0; i < length; i += MASK_RUN * BYTESLICE_BLOCK) {
+    size_t num_blocks =
+        run_masks(slices, start, i, length, low_bytes, high_bytes, masks);
+    uint64_t* run_words = words + i / 64;
+    for (size_t b = 0; b < num_blocks; b += 2) {
+      uint64_t word = masks[b];
+      if (b + 1 < num_blocks) word |= (uint64_t)masks[b + 1] << 32;
+      run_words[b / 2] = word;
+      n += __builtin_popcountll(word);
+    }
+  }
+  return n;
+}
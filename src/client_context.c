@@ -56,6 +56,40 @@ size_t lookup_column_idx(Table* tbl, char* col_name) {
   return tbl->col_count;
 }
 
+Table* lookup_column_table(Column* col) {
+  for (size_t i = 0; current_db && i < current_db->size; i++) {
+    Table* tbl = current_db->tables + i;
+    if (col >= tbl->columns && col < tbl->columns + tbl->col_count)
+      return tbl;
+  }
+  return NULL;
+}
+
+Table* lookup_projection(Table* tbl, char* key) {
+  for (size_t i = 0; i < tbl->num_projections; i++) {
+    if (strcmp(tbl->projections[i]->columns[0].name, key) == 0)
+      return tbl->projections[i];
+  }
+  return NULL;
+}
+
+Column* lookup_projection_column(Result* ids, Column* col) {
+  Table* proj = ids->projection;
+  Table* tbl = lookup_column_table(col);
+  if (proj == NULL || tbl == NULL) return NULL;
+
+  bool owned = false;
+  for (size_t i = 0; i < tbl->num_projections; i++)
+    owned = owned || tbl->projections[i] == proj;
+  size_t idx = lookup_column_idx(proj, col->name);
+  // A write since the select may have moved the slice, even though the
+  // positions of the table are still valid.
+  if (!owned || idx == proj->col_count ||
+      ids->proj_writes != proj->columns[0].writes)
+    return NULL;
+  return proj->columns + idx;
+}
+
 int lookup_handle_id(ClientContext* context, char* name) {
   if (context && context->chandles_in_use > 0)
     for (int id = 0; id < context->chandles_in_use; id++) {
@@ -0,0 +1,216 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "cracker.h"
+#include "utils.h"
+
+/*=== Pieces ===*/
+
+static uint64_t next_random(CrackerIndex* index) {
+  uint64_t x = index->seed;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  return index->seed = x;
+}
+
+// The first boundary whose key is >= val, or num_bounds.
+static size_t bound_of(CrackerIndex* index, long val) {
+  size_t low = 0;
+  size_t high = index->num_bounds;
+  while (low < high) {
+    size_t mid = low + (high - low) / 2;
+    if (index->bounds[mid].key < val)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  return low;
+}
+
+static size_t piece_start(CrackerIndex* index, size_t b) {
+  return b > 0 ? index->bounds[b - 1].pos : 0;
+}
+
+static size_t piece_end(CrackerIndex* index, size_t b) {
+  return b < index->num_bounds ? index->bounds[b].pos : index->length;
+}
+
+static void add_bound(CrackerIndex* index, size_t b, long key, size_t pos) {
+  if (index->num_bounds == index->bounds_capacity) {
+    index->bounds_capacity *= 2;
+    index->bounds = realloc(index->bounds,
+                            sizeof(CrackBound) * index->bounds_capacity);
+  }
+  memmove(index->bounds + b + 1, index->bounds + b,
+          sizeof(CrackBound) * (index->num_bounds - b));
+  index->bounds[b].key = key;
+  index->bounds[b].pos = pos;
+  index->num_bounds++;
+}
+
+// Moves the values of [start, end) below val to its front and returns
+// where the rest begins.
+static size_t partition(CrackerIndex* index, size_t start, size_t end,
+                        long val) {
+  int* vals = index->vals;
+  uint32_t* ids = index->ids;
+  size_t i = start;
+  size_t j = end;
+  while (true) {
+    while (i < j && vals[i] < val) i++;
+    while (i < j && vals[j - 1] >= val) j--;
+    if (i >= j) return i;
+    j--;
+    int v = vals[i];
+    vals[i] = vals[j];
+    vals[j] = v;
+    uint32_t id = ids[i];
+    ids[i] = ids[j];
+    ids[j] = id;
+    i++;
+  }
+}
+
+size_t crack(CrackerIndex* index, long val) {
+  size_t b = bound_of(index, val);
+  if (b < index->num_bounds && index->bounds[b].key == val)
+    return index->bounds[b].pos;
+
+  size_t start = piece_start(index, b);
+  size_t end = piece_end(index, b);
+  if (end - start >= index->random_piece) {
+    long pivot = index->vals[start + next_random(index) % (end - start)];
+    if (pivot != val && (b == 0 || pivot != index->bounds[b - 1].key)) {
+      size_t pos = partition(index, start, end, pivot);
+      add_bound(index, b, pivot, pos);
+      if (pivot < val) {
+        start = pos;
+        b++;
+      } else {
+        end = pos;
+      }
+    }
+  }
+
+  size_t pos = partition(index, start, end, val);
+  add_bound(index, b, val, pos);
+  return pos;
+}
+
+/*=== Index ===*/
+
+CrackerIndex* build_cracker_index(int* data, uint32_t* ids, size_t length) {
+  CrackerIndex* index = calloc(sizeof(CrackerIndex), 1);
+  index->length = length;
+  index->capacity = length > 0 ? length : 1;
+  index->vals = malloc(sizeof(int) * index->capacity);
+  index->ids = malloc(sizeof(uint32_t) * index->capacity);
+  memcpy(index->vals, data, sizeof(int) * length);
+  memcpy(index->ids, ids, sizeof(uint32_t) * length);
+  index->bounds_capacity = DEFAULT_CAPACITY;
+  index->bounds = malloc(sizeof(CrackBound) * index->bounds_capacity);
+  index->random_piece = CRACK_RANDOM_PIECE;
+  index->seed = UINT64_C(0x9E3779B97F4A7C15);
+  pthread_mutex_init(&index->lock, NULL);
+  return index;
+}
+
+void free_cracker_index(CrackerIndex* index) {
+  free(index->vals);
+  free(index->ids);
+  free(index->bounds);
+  free(index);
+}
+
+void cracker_select(CrackerIndex* index, uint32_t* pos, int low, int high,
+                    int** output, size_t* res_size, size_t* res_capacity) {
+  if (low > high) return;
+  pthread_mutex_lock(&index->lock);
+  size_t start = crack(index, low);
+  size_t end = crack(index, (long)high + 1);
+  if (*res_size + (end - start) > *res_capacity) {
+    while (*res_size + (end - start) > *res_capacity) *res_capacity *= 2;
+    *output = realloc(*output, sizeof(int) * *res_capacity);
+  }
+  for (size_t i = start; i < end; i++)
+    (*output)[(*res_size)++] = pos[index->ids[i]];
+  pthread_mutex_unlock(&index->lock);
+}
+
+/**
+ * Opens a slot at the end of the piece of val by moving the first value of
+ * every later piece to that piece's end, starting from the last piece.
+ **/
+void cracker_insert(CrackerIndex* index, int val, uint32_t id) {
+  if (index->length == index->capacity) {
+    index->capacity *= 2;
+    index->vals = realloc(index->vals, sizeof(int) * index->capacity);
+    index->ids = realloc(index->ids, sizeof(uint32_t) * index->capacity);
+  }
+  size_t target = bound_of(index, (long)val + 1);
+  size_t hole = index->length;
+  for (size_t b = index->num_bounds; b-- > target;) {
+    size_t first = index->bounds[b].pos;
+    index->vals[hole] = index->vals[first];
+    index->ids[hole] = index->ids[first];
+    hole = first;
+    index->bounds[b].pos++;
+  }
+  index->vals[hole] = val;
+  index->ids[hole] = id;
+  index->length++;
+}
+
+/**
+ * Fills the slot of row id with the last value of its piece, then moves
+ * the last value of every later piece back into the slot that left behind.
+ **/
+void cracker_delete(CrackerIndex* index, int val, uint32_t id) {
+  size_t b = bound_of(index, (long)val + 1);
+  size_t i = piece_start(index, b);
+  size_t end = piece_end(index, b);
+  while (i < end && index->ids[i] != id) i++;
+  if (i == end) return;
+
+  for (size_t hole = i;; b++) {
+    size_t last = piece_end(index, b) - 1;
+    index->vals[hole] = index->vals[last];
+    index->ids[hole] = index->ids[last];
+    hole = last;
+    if (b == index->num_bounds) break;
+    index->bounds[b].pos--;
+  }
+  index->length--;
+}
+
+/*=== Persistence ===*/
+
+void sync_cracker_index(CrackerIndex* index, FILE* fp) {
+  fwrite(&index->length, sizeof(size_t), 1, fp);
+  fwrite(&index->num_bounds, sizeof(size_t), 1, fp);
+  fwrite(&index->seed, sizeof(uint64_t), 1, fp);
+  fwrite(index->vals, sizeof(int), index->length, fp);
+  fwrite(index->ids, sizeof(uint32_t), index->length, fp);
+  fwrite(index->bounds, sizeof(CrackBound), index->num_bounds, fp);
+}
+
+CrackerIndex* load_cracker_index(FILE* fp) {
+  CrackerIndex* index = calloc(sizeof(CrackerIndex), 1);
+  fread(&index->length, sizeof(size_t), 1, fp);
+  fread(&index->num_bounds, sizeof(size_t), 1, fp);
+  fread(&index->seed, sizeof(uint64_t), 1, fp);
+  index->capacity = index->length > 0 ? index->length : 1;
+  index->vals = malloc(sizeof(int) * index->capacity);
+  index->ids = malloc(sizeof(uint32_t) * index->capacity);
+  fread(index->vals, sizeof(int), index->length, fp);
+  fread(index->ids, sizeof(uint32_t), index->length, fp);
+  index->bounds_capacity = DEFAULT_CAPACITY;
+  while (index->bounds_capacity < index->num_bounds)
+    index->bounds_capacity *= 2;
+  index->bounds = malloc(sizeof(CrackBound) * index->bounds_capacity);
+  fread(index->bounds, sizeof(CrackBound), index->num_bounds, fp);
+  index->random_piece = CRACK_RANDOM_PIECE;
+  pthread_mutex_init(&index->lock, NULL);
+  return index;
+}
@@ -0,0 +1,170 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <emmintrin.h>
+#include <limits.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "css_tree.h"
+#include "utils.h"
+
+/*=== Layout ===*/
+
+// Sizes the directory levels for length sorted values.
+static void css_layout(CssTree* tree, size_t length) {
+  size_t blocks = (length + CSS_NODE_KEYS - 1) / CSS_NODE_KEYS;
+  size_t nodes[CSS_MAX_LEVELS];
+  size_t levels = 0;
+  for (size_t count = blocks; count > 1; levels++) {
+    count = (count + CSS_NODE_KEYS) / (CSS_NODE_KEYS + 1);
+    nodes[levels] = count;
+  }
+
+  size_t start = 0;
+  for (size_t l = 0; l < levels; l++) {
+    tree->level_start[l] = start;
+    tree->level_nodes[l] = nodes[levels - 1 - l];
+    start += tree->level_nodes[l];
+  }
+  tree->length = length;
+  tree->levels = levels;
+}
+
+static size_t css_num_nodes(const CssTree* tree) {
+  if (tree->levels == 0) return 0;
+  size_t last = tree->levels - 1;
+  return tree->level_start[last] + tree->level_nodes[last];
+}
+
+// Maps size bytes of the tree's file, growing or shrinking it first.
+static void css_map(CssTree* tree, size_t size) {
+  if (tree->file) munmap(tree->file, tree->file_size);
+  ftruncate(tree->fd, (off_t)size);
+  tree->file = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, tree->fd,
+                    0);
+  tree->file_size = size;
+  tree->keys = (int*)(tree->file + CSS_HEADER_SIZE);
+}
+
+/*=== Maintenance ===*/
+
+void open_css_tree(CssTree* tree, int fd) {
+  pthread_mutex_init(&tree->lock, NULL);
+  tree->fd = fd;
+  tree->file = NULL;
+  tree->file_size = 0;
+  tree->keys = NULL;
+  tree->stale = true;
+  css_layout(tree, 0);
+
+  struct stat sb;
+  if (fstat(fd, &sb) == 0 && (size_t)sb.st_size >= CSS_HEADER_SIZE) {
+    tree->file = mmap(NULL, sb.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+                      0);
+    tree->file_size = sb.st_size;
+    tree->keys = (int*)(tree->file + CSS_HEADER_SIZE);
+    CssHeader* header = (CssHeader*)tree->file;
+    css_layout(tree, header->length);
+    tree->stale = header->stale;
+  }
+}
+
+void build_css_tree(CssTree* tree, const int* vals, size_t length) {
+  css_layout(tree, length);
+  size_t num_nodes = css_num_nodes(tree);
+  css_map(tree, CSS_HEADER_SIZE + sizeof(int) * CSS_NODE_KEYS * num_nodes);
+
+  // Children of a node on level l each cover span leaf blocks.
+  size_t blocks = (length + CSS_NODE_KEYS - 1) / CSS_NODE_KEYS;
+  size_t span = 1;
+  for (size_t l = tree->levels; l-- > 0;) {
+    for (size_t n = 0; n < tree->level_nodes[l]; n++) {
+      int* keys = tree->keys + (tree->level_start[l] + n) * CSS_NODE_KEYS;
+      for (size_t c = 0; c < CSS_NODE_KEYS; c++) {
+        size_t child = n * (CSS_NODE_KEYS + 1) + c;
+        if (child * span >= blocks) {
+          keys[c] = INT_MAX;
+          continue;
+        }
+        size_t end = (child + 1) * span * CSS_NODE_KEYS;
+        keys[c] = vals[(end < length ? end : length) - 1];
+      }
+    }
+    span *= CSS_NODE_KEYS + 1;
+  }
+
+  CssHeader* header = (CssHeader*)tree->file;
+  header->length = length;
+  header->stale = 0;
+  tree->stale = false;
+  cs165_log(stdout, "CSS: built %zu levels, %zu nodes over %zu values\n",
+            tree->levels, num_nodes, length);
+}
+
+void invalidate_css_tree(CssTree* tree) {
+  pthread_mutex_lock(&tree->lock);
+  tree->stale = true;
+  if (tree->file) ((CssHeader*)tree->file)->stale = 1;
+  pthread_mutex_unlock(&tree->lock);
+}
+
+// Rebuilds the tree from vals if a write made it stale since.
+void refresh_css_tree(CssTree* tree, const int* vals, size_t length) {
+  pthread_mutex_lock(&tree->lock);
+  if (tree->stale || tree->length != length)
+    build_css_tree(tree, vals, length);
+  pthread_mutex_unlock(&tree->lock);
+}
+
+void sync_css_tree(CssTree* tree) {
+  if (tree->file) {
+    msync(tree->file, tree->file_size, MS_SYNC);
+    munmap(tree->file, tree->file_size);
+  }
+  close(tree->fd);
+  pthread_mutex_destroy(&tree->lock);
+}
+
+/*=== Search ===*/
+
+// Number of the CSS_NODE_KEYS keys of a node that are < val.
+static size_t count_less(const int* keys, int val) {
+  __m128i v = _mm_set1_epi32(val);
+  size_t count = 0;
+  for (size_t i = 0; i < CSS_NODE_KEYS; i += 4) {
+    __m128i k = _mm_loadu_si128((const __m128i*)(keys + i));
+    __m128i less = _mm_cmpgt_epi32(v, k);
+    count += __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(less)));
+  }
+  return count;
+}
+
+/**
+ * A child past the last one exists only when every value so far is < val,
+ * so reaching one means there is nothing >= val at all.
+ **/
+size_t css_lower_bound(const CssTree* tree, const int* vals, long val) {
+  if (val > INT_MAX) return tree->length;
+  if (val < INT_MIN) return 0;
+
+  size_t node = 0;
+  for (size_t l = 0; l < tree->levels; l++) {
+    const int* keys =
+        tree->keys + (tree->level_start[l] + node) * CSS_NODE_KEYS;
+    node = node * (CSS_NODE_KEYS + 1) + count_less(keys, val);
+    size_t below = l + 1 < tree->levels
+                       ? tree->level_nodes[l + 1]
+                       : (tree->length + CSS_NODE_KEYS - 1) / CSS_NODE_KEYS;
+    if (node >= below) return tree->length;
+  }
+
+  size_t start = node * CSS_NODE_KEYS;
+  if (start >= tree->length) return tree->length;
+  if (tree->length - start >= CSS_NODE_KEYS)
+    return start + count_less(vals + start, val);
+  size_t i = start;
+  while (i < tree->length && vals[i] < val) i++;
+  return i;
+}
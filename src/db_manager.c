@@ -8,9 +8,15 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include "bitmap.h"
 #include "btree.h"
+#include "cracker.h"
 #include "cs165_api.h"
+#include "css_tree.h"
 #include "db_manager.h"
+#include "hash_index.h"
+#include "index.h"
+#include "insert.h"
 #include "utils.h"
 
 Db* current_db;
@@ -19,9 +25,12 @@ static char db_path[PATH_SIZE];
 static char db_meta_path[PATH_SIZE];
 static char tbl_path[PATH_SIZE];
 static char tbl_meta_path[PATH_SIZE];
+static char row_ids_path[PATH_SIZE];
 static char col_path[PATH_SIZE];
 static char col_meta_path[PATH_SIZE];
 static char col_data_path[PATH_SIZE];
+static char zone_map_path[PATH_SIZE];
+static char byte_slices_path[PATH_SIZE];
 static char idx_path[PATH_SIZE];
 static char idx_data_path[PATH_SIZE];
 
@@ -31,12 +40,12 @@ bool not_current_db(char* db_name) {
 
 /*=== CREATE DB OBJECTS ===*/
 
-void create_column(char* name, Table* tbl) {
+static void add_column(char* name, Table* tbl, char* table_path,
+                       bool byte_sliced) {
   Column* col = tbl->columns + tbl->col_ready;
   strcpy(col->name, name);
 
-  sprintf(col_path, "%s/%s/%s/%s", DATA_DIR, current_db->name, tbl->name,
-          col->name);
+  sprintf(col_path, "%s/%s", table_path, col->name);
   mkdir(col_path, 0777);
 
   sprintf(col_data_path, "%s/col_data", col_path);
@@ -49,11 +58,21 @@ void create_column(char* name, Table* tbl) {
       mmap(0, length, PROT_READ | PROT_WRITE, MAP_SHARED, col->data_fd, 0);
 
   col->size = 0;
+  init_zonemap(&col->zones);
+  col->byte_sliced = byte_sliced;
+  init_byteslices(&col->slices);
   col->index.type = NONE;
+  pthread_mutex_init(&col->index.build_lock, NULL);
   col->clustered = false;
+  col->rows = tbl->rows;
   tbl->col_ready++;
 }
 
+void create_column(char* name, Table* tbl, bool byte_sliced) {
+  sprintf(tbl_path, "%s/%s/%s", DATA_DIR, current_db->name, tbl->name);
+  add_column(name, tbl, tbl_path, byte_sliced);
+}
+
 void create_table(Db* db, const char* name, size_t num_columns) {
   sprintf(tbl_path, "%s/%s/%s", DATA_DIR, current_db->name, name);
   mkdir(tbl_path, 0777);
@@ -74,9 +93,45 @@ void create_table(Db* db, const char* name, size_t num_columns) {
   new_tbl->size = 0;
   new_tbl->capacity = TABLE_CAPACITY;
   new_tbl->columns = calloc(sizeof(Column), num_columns);
+  new_tbl->rows = create_row_map(TABLE_CAPACITY);
   db->size++;
 }
 
+/**
+ * Copies the columns cols of tbl into a new projection clustered on
+ * cols[0], rows renamed to the ids they have in tbl.
+ **/
+void create_projection(Table* tbl, const char* name, size_t* cols,
+                       size_t num_cols) {
+  wait_index_builds(tbl);
+  char proj_path[PATH_SIZE];
+  sprintf(proj_path, "%s/%s/%s/%s", DATA_DIR, current_db->name, tbl->name,
+          name);
+  mkdir(proj_path, 0777);
+
+  Table* proj = calloc(sizeof(Table), 1);
+  strcpy(proj->name, name);
+  proj->col_count = num_cols;
+  proj->capacity = TABLE_CAPACITY;
+  proj->columns = calloc(sizeof(Column), num_cols);
+  proj->rows = create_row_map(TABLE_CAPACITY);
+  for (size_t i = 0; i < num_cols; i++)
+    add_column(tbl->columns[cols[i]].name, proj, proj_path, false);
+  proj->columns[0].clustered = true;
+  proj->columns[0].index.type = SORTED;
+
+  if (tbl->size > 0) {
+    int* vals[num_cols];
+    for (size_t i = 0; i < num_cols; i++) vals[i] = tbl->columns[cols[i]].data;
+    load_scheduler(proj, vals, tbl->size);
+  }
+  row_map_rename(proj->rows, tbl->rows->ids, proj->size, tbl->rows->next_id);
+
+  tbl->projections = realloc(tbl->projections,
+                             sizeof(Table*) * (tbl->num_projections + 1));
+  tbl->projections[tbl->num_projections++] = proj;
+}
+
 void add_db(const char* db_name) {
   sprintf(db_path, "%s/%s", DATA_DIR, db_name);
   mkdir(DATA_DIR, 0777);
@@ -97,6 +152,7 @@ void add_db(const char* db_name) {
 
 void sync_sorted_idx(Column* col) {
   if (col->clustered) return;
+  // A CssIndex starts with its SortedIndex.
   SortedIndex* payload = (SortedIndex*)(col->index.payload);
 
   size_t length;
@@ -114,18 +170,19 @@ void sync_sorted_idx(Column* col) {
   close(payload->pos_fd);
 }
 
-void sync_btree_idx(BTreeNode* node, FILE* fp) {
-  fwrite(node, sizeof(BTreeNode), 1, fp);
-  fwrite(node->vals, sizeof(int), node->length, fp);
-  if (node->is_leaf) {
-    fwrite(node->idxs, sizeof(size_t), node->length, fp);
-  } else {
-    for (size_t i = 0; i <= node->length; i++)
-      sync_btree_idx(node->children[i], fp);
-  }
+void sync_zonemap(ZoneMap* zones, FILE* fp) {
+  fwrite(zones->mins, sizeof(int), zones->num_zones, fp);
+  fwrite(zones->maxs, sizeof(int), zones->num_zones, fp);
+  fwrite(zones->sums, sizeof(long), zones->num_zones, fp);
+}
+
+void sync_byteslices(ByteSlices* slices, size_t size, FILE* fp) {
+  for (int k = 0; k < BYTESLICE_BYTES; k++)
+    fwrite(slices->bytes[k], 1, size, fp);
 }
 
 void sync_column(Column* col, char* table_path) {
+  wait_index_build(col);
   sprintf(col_path, "%s/%s", table_path, col->name);
   sprintf(idx_path, "%s/idx", col_path);
 
@@ -142,6 +199,22 @@ void sync_column(Column* col, char* table_path) {
   munmap(col->data, length);
   close(col->data_fd);
 
+  // save column zone map
+  path_join(zone_map_path, col_path, "zone_map");
+  fp = fopen(zone_map_path, "wb");
+  sync_zonemap(&col->zones, fp);
+  fclose(fp);
+  free_zonemap(&col->zones);
+
+  // save column byte slices
+  if (col->byte_sliced) {
+    path_join(byte_slices_path, col_path, "byte_slices");
+    fp = fopen(byte_slices_path, "wb");
+    sync_byteslices(&col->slices, col->size, fp);
+    fclose(fp);
+    free_byteslices(&col->slices);
+  }
+
   // save column index
   switch (col->index.type) {
     case NONE:
@@ -149,10 +222,31 @@ void sync_column(Column* col, char* table_path) {
     case SORTED:
       sync_sorted_idx(col);
       break;
-    case BTREE: {
-      sprintf(idx_data_path, "%s/b_tree", idx_path);
+    case BTREE:
+      sync_btree((BTree*)(col->index.payload));
+      break;
+    case BITMAP: {
+      path_join(idx_data_path, idx_path, "bitmaps");
+      fp = fopen(idx_data_path, "wb");
+      sync_bitmap_index((BitmapIndex*)(col->index.payload), fp);
+      fclose(fp);
+      break;
+    }
+    case CSS:
+      sync_sorted_idx(col);
+      sync_css_tree(&((CssIndex*)(col->index.payload))->tree);
+      break;
+    case HASH: {
+      path_join(idx_data_path, idx_path, "hash");
+      fp = fopen(idx_data_path, "wb");
+      sync_hash_index((HashIndex*)(col->index.payload), fp);
+      fclose(fp);
+      break;
+    }
+    case CRACKED: {
+      path_join(idx_data_path, idx_path, "cracker");
       fp = fopen(idx_data_path, "wb");
-      sync_btree_idx((BTreeNode*)(col->index.payload), fp);
+      sync_cracker_index((CrackerIndex*)(col->index.payload), fp);
       fclose(fp);
       break;
     }
@@ -171,8 +265,20 @@ void sync_table(Table* tbl, char* db_path) {
     fwrite(col->name, 1, NAME_SIZE, fp);
     sync_column(col, tbl_path);
   }
+  for (size_t i = 0; i < tbl->num_projections; i++)
+    fwrite(tbl->projections[i]->name, 1, NAME_SIZE, fp);
+  fclose(fp);
 
+  path_join(row_ids_path, tbl_path, "row_ids");
+  fp = fopen(row_ids_path, "wb");
+  sync_row_map(tbl->rows, tbl->size, fp);
   fclose(fp);
+
+  // Projections are tables inside this one's directory.
+  char path[PATH_SIZE];
+  strcpy(path, tbl_path);
+  for (size_t i = 0; i < tbl->num_projections; i++)
+    sync_table(tbl->projections[i], path);
 }
 
 void sync_db(Db* db) {
@@ -192,44 +298,75 @@ void sync_db(Db* db) {
 
 /*=== LOAD DB OBJECTS ===*/
 
-void load_sorted_idx(Column* col, int vals_fd, int pos_fd) {
-  SortedIndex* sorted_index = malloc(sizeof(SortedIndex));
-
-  struct stat sb;
-
+// Sync truncates the files to the column; they grow back to capacity
+// entries so inserts land inside the mapping.
+void load_sorted_idx(SortedIndex* sorted_index, int vals_fd, int pos_fd,
+                     size_t capacity) {
+  size_t length = sizeof(int) * capacity;
   sorted_index->vals_fd = vals_fd;
-  fstat(vals_fd, &sb);
+  ftruncate(vals_fd, (off_t)length);
   sorted_index->vals =
-      mmap(0, sb.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, vals_fd, 0);
+      mmap(0, length, PROT_READ | PROT_WRITE, MAP_SHARED, vals_fd, 0);
 
+  length = sizeof(size_t) * capacity;
   sorted_index->pos_fd = pos_fd;
-  fstat(pos_fd, &sb);
+  ftruncate(pos_fd, (off_t)length);
   sorted_index->pos =
-      mmap(0, sb.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, pos_fd, 0);
+      mmap(0, length, PROT_READ | PROT_WRITE, MAP_SHARED, pos_fd, 0);
+}
 
-  col->index.payload = sorted_index;
+/**
+ * Maps the column's B-tree file. A file from before the page layout, or
+ * none at all, gets the tree rebuilt from the column.
+ **/
+void load_btree_idx(Column* col, int fd) {
+  BTree* tree = malloc(sizeof(BTree));
+  col->index.payload = tree;
+  if (open_btree(tree, fd) || col->size == 0 || !index_ready(col)) return;
+
+  cs165_log(stdout, "BTREE: rebuilding %s from the column\n", col->name);
+  size_t* ids = row_ids(col->rows, col->size);
+  rebuild_index(col, ids);
+  free(ids);
 }
 
-BTreeNode* load_btree_node(FILE* fp) {
-  BTreeNode* node = malloc(sizeof(BTreeNode));
-  fread(node, sizeof(BTreeNode), 1, fp);
-  fread(node->vals, sizeof(int), node->length, fp);
-  if (node->is_leaf) {
-    fread(node->idxs, sizeof(size_t), node->length, fp);
-  } else {
-    for (size_t i = 0; i <= node->length; i++)
-      node->children[i] = load_btree_node(fp);
+void load_zonemap(Column* col, FILE* fp) {
+  ZoneMap* zones = &col->zones;
+  size_t num_zones = zones->num_zones;
+  init_zonemap(zones);
+  if (!fp || num_zones != ZONE_COUNT(col->size)) {
+    refresh_zonemap(col, 0);
+    return;
   }
-  return node;
+  zones->num_zones = zones->capacity = num_zones;
+  zones->mins = malloc(sizeof(int) * num_zones);
+  zones->maxs = malloc(sizeof(int) * num_zones);
+  zones->sums = malloc(sizeof(long) * num_zones);
+  fread(zones->mins, sizeof(int), num_zones, fp);
+  fread(zones->maxs, sizeof(int), num_zones, fp);
+  fread(zones->sums, sizeof(long), num_zones, fp);
 }
 
-void load_btree_idx(Column* col, FILE* fp) {
-  BTreeNode* root = load_btree_node(fp);
-  link_btree_nodes(root);
-  col->index.payload = root;
+void load_byteslices(Column* col, FILE* fp) {
+  ByteSlices* slices = &col->slices;
+  init_byteslices(slices);
+  if (!col->byte_sliced) return;
+  // Sizes the slices without encoding anything.
+  refresh_byteslices(col, col->size);
+  if (!fp) {
+    refresh_byteslices(col, 0);
+    return;
+  }
+  for (int k = 0; k < BYTESLICE_BYTES; k++) {
+    if (fread(slices->bytes[k], 1, col->size, fp) != col->size) {
+      refresh_byteslices(col, 0);
+      return;
+    }
+  }
 }
 
-void load_column(Column* col, char* col_name, char* table_path) {
+void load_column(Column* col, char* col_name, char* table_path,
+                 RowMap* rows, size_t capacity) {
   sprintf(col_path, "%s/%s", table_path, col_name);
   sprintf(col_meta_path, "%s/col_meta", col_path);
   sprintf(col_data_path, "%s/col_data", col_path);
@@ -239,12 +376,27 @@ void load_column(Column* col, char* col_name, char* table_path) {
   FILE* fp = fopen(col_meta_path, "rb");
   fread(col, sizeof(Column), 1, fp);
   fclose(fp);
+  col->rows = rows;
+  pthread_mutex_init(&col->index.build_lock, NULL);
+  col->index.building = false;
 
+  // Sync truncated the values to the column; inserts need the table's
+  // capacity mapped.
   col->data_fd = open(col_data_path, O_RDWR);
-  struct stat sb;
-  fstat(col->data_fd, &sb);
+  size_t length = sizeof(int) * capacity;
+  ftruncate(col->data_fd, (off_t)length);
   col->data =
-      mmap(0, sb.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, col->data_fd, 0);
+      mmap(0, length, PROT_READ | PROT_WRITE, MAP_SHARED, col->data_fd, 0);
+
+  path_join(zone_map_path, col_path, "zone_map");
+  fp = fopen(zone_map_path, "rb");
+  load_zonemap(col, fp);
+  if (fp) fclose(fp);
+
+  path_join(byte_slices_path, col_path, "byte_slices");
+  fp = col->byte_sliced ? fopen(byte_slices_path, "rb") : NULL;
+  load_byteslices(col, fp);
+  if (fp) fclose(fp);
 
   switch (col->index.type) {
     case NONE:
@@ -257,17 +409,55 @@ void load_column(Column* col, char* col_name, char* table_path) {
         sprintf(idx_data_path, "%s/sorted_pos", idx_path);
         int pos_fd = open(idx_data_path, O_RDWR, S_IRWXU);
 
-        load_sorted_idx(col, vals_fd, pos_fd);
+        col->index.payload = malloc(sizeof(SortedIndex));
+        load_sorted_idx((SortedIndex*)(col->index.payload), vals_fd, pos_fd,
+                        capacity);
       }
       break;
     }
-    case BTREE: {
+    case BTREE:
+      load_btree_idx(col, open(idx_data_path, O_CREAT | O_RDWR, S_IRWXU));
+      break;
+    case BITMAP: {
+      path_join(idx_data_path, idx_path, "bitmaps");
       fp = fopen(idx_data_path, "rb");
-      load_btree_idx(col, fp);
+      col->index.payload = load_bitmap_index(fp);
+      fclose(fp);
+      break;
+    }
+    case CSS: {
+      CssIndex* index = calloc(sizeof(CssIndex), 1);
+      if (!col->clustered) {
+        path_join(idx_data_path, idx_path, "sorted_vals");
+        int vals_fd = open(idx_data_path, O_RDWR, S_IRWXU);
+
+        path_join(idx_data_path, idx_path, "sorted_pos");
+        int pos_fd = open(idx_data_path, O_RDWR, S_IRWXU);
+
+        load_sorted_idx(&index->sorted, vals_fd, pos_fd, capacity);
+      }
+      path_join(idx_data_path, idx_path, "css_tree");
+      open_css_tree(&index->tree, open(idx_data_path, O_RDWR, S_IRWXU));
+      col->index.payload = index;
+      break;
+    }
+    case HASH: {
+      path_join(idx_data_path, idx_path, "hash");
+      fp = fopen(idx_data_path, "rb");
+      col->index.payload = load_hash_index(fp);
+      fclose(fp);
+      break;
+    }
+    case CRACKED: {
+      path_join(idx_data_path, idx_path, "cracker");
+      fp = fopen(idx_data_path, "rb");
+      col->index.payload = load_cracker_index(fp);
       fclose(fp);
       break;
     }
   }
+  // A lazy index saved before its first use is still waiting for it.
+  if (!index_ready(col)) schedule_index_build(col);
 }
 
 void load_table(Table* table, char* tbl_name, char* db_path) {
@@ -278,14 +468,33 @@ void load_table(Table* table, char* tbl_name, char* db_path) {
   FILE* fp = fopen(tbl_meta_path, "rb");
   fread(table, sizeof(Table), 1, fp);
 
+  // load table's row ids (positions if it predates them)
+  path_join(row_ids_path, tbl_path, "row_ids");
+  FILE* ids_fp = fopen(row_ids_path, "rb");
+  table->rows = load_row_map(ids_fp, table->size);
+  if (ids_fp) fclose(ids_fp);
+
   // load table's columns
   table->columns = malloc(sizeof(Column) * table->col_count);
   char col_name[NAME_SIZE];
   for (size_t i = 0; i < table->col_count; i++) {
     fread(col_name, 1, NAME_SIZE, fp);
-    load_column(table->columns + i, col_name, tbl_path);
+    load_column(table->columns + i, col_name, tbl_path, table->rows,
+                table->capacity);
   }
+
+  // load table's projections
+  char path[PATH_SIZE];
+  strcpy(path, tbl_path);
+  table->projections = malloc(sizeof(Table*) * (table->num_projections + 1));
+  char proj_names[table->num_projections + 1][NAME_SIZE];
+  for (size_t i = 0; i < table->num_projections; i++)
+    fread(proj_names[i], 1, NAME_SIZE, fp);
   fclose(fp);
+  for (size_t i = 0; i < table->num_projections; i++) {
+    table->projections[i] = malloc(sizeof(Table));
+    load_table(table->projections[i], proj_names[i], path);
+  }
 }
 
 Db* load_db(char* db_name) {
@@ -313,6 +522,7 @@ Db* load_db(char* db_name) {
 
 void free_column(Column* col) {
   if (col) {
+    wait_index_build(col);
     switch (col->index.type) {
       case NONE:
         break;
@@ -320,7 +530,19 @@ void free_column(Column* col) {
         if (!col->clustered) free(col->index.payload);
         break;
       case BTREE:
-        free_btree((BTreeNode*)(col->index.payload));
+        free(col->index.payload);
+        break;
+      case BITMAP:
+        free_bitmap_index((BitmapIndex*)(col->index.payload));
+        break;
+      case CSS:
+        free(col->index.payload);
+        break;
+      case HASH:
+        free_hash_index((HashIndex*)(col->index.payload));
+        break;
+      case CRACKED:
+        free_cracker_index((CrackerIndex*)(col->index.payload));
         break;
     }
   }
@@ -331,6 +553,12 @@ void free_table(Table* table) {
     for (size_t i = 0; i < table->col_count; i++)
       free_column(table->columns + i);
     free(table->columns);
+    free_row_map(table->rows);
+    for (size_t i = 0; i < table->num_projections; i++) {
+      free_table(table->projections[i]);
+      free(table->projections[i]);
+    }
+    free(table->projections);
   }
 }
 
@@ -380,6 +608,9 @@ void free_operator(DbOperator* query) {
         free(op.gen_col);
         break;
       }
+      case SELECT_AND:
+        free(query->operator_fields.select_and_operator.comparators);
+        break;
       case PRINT: {
         PrintOperator op = query->operator_fields.print_operator;
         for (size_t i = 0; i < op.handle_num; i++) free(op.handles[i]);
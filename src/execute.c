@@ -5,9 +5,12 @@
 #include "client_context.h"
 #include "cs165_api.h"
 #include "db_manager.h"
+#include "index.h"
 #include "insert.h"
 #include "join.h"
+#include "positions.h"
 #include "select.h"
+#include "setops.h"
 #include "update.h"
 #include "utils.h"
 
@@ -34,16 +37,39 @@ void select_scheduler(DbOperator* query) {
 
 Result* fetch(Column* col, Result* ids) {
   size_t size = ids->num_tuples;
-  int* input_ids = (int*)ids->payload;
   int* input_vals = col->data;
   int* output = malloc(sizeof(int) * size);
-
-  for (size_t i = 0; i < size; i++) output[i] = input_vals[input_ids[i]];
+  Column* proj_col = lookup_projection_column(ids, col);
+
+  if (proj_col) {
+    // The projection holds the values in the order of the positions.
+    memcpy(output, proj_col->data + ids->proj_start, sizeof(int) * size);
+  } else if (ids->data_type == BITVECTOR) {
+    BitVector* bv = (BitVector*)ids->payload;
+    size_t words = BITVECTOR_WORDS(bv->length);
+    size_t k = 0;
+    for (size_t w = 0; w < words; w++) {
+      uint64_t bits = bv->words[w];
+      while (bits) {
+        output[k++] = input_vals[w * 64 + __builtin_ctzll(bits)];
+        bits &= bits - 1;
+      }
+    }
+  } else if (ids->data_type == SLICE) {
+    memcpy(output, input_vals + ((Slice*)ids->payload)->start,
+           sizeof(int) * size);
+  } else {
+    int* input_ids = (int*)ids->payload;
+    for (size_t i = 0; i < size; i++) output[i] = input_vals[input_ids[i]];
+  }
 
   Result* result = calloc(sizeof(Result), 1);
   result->num_tuples = size;
   result->data_type = INT;
   result->payload = output;
+  result->source = col;
+  result->whole_source = all_positions(ids, col->size);
+  result->source_writes = col->writes;
   return result;
 }
 
@@ -52,10 +78,16 @@ Result* fetch(Column* col, Result* ids) {
 Result* avg_sum(GeneralizedColumn* gen_col, OperatorType op) {
   int* input = NULL;
   size_t input_size = 0;
+  BitVector* bv = NULL;
+  Slice* slice = NULL;
   switch (gen_col->column_type) {
     case RESULT: {
       input = (int*)gen_col->column_pointer.result->payload;
       input_size = gen_col->column_pointer.result->num_tuples;
+      if (gen_col->column_pointer.result->data_type == BITVECTOR)
+        bv = (BitVector*)gen_col->column_pointer.result->payload;
+      if (gen_col->column_pointer.result->data_type == SLICE)
+        slice = (Slice*)gen_col->column_pointer.result->payload;
       break;
     }
     case COLUMN: {
@@ -72,7 +104,23 @@ Result* avg_sum(GeneralizedColumn* gen_col, OperatorType op) {
   res->num_tuples = 1;
 
   long sum = 0;
-  for (size_t i = 0; i < input_size; i++) sum += (long)input[i];
+  if (gen_col->column_type == COLUMN) {
+    sum = zonemap_sum(&gen_col->column_pointer.column->zones);
+  } else if (slice) {
+    sum = (long)(slice->start + slice->end - 1) * (long)input_size / 2;
+  } else if (bv) {
+    size_t words = BITVECTOR_WORDS(bv->length);
+    for (size_t w = 0; w < words; w++) {
+      uint64_t bits = bv->words[w];
+      sum += (long)(w * 64) * __builtin_popcountll(bits);
+      while (bits) {
+        sum += __builtin_ctzll(bits);
+        bits &= bits - 1;
+      }
+    }
+  } else {
+    for (size_t i = 0; i < input_size; i++) sum += (long)input[i];
+  }
 
   switch (op) {
     case AVG: {
@@ -128,8 +176,17 @@ Result* max_min(Result* vals_res, OperatorType op) {
     res->num_tuples = 0;
     return res;
   }
-  int* input = (int*)vals_res->payload;
   int* output = malloc(sizeof(int));
+  res->num_tuples = 1;
+  res->data_type = INT;
+  res->payload = output;
+  if (vals_res->data_type == SLICE) {
+    Slice* slice = (Slice*)vals_res->payload;
+    *output = op == MAX ? (int)slice->end - 1 : (int)slice->start;
+    return res;
+  }
+
+  int* input = materialize_positions(vals_res);
   *output = input[0];
   switch (op) {
     case MAX: {
@@ -144,27 +201,40 @@ Result* max_min(Result* vals_res, OperatorType op) {
     default:
       break;
   }
-  res->num_tuples = 1;
-  res->data_type = INT;
-  res->payload = output;
+  release_positions(vals_res, input);
   return res;
 }
 
 /*=== JOIN ===*/
 
+/**
+ * The column vals was fetched from, if the column has a hash index and
+ * vals still holds all of it with pos its positions, so a hash join can
+ * probe the index, which answers with positions of its own, instead of
+ * building a table.
+ **/
+static Column* join_index(Result* vals, Result* pos) {
+  Column* col = vals->source;
+  if (col == NULL || col->index.type != HASH || !vals->whole_source ||
+      vals->source_writes != col->writes || !all_positions(pos, col->size) ||
+      !ensure_index(col))
+    return NULL;
+  return col;
+}
+
 void join(Result* val_res_l, Result* pos_res_l, Result* val_res_r,
           Result* pos_res_r, JoinType join_type, Result** res_l,
           Result** res_r) {
-  int* val_l = (int*)(val_res_l->payload);
-  int* pos_l = (int*)(pos_res_l->payload);
-  int* val_r = (int*)(val_res_r->payload);
-  int* pos_r = (int*)(pos_res_r->payload);
-
   if (val_res_l->num_tuples != pos_res_l->num_tuples ||
       val_res_r->num_tuples != pos_res_r->num_tuples) {
     log_err("Join Failed: val and pos length don't match");
     return;
   }
+
+  int* val_l = (int*)(val_res_l->payload);
+  int* pos_l = materialize_positions(pos_res_l);
+  int* val_r = (int*)(val_res_r->payload);
+  int* pos_r = materialize_positions(pos_res_r);
   size_t size_l = val_res_l->num_tuples;
   size_t size_r = val_res_r->num_tuples;
   size_t res_capacity = size_l > size_r ? size_l : size_r;
@@ -172,14 +242,25 @@ void join(Result* val_res_l, Result* pos_res_l, Result* val_res_r,
   int* output_l = malloc(sizeof(int) * res_capacity);
   int* output_r = malloc(sizeof(int) * res_capacity);
 
+  Column* index_l = join_index(val_res_l, pos_res_l);
+  Column* index_r = join_index(val_res_r, pos_res_r);
+
   size_t res_size = 0;
-  if (join_type == NESTED) {
+  if (join_type == HASH_JOIN && index_l && (!index_r || size_l >= size_r)) {
+    res_size = index_join(index_l, val_r, pos_r, size_r, &output_l, &output_r,
+                          &res_capacity);
+  } else if (join_type == HASH_JOIN && index_r) {
+    res_size = index_join(index_r, val_l, pos_l, size_l, &output_r, &output_l,
+                          &res_capacity);
+  } else if (join_type == NESTED_LOOP) {
     res_size = nested_loop_join(val_l, pos_l, val_r, pos_r, size_l, size_r,
                                 output_l, output_r);
-  } else if (join_type == HASH) {
-    res_size = hash_join(val_l, pos_l, val_r, pos_r, size_l, size_r, output_l,
-                         output_r);
+  } else if (join_type == HASH_JOIN) {
+    res_size = parallel_hash_join(val_l, pos_l, val_r, pos_r, size_l, size_r,
+                                  &output_l, &output_r, &res_capacity);
   }
+  release_positions(pos_res_l, pos_l);
+  release_positions(pos_res_r, pos_r);
 
   *res_l = calloc(sizeof(Result), 1);
   (*res_l)->num_tuples = res_size;
@@ -205,8 +286,12 @@ char* print(DbOperator* query) {
   buffer[0] = '\0';
 
   Result** res = malloc(sizeof(Result*) * handle_num);
-  for (size_t i = 0; i < handle_num; i++)
+  BitVectorIterator* bits = malloc(sizeof(BitVectorIterator) * handle_num);
+  for (size_t i = 0; i < handle_num; i++) {
     res[i] = lookup_handle_result(context, handles[i]);
+    if (res[i]->data_type == BITVECTOR)
+      bitvector_iterator(bits + i, (BitVector*)res[i]->payload);
+  }
 
   size_t num_tuples = res[0]->num_tuples;
 
@@ -228,6 +313,16 @@ char* print(DbOperator* query) {
         case DOUBLE: {
           double* payload = (double*)(res[j]->payload);
           buf_len += sprintf(buffer + strlen(buffer), "%.2f,", *payload);
+          break;
+        }
+        case BITVECTOR: {
+          int pos = bitvector_next(bits + j);
+          buf_len += sprintf(buffer + buf_len, "%d,", pos);
+          break;
+        }
+        case SLICE: {
+          Slice* slice = (Slice*)(res[j]->payload);
+          buf_len += sprintf(buffer + buf_len, "%zu,", slice->start + i);
         }
       }
       if (j >= handle_num - 1) buffer[buf_len - 1] = '\n';
@@ -235,6 +330,7 @@ char* print(DbOperator* query) {
   }
 
   free(res);
+  free(bits);
 
   if (buf_len == 0) {
     free(buffer);
@@ -285,6 +381,22 @@ char* execute_DbOperator(DbOperator* query) {
         update_context(query->context, op.handle, result);
         break;
       }
+      case SELECT_AND: {
+        SelectAndOperator op = query->operator_fields.select_and_operator;
+        result = conjunctive_select(op.comparators, op.num);
+        update_context(query->context, op.handle, result);
+        break;
+      }
+      case SELECT_FETCH: {
+        SelectFetchOperator op = query->operator_fields.select_fetch_operator;
+        Result* positions = NULL;
+        select_fetch(op.comparator, op.vals_col,
+                     op.pos_handle[0] ? &positions : NULL, &result);
+        if (op.pos_handle[0])
+          update_context(query->context, op.pos_handle, positions);
+        update_context(query->context, op.vals_handle, result);
+        break;
+      }
       case JOIN: {
         Result* res_l;
         Result* res_r;
@@ -316,10 +428,26 @@ char* execute_DbOperator(DbOperator* query) {
         update_context(query->context, op.handle, result);
         break;
       }
+      case AND:
+      case OR:
+      case ANDNOT: {
+        AndOrOperator op = query->operator_fields.and_or_operators;
+        if (op.pos_l == NULL || op.pos_r == NULL) {
+          log_err("Position list not found.");
+          break;
+        }
+        result = combine_positions(op.pos_l, op.pos_r, query->type);
+        update_context(query->context, op.handle, result);
+        break;
+      }
       case PRINT: {
         buffer = print(query);
         break;
       }
+      case ANALYZE: {
+        analyze_column(query->operator_fields.analyze_operator.col);
+        break;
+      }
       case CLOSE: {
         shutdown_database(current_db);
         break;
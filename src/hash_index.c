@@ -0,0 +1,167 @@
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "hash_index.h"
+
+/*=== Slots ===*/
+
+static size_t slot_of(HashIndex* index, int val) {
+  uint32_t hash = (uint32_t)val * UINT32_C(2654435769);
+  return ((uint64_t)hash * index->num_slots) >> 32;
+}
+
+// The slot holding val, or the empty slot where it would go.
+static HashEntry* probe(HashIndex* index, int val) {
+  size_t mask = index->num_slots - 1;
+  size_t s = slot_of(index, val);
+  while (index->slots[s].count > 0 && index->slots[s].key != val)
+    s = (s + 1) & mask;
+  return index->slots + s;
+}
+
+uint32_t* hash_entry_positions(HashEntry* entry) {
+  return entry->count == 1 ? &entry->at.pos : entry->at.list;
+}
+
+// A list has room for at least count rounded up to a power of two, so it
+// must grow before taking another row id when count is one.
+static bool list_full(uint32_t count) { return (count & (count - 1)) == 0; }
+
+// Adds the row id pos to entry, after the ids below it.
+static void entry_add(HashEntry* entry, uint32_t pos) {
+  if (entry->count == 0) {
+    entry->at.pos = pos;
+  } else if (entry->count == 1) {
+    uint32_t first = entry->at.pos;
+    entry->at.list = malloc(sizeof(uint32_t) * 2);
+    entry->at.list[pos < first] = first;
+    entry->at.list[pos > first] = pos;
+  } else {
+    if (list_full(entry->count))
+      entry->at.list =
+          realloc(entry->at.list, sizeof(uint32_t) * 2 * entry->count);
+    uint32_t* list = entry->at.list;
+    size_t i = entry->count;
+    for (; i > 0 && list[i - 1] > pos; i--) list[i] = list[i - 1];
+    list[i] = pos;
+  }
+  entry->count++;
+}
+
+static void resize_hash_index(HashIndex* index, size_t num_slots) {
+  HashEntry* old = index->slots;
+  size_t old_slots = index->num_slots;
+  index->slots = calloc(sizeof(HashEntry), num_slots);
+  index->num_slots = num_slots;
+  for (size_t s = 0; s < old_slots; s++)
+    if (old[s].count > 0) *probe(index, old[s].key) = old[s];
+  free(old);
+}
+
+// Empties slot s and moves back the entries probed past it.
+static void remove_slot(HashIndex* index, size_t s) {
+  size_t mask = index->num_slots - 1;
+  index->slots[s].count = 0;
+  index->num_keys--;
+  for (size_t next = (s + 1) & mask; index->slots[next].count > 0;
+       next = (next + 1) & mask) {
+    size_t home = slot_of(index, index->slots[next].key);
+    // Leave entries whose home lies cyclically in (s, next].
+    if ((next > s && home > s && home <= next) ||
+        (next < s && (home > s || home <= next)))
+      continue;
+    index->slots[s] = index->slots[next];
+    index->slots[next].count = 0;
+    s = next;
+  }
+}
+
+/*=== Index ===*/
+
+HashIndex* build_hash_index(int* data, uint32_t* ids, size_t length) {
+  HashIndex* index = calloc(sizeof(HashIndex), 1);
+  index->num_slots = HASH_INDEX_MIN_SLOTS;
+  while (index->num_slots * HASH_INDEX_LOAD < length) index->num_slots *= 2;
+  index->slots = calloc(sizeof(HashEntry), index->num_slots);
+  for (size_t i = 0; i < length; i++) {
+    HashEntry* entry = probe(index, data[i]);
+    if (entry->count == 0) {
+      entry->key = data[i];
+      index->num_keys++;
+    }
+    entry_add(entry, ids[i]);
+  }
+  return index;
+}
+
+void free_hash_index(HashIndex* index) {
+  for (size_t s = 0; s < index->num_slots; s++)
+    if (index->slots[s].count > 1) free(index->slots[s].at.list);
+  free(index->slots);
+  free(index);
+}
+
+HashEntry* hash_index_lookup(HashIndex* index, int val) {
+  HashEntry* entry = probe(index, val);
+  return entry->count > 0 ? entry : NULL;
+}
+
+void hash_index_insert(HashIndex* index, int val, uint32_t id) {
+  if (index->num_keys + 1 > index->num_slots * HASH_INDEX_LOAD)
+    resize_hash_index(index, 2 * index->num_slots);
+  HashEntry* entry = probe(index, val);
+  if (entry->count == 0) {
+    entry->key = val;
+    index->num_keys++;
+  }
+  entry_add(entry, id);
+}
+
+void hash_index_delete(HashIndex* index, int val, uint32_t id) {
+  HashEntry* entry = probe(index, val);
+  uint32_t* ids = hash_entry_positions(entry);
+  size_t i = 0;
+  while (i < entry->count && ids[i] != id) i++;
+  if (i == entry->count) return;
+
+  if (entry->count == 1) {
+    remove_slot(index, entry - index->slots);
+    return;
+  }
+  for (; i + 1 < entry->count; i++) ids[i] = ids[i + 1];
+  entry->count--;
+  if (entry->count == 1) {
+    uint32_t last = ids[0];
+    free(entry->at.list);
+    entry->at.pos = last;
+  }
+}
+
+/*=== Persistence ===*/
+
+void sync_hash_index(HashIndex* index, FILE* fp) {
+  fwrite(&index->num_slots, sizeof(size_t), 1, fp);
+  fwrite(&index->num_keys, sizeof(size_t), 1, fp);
+  fwrite(index->slots, sizeof(HashEntry), index->num_slots, fp);
+  for (size_t s = 0; s < index->num_slots; s++)
+    if (index->slots[s].count > 1)
+      fwrite(index->slots[s].at.list, sizeof(uint32_t), index->slots[s].count,
+             fp);
+}
+
+HashIndex* load_hash_index(FILE* fp) {
+  HashIndex* index = calloc(sizeof(HashIndex), 1);
+  fread(&index->num_slots, sizeof(size_t), 1, fp);
+  fread(&index->num_keys, sizeof(size_t), 1, fp);
+  index->slots = malloc(sizeof(HashEntry) * index->num_slots);
+  fread(index->slots, sizeof(HashEntry), index->num_slots, fp);
+  for (size_t s = 0; s < index->num_slots; s++) {
+    HashEntry* entry = index->slots + s;
+    if (entry->count <= 1) continue;
+    size_t capacity = 2;
+    while (capacity < entry->count) capacity *= 2;
+    entry->at.list = malloc(sizeof(uint32_t) * capacity);
+    fread(entry->at.list, sizeof(uint32_t), entry->count, fp);
+  }
+  return index;
+}
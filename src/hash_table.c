@@ -130,8 +130,13 @@ void hashtable_get(HashTable* ha_tbl, size_t key, Result* res) {
   while (bucket) {
     for (size_t i = 0; i < bucket->size; i++)
       if (key == bucket->key[i]) {
-        if (res->num_tuples + 1 >= DEFAULT_CAPACITY)
-            output = realloc(output, sizeof(int) * (res->num_tuples + 1));
+        // payload starts with DEFAULT_CAPACITY slots and doubles when a
+        // power of two past it fills up.
+        size_t n = res->num_tuples;
+        if (n >= DEFAULT_CAPACITY && (n & (n - 1)) == 0) {
+          output = realloc(output, sizeof(int) * 2 * n);
+          res->payload = output;
+        }
         output[res->num_tuples++] = bucket->val[i];
       }
 
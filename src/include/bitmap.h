@@ -0,0 +1,70 @@
+#ifndef BITMAP_H__
+#define BITMAP_H__
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "cs165_api.h"
+#include "positions.h"
+
+/**
+ * Word-aligned hybrid (WAH) compressed bitmap. Positions are cut into
+ * groups of 31, and every 32-bit word either spells out one group or
+ * stands for a run of identical groups:
+ *
+ *   top bits  |  meaning
+ * ----------- + ------------------------------------------------------
+ *      0      |  literal: bit b set <=> position 31 * group + b is set
+ *     1 f     |  fill: the next (word & WAH_RUN_MASK) groups are all f
+ *
+ * Positions are appended in ascending order; everything past the last
+ * group is 0. groups is the number of groups the words cover and count
+ * the number of set positions.
+ **/
+typedef struct WahBitmap {
+  uint32_t* words;
+  size_t num_words;
+  size_t capacity;
+  size_t groups;
+  size_t count;
+} WahBitmap;
+
+#define WAH_GROUP 31
+#define WAH_FILL (UINT32_C(1) << 31)
+#define WAH_ONES (UINT32_C(1) << 30)
+#define WAH_RUN_MASK (WAH_ONES - 1)
+#define WAH_LITERAL_MASK (WAH_FILL - 1)
+
+/**
+ * Bitmap index of a column: its distinct values in ascending order and,
+ * for each, a WAH bitmap of the positions holding it. Meant for columns of
+ * a few hundred distinct values at most; every value costs one bitmap.
+ *
+ * Persisted in the column's idx directory as "bitmaps": num_values, then
+ * per value the value, count, groups, num_words and the words.
+ **/
+typedef struct BitmapIndex {
+  int* values;
+  WahBitmap* bitmaps;
+  size_t num_values;
+  size_t capacity;
+} BitmapIndex;
+
+BitmapIndex* build_bitmap_index(int* data, size_t length);
+void free_bitmap_index(BitmapIndex* index);
+
+// Keep the index current when val is inserted at, or the value at, pos is
+// deleted from a column of length values (before the write).
+void bitmap_insert(BitmapIndex* index, int val, size_t pos, size_t length);
+void bitmap_delete(BitmapIndex* index, size_t pos);
+
+// Index of the first value >= val (num_values if none).
+size_t bitmap_lower_bound(BitmapIndex* index, int val);
+
+void wah_or(WahBitmap* bm, BitVector* bv);
+size_t wah_positions(WahBitmap* bm, int* output);
+
+void sync_bitmap_index(BitmapIndex* index, FILE* fp);
+BitmapIndex* load_bitmap_index(FILE* fp);
+
+#endif
@@ -2,38 +2,105 @@
 #define BTREE_H__
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
-#include "cs165_api.h"
+// Every node, leaf or internal, is one page: a single TLB entry and a whole
+// number of cache lines.
+#define BTREE_NODE_SIZE 4096
 
-#define FANOUT 408
+#define LEAF_FANOUT ((BTREE_NODE_SIZE - 16) / 8)
+#define INNER_FANOUT ((BTREE_NODE_SIZE - 12) / 8)
 
+// Share of a node a bulk load fills, leaving room for inserts before the
+// first splits.
+#define BTREE_FILL_FACTOR 0.9
+
+// Leaves a bulk load fills per task.
+#define BTREE_LOAD_GRAIN 256
+
+// Keys an in-node search still has left when it stops halving and counts
+// the rest with SIMD compares.
+#define BTREE_SEARCH_WINDOW 16
+
+// First bytes of a B-tree file; files written before the page layout lack
+// it and are rebuilt from the column.
+#define BTREE_MAGIC UINT64_C(0x3147504545525442)
+
+// Number of a page of a B-tree file. Page 0 holds the BTreeHeader, so no
+// node link is ever 0 and 0 stands for none.
+typedef uint32_t BTreePage;
+
+/**
+ * Header shared by both node kinds; a node pointer is cast to BTreeLeaf
+ * or BTreeInner by is_leaf.
+ **/
 typedef struct BTreeNode {
-  bool is_leaf;
-  int vals[FANOUT];
-  size_t idxs[FANOUT];
-  size_t length;
-  struct BTreeNode* children[FANOUT + 1];
-  struct BTreeNode* next;
+  uint32_t is_leaf;
+  uint32_t length;
 } BTreeNode;
-// size ~= 20 * FANOUT + 25, e.g. 8192 ~ 408
 
-BTreeNode* build_btree(int* vals, size_t* idxs, size_t length);
-BTreeNode* btree_search(BTreeNode* node, int val);
-void btree_insert(BTreeNode** node, int val, size_t val_pos, bool clustered);
-void btree_delete(BTreeNode* node, size_t pos);
-void link_btree_nodes(BTreeNode* node);
-void print_btree(BTreeNode* node);
-void free_btree(BTreeNode* node);
+/**
+ * Leaves hold only values and row ids; internal nodes only keys and
+ * children. Nodes link to each other by page number, never by pointer, so
+ * the file is the tree. Both fill a page exactly:
+ *
+ *  node  |  header  |  per entry              |  fanout
+ * ------ + -------- + ----------------------- + ------
+ *  leaf  |  8 + 8   |  4 (val) + 4 (row id)   |  510
+ *  inner |  8 + 4   |  4 (key) + 4 (child)    |  510
+ *
+ * Child i of an internal node holds the values from keys[i - 1] up to
+ * keys[i]; duplicates of a key may sit on both sides of it.
+ **/
+typedef struct BTreeLeaf {
+  BTreeNode header;
+  BTreePage next;
+  uint32_t unused;
+  int vals[LEAF_FANOUT];
+  uint32_t idxs[LEAF_FANOUT];
+} BTreeLeaf;
 
-typedef enum ShiftDirection { LEFT, RIGHT } ShiftDirection;
+typedef struct BTreeInner {
+  BTreeNode header;
+  int keys[INNER_FANOUT];
+  BTreePage children[INNER_FANOUT + 1];
+} BTreeInner;
 
-#endif
+typedef struct BTreeHeader {
+  uint64_t magic;
+  uint64_t root;
+  uint64_t num_pages;
+} BTreeHeader;
 
 /**
- *  type  |  size
- * ------ +  ----
- *  bool  |   1
- *  int   |   4
- * size_t |   8
- *  ptr*  |   8
+ * A B-tree lives in the column's idx/b_tree file: a page of BTreeHeader,
+ * then num_pages - 1 node pages in allocation order. The file is mmapped
+ * as it is at startup and updated in place; sync_btree flushes it. Pages
+ * are only appended (a bulk load starts the file over), and capacity
+ * pages are mapped so the descent of an insert never remaps.
  **/
+typedef struct BTree {
+  int fd;
+  char* file;
+  size_t capacity;
+} BTree;
+
+// Maps the tree in fd, or starts an empty one there and returns false if
+// fd holds none.
+bool open_btree(BTree* tree, int fd);
+void build_btree(BTree* tree, int* vals, size_t* idxs, size_t length);
+void sync_btree(BTree* tree);
+
+// Leftmost leaf that may hold val, and in slot the first entry >= val
+// (which may be past its end).
+BTreeLeaf* btree_search(BTree* tree, int val, size_t* slot);
+BTreeLeaf* btree_next_leaf(BTree* tree, BTreeLeaf* leaf);
+
+// Entries hold row ids; see RowMap.
+void btree_insert(BTree* tree, int val, uint32_t id);
+void btree_delete(BTree* tree, int val, uint32_t id);
+size_t btree_memory(BTree* tree);
+void print_btree(BTree* tree);
+
+#endif
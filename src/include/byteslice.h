@@ -0,0 +1,53 @@
+#ifndef BYTESLICE_H__
+#define BYTESLICE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Values a byte-sliced scan compares per step: one AVX2 register of bytes.
+#define BYTESLICE_BLOCK 32
+#define BYTESLICE_BYTES 4
+
+// Slices every block is compared on before a scan may stop early. Blocks
+// that need a later slice are scattered, and reading their bytes one cache
+// line at a time defeats the prefetcher, so the first two slices are
+// always streamed in full.
+#define BYTESLICE_EAGER 2
+
+/**
+ * Byte-sliced copy of a column, kept next to its data for columns created
+ * with the bitsliced option. bytes[k][i] is byte k (most significant
+ * first) of value i, encoded so that comparing the slices byte by byte as
+ * signed chars orders values like comparing the ints themselves.
+ *
+ * A range scan compares BYTESLICE_BLOCK values a slice at a time, keeping
+ * for each bound which values are already decided and which still tie
+ * with it. Once no value of the block ties with either bound the later
+ * slices cannot change the answer and are never read, so most blocks cost
+ * two bytes per value instead of four.
+ *
+ * Kept current by every write to the column and persisted next to its
+ * data as "byte_slices".
+ **/
+typedef struct ByteSlices {
+  size_t capacity;
+  int8_t* bytes[BYTESLICE_BYTES];
+} ByteSlices;
+
+struct Column;
+
+void init_byteslices(ByteSlices* slices);
+void free_byteslices(ByteSlices* slices);
+void refresh_byteslices(struct Column* col, size_t from);
+
+/**
+ * Range scans over values [start, start + length) of the slices, start a
+ * multiple of 64. Output contracts match scan_range (positions written as
+ * start + i) and scan_range_bits.
+ **/
+size_t scan_byteslices(const ByteSlices* slices, size_t start, size_t length,
+                       int low, int high, int* output);
+size_t scan_byteslices_bits(const ByteSlices* slices, size_t start,
+                            size_t length, int low, int high, uint64_t* words);
+
+#endif
@@ -11,6 +11,15 @@ Table* lookup_table(char* name);
 Column* lookup_column(char* tbl_name, char* name);
 size_t lookup_primary_column(Table* tbl);
 size_t lookup_column_idx(Table* tbl, char* col_name);
+
+// The table owning col, NULL for a projection's columns.
+Table* lookup_column_table(Column* col);
+// The projection of tbl sorted on the column named key, if any.
+Table* lookup_projection(Table* tbl, char* key);
+// The column named like col of the projection a select answered ids
+// from, or NULL when ids did not come from one of col's table or the
+// projection was written since.
+Column* lookup_projection_column(Result* ids, Column* col);
 Result* lookup_handle_result(ClientContext* context, char* name);
 
 #endif
@@ -0,0 +1,77 @@
+#ifndef CRACKER_H__
+#define CRACKER_H__
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// A query bound falling in a piece of at least this many values cracks it
+// at a random value of the piece first (stochastic cracking, DD1R), so a
+// sequential query pattern does not leave one huge piece to partition over
+// and over.
+#define CRACK_RANDOM_PIECE 16384
+
+/**
+ * Piece boundary of a cracker column: every value before pos is below key,
+ * every value from pos on is at least key.
+ **/
+typedef struct CrackBound {
+  long key;
+  size_t pos;
+} CrackBound;
+
+/**
+ * Cracked index of a column: a copy of the values with their row ids (the
+ * cracker column) that range selects partition a little further each time,
+ * and the boundaries between its pieces in ascending key order (the
+ * cracker index). A select cracks the pieces holding its two bounds and
+ * reads the positions in between, so the copy drifts toward sorted where
+ * the workload looks and stays untouched elsewhere.
+ *
+ *  pieces         |  values
+ * --------------- + ------------------------------------------
+ *  0              |  [0, bounds[0].pos), below bounds[0].key
+ *  b, 0 < b < n   |  [bounds[b - 1].pos, bounds[b].pos)
+ *  n              |  [bounds[n - 1].pos, length)
+ *
+ * Inserts and deletes ripple: they move one value per piece boundary
+ * between the value's piece and the end of the column, so the pieces stay
+ * valid and no delta has to be merged later.
+ *
+ * Selects crack under lock, since batched selects run on the pool.
+ * Persisted in the column's idx directory as "cracker": the header
+ * fields, then vals, ids and bounds as they are.
+ **/
+typedef struct CrackerIndex {
+  int* vals;
+  uint32_t* ids;
+  size_t length;
+  size_t capacity;
+  CrackBound* bounds;
+  size_t num_bounds;
+  size_t bounds_capacity;
+  size_t random_piece;
+  uint64_t seed;
+  pthread_mutex_t lock;
+} CrackerIndex;
+
+// Copies data[i] under the row id ids[i], in one piece.
+CrackerIndex* build_cracker_index(int* data, uint32_t* ids, size_t length);
+void free_cracker_index(CrackerIndex* index);
+
+// Cracks the column at val and returns the boundary position.
+size_t crack(CrackerIndex* index, long val);
+
+// Appends the positions (looked up in pos) of the values in [low, high] to
+// output, cracking at both bounds.
+void cracker_select(CrackerIndex* index, uint32_t* pos, int low, int high,
+                    int** output, size_t* res_size, size_t* res_capacity);
+
+void cracker_insert(CrackerIndex* index, int val, uint32_t id);
+void cracker_delete(CrackerIndex* index, int val, uint32_t id);
+
+void sync_cracker_index(CrackerIndex* index, FILE* fp);
+CrackerIndex* load_cracker_index(FILE* fp);
+
+#endif
@@ -20,12 +20,17 @@ SOFTWARE.
 #ifndef CS165_H
 #define CS165_H
 
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 
-#define PROC_NUM 16     // sysconf(_SC_NPROCESSORS_ONLN)
+#include "byteslice.h"
+#include "row_map.h"
+#include "stats.h"
+#include "zonemap.h"
+
 #define PAGE_SIZE 4096  // sysconf(_SC_PAGESIZE)
 #define CACHE_SIZE 32768
 #define CACHE_LINE_SIZE 64
@@ -37,7 +42,15 @@ SOFTWARE.
 #define TABLE_CAPACITY 256
 #define BUFFER_CAPACITY 256
 
-typedef enum IndexType { NONE, SORTED, BTREE } IndexType;
+typedef enum IndexType {
+  NONE,
+  SORTED,
+  BTREE,
+  BITMAP,
+  CSS,
+  HASH,
+  CRACKED
+} IndexType;
 
 typedef struct SortedIndex {
   int* vals;
@@ -46,11 +59,31 @@ typedef struct SortedIndex {
   int pos_fd;
 } SortedIndex;
 
+/**
+ * Whether an index answers selects. A load leaves every index of the
+ * column to be rebuilt: by a builder thread started right away, during
+ * which selects scan (BUILDING), or, for a lazy index, by the first select
+ * that would use it (PENDING). Writes wait for a builder and leave a
+ * PENDING index alone.
+ **/
+typedef enum IndexState {
+  INDEX_READY,
+  INDEX_PENDING,
+  INDEX_BUILDING
+} IndexState;
+
 typedef struct ColumnIndex {
   IndexType type;
   void* payload;
+  bool lazy;
+  IndexState state;
+  bool building;
+  pthread_t builder;
+  pthread_mutex_t build_lock;
 } ColumnIndex;
 
+// writes counts the inserts, loads and deletes that changed the column, so
+// a result can tell whether the column changed since it was computed.
 typedef struct Column {
   char name[NAME_SIZE];
   int* data;
@@ -58,8 +91,23 @@ typedef struct Column {
   size_t size;
   bool clustered;
   ColumnIndex index;
+  ZoneMap zones;
+  bool byte_sliced;
+  ByteSlices slices;
+  ColumnStats stats;
+  RowMap* rows;
+  size_t writes;
 } Column;
 
+/**
+ * A table may keep projections: redundant copies of some of its columns,
+ * each a table of its own clustered on its first column (its sort key), so
+ * that range selects on that key are a slice of the projection and fetches
+ * of the columns it holds read it sequentially. A projection's columns are
+ * named after the table's, its rows carry the table's row ids, and every
+ * insert, load and delete on the table is repeated on it. Projections are
+ * persisted as table directories inside the table's.
+ **/
 typedef struct Table {
   char name[NAME_SIZE];
   Column* columns;
@@ -67,6 +115,9 @@ typedef struct Table {
   size_t col_ready;
   size_t size;
   size_t capacity;
+  RowMap* rows;
+  struct Table** projections;
+  size_t num_projections;
 } Table;
 
 typedef struct Db {
@@ -93,15 +144,28 @@ typedef enum ComparatorType {
   EQUAL = 4,
   LESS_THAN_OR_EQUAL = 5,
   GREATER_THAN_OR_EQUAL = 6,
-  RANGE = 7
+  RANGE = 7,
+  IN_LIST = 8
 } ComparatorType;
 
-typedef enum DataType { INT, LONG, DOUBLE } DataType;
+typedef enum DataType { INT, LONG, DOUBLE, BITVECTOR, SLICE } DataType;
 
+// source is the column a fetch read the values from, NULL for anything
+// else. whole_source says the fetch read all of it, in position order,
+// when it had seen source_writes writes. A select answered from a
+// projection sets projection, and its positions are those of rows
+// [proj_start, proj_start + num_tuples) of it as long as its sort key has
+// seen proj_writes writes.
 typedef struct Result {
   void* payload;
   size_t num_tuples;
   DataType data_type;
+  Column* source;
+  bool whole_source;
+  size_t source_writes;
+  Table* projection;
+  size_t proj_start;
+  size_t proj_writes;
 } Result;
 
 typedef enum GeneralizedColumnType { RESULT, COLUMN } GeneralizedColumnType;
@@ -121,9 +185,13 @@ typedef struct GeneralizedColumnHandle {
   GeneralizedColumn generalized_column;
 } GeneralizedColumnHandle;
 
+// EQUAL compares against p_low; IN_LIST against the num_vals values of
+// p_vals.
 typedef struct Comparator {
   long int p_low;
   long int p_high;
+  int* p_vals;
+  size_t num_vals;
   GeneralizedColumn* gen_col;
   GeneralizedColumn* gen_col_id;
   ComparatorType type1;
@@ -138,6 +206,8 @@ typedef enum OperatorType {
   DELETE,
   SELECT,
   FETCH,
+  SELECT_FETCH,
+  SELECT_AND,
   JOIN,
   AVG,
   SUM,
@@ -145,7 +215,11 @@ typedef enum OperatorType {
   SUB,
   MAX,
   MIN,
+  AND,
+  OR,
+  ANDNOT,
   PRINT,
+  ANALYZE,
   CLOSE
 } OperatorType;
 
@@ -171,13 +245,26 @@ typedef struct SelectOperator {
   char handle[NAME_SIZE];
 } SelectOperator;
 
+typedef struct SelectAndOperator {
+  Comparator** comparators;
+  size_t num;
+  char handle[NAME_SIZE];
+} SelectAndOperator;
+
+typedef struct SelectFetchOperator {
+  Comparator* comparator;
+  Column* vals_col;
+  char pos_handle[NAME_SIZE];
+  char vals_handle[NAME_SIZE];
+} SelectFetchOperator;
+
 typedef struct FetchOperator {
   Column* vals_col;
   Result* ids_res;
   char handle[NAME_SIZE];
 } FetchOperator;
 
-typedef enum JoinType { NESTED, HASH } JoinType;
+typedef enum JoinType { NESTED_LOOP, HASH_JOIN } JoinType;
 
 typedef struct JoinOperator {
   Result* val_l;
@@ -205,22 +292,36 @@ typedef struct MaxMinOperator {
   char handle[NAME_SIZE];
 } MaxMinOperator;
 
+typedef struct AndOrOperator {
+  Result* pos_l;
+  Result* pos_r;
+  char handle[NAME_SIZE];
+} AndOrOperator;
+
 typedef struct PrintOperator {
   char** handles;
   size_t handle_num;
 } PrintOperator;
 
+typedef struct AnalyzeOperator {
+  Column* col;
+} AnalyzeOperator;
+
 typedef union OperatorFields {
   InsertOperator insert_operator;
   UpdateOperator update_operator;
   DeleteOperator delete_operator;
   SelectOperator select_operator;
   FetchOperator fetch_operator;
+  SelectFetchOperator select_fetch_operator;
+  SelectAndOperator select_and_operator;
   JoinOperator join_operator;
   AvgSumOperator avg_sum_operators;
   AddSubOperator add_sub_operators;
   MaxMinOperator max_min_operators;
+  AndOrOperator and_or_operators;
   PrintOperator print_operator;
+  AnalyzeOperator analyze_operator;
 } OperatorFields;
 
 typedef struct BatchSelect {
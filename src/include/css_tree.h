@@ -0,0 +1,76 @@
+#ifndef CSS_TREE_H__
+#define CSS_TREE_H__
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cs165_api.h"
+
+// Keys of a directory node, one cache line; a node has one child more.
+#define CSS_NODE_KEYS 16
+#define CSS_MAX_LEVELS 16
+
+// Bytes before the keys in the css_tree file: a CssHeader padded to a
+// cache line.
+#define CSS_HEADER_SIZE 64
+
+/**
+ * Cache-sensitive search tree (CSS-tree) over a sorted array. The sorted
+ * values are the leaves, cut into blocks of CSS_NODE_KEYS. Above them sits
+ * a directory of full nodes laid out level by level, root first, in one
+ * flat array without pointers:
+ *
+ *  node         |  children
+ * ------------- + -----------------------------------------------------
+ *  n, level l   |  n * (CSS_NODE_KEYS + 1) + c, c <= CSS_NODE_KEYS, on
+ *               |  level l + 1, or leaf blocks below the last level
+ *
+ * Key c of a node is the largest value under child c (INT_MAX past the
+ * last child), so a search descends into the first child whose largest
+ * value is at least the one it looks for and reads one line per level.
+ *
+ * The directory lives in the column's idx/css_tree file, a CssHeader and
+ * then the keys, which is mmapped as it is at startup. Writes to the
+ * column only mark it stale; the next search rebuilds it.
+ **/
+typedef struct CssHeader {
+  uint64_t length;
+  uint64_t stale;
+} CssHeader;
+
+typedef struct CssTree {
+  int fd;
+  char* file;
+  size_t file_size;
+  int* keys;
+  size_t length;
+  size_t levels;
+  size_t level_start[CSS_MAX_LEVELS];
+  size_t level_nodes[CSS_MAX_LEVELS];
+  bool stale;
+  pthread_mutex_t lock;
+} CssTree;
+
+/**
+ * Payload of a CSS index: a sorted copy of the column as a SORTED index
+ * keeps it (unused on a clustered column, which is sorted itself) and the
+ * directory over it.
+ **/
+typedef struct CssIndex {
+  SortedIndex sorted;
+  CssTree tree;
+} CssIndex;
+
+void open_css_tree(CssTree* tree, int fd);
+void build_css_tree(CssTree* tree, const int* vals, size_t length);
+void invalidate_css_tree(CssTree* tree);
+void refresh_css_tree(CssTree* tree, const int* vals, size_t length);
+void sync_css_tree(CssTree* tree);
+
+// First index of vals (the array the tree was built over) holding a value
+// >= val, or the tree's length if there is none.
+size_t css_lower_bound(const CssTree* tree, const int* vals, long val);
+
+#endif
@@ -10,7 +10,9 @@ Db* load_db(char* db_name);
 void add_db(const char* db_name);
 
 void create_table(Db* db, const char* name, size_t num_columns);
-void create_column(char* name, Table* table);
+void create_column(char* name, Table* table, bool byte_sliced);
+void create_projection(Table* tbl, const char* name, size_t* cols,
+                       size_t num_cols);
 
 /**
  * cleaning utilities
@@ -20,7 +22,6 @@ void free_result(Result* result);
 void free_batch(BatchSelect* batch);
 void free_context(ClientContext* context);
 void free_operator(DbOperator* query);
-void free_btree(BTreeNode* node);
 
 void shutdown_database(Db* db);
 
@@ -0,0 +1,65 @@
+#ifndef HASH_INDEX_H__
+#define HASH_INDEX_H__
+
+#include <stdint.h>
+#include <stdio.h>
+
+// The table doubles once more than this share of its slots is taken.
+#define HASH_INDEX_LOAD 0.5
+#define HASH_INDEX_MIN_SLOTS 16
+
+/**
+ * One slot of a hash index, four to a cache line. A value held by a single
+ * row, the common case on a key column, keeps its row id inline; otherwise
+ * list holds the row ids in ascending order, with room for count rounded
+ * up to a power of two.
+ *
+ *  count |  slot
+ * ------ + ----------------------------------
+ *    0   |  empty
+ *    1   |  key, pos
+ *   > 1  |  key, list[count]
+ **/
+typedef struct HashEntry {
+  int key;
+  uint32_t count;
+  union {
+    uint32_t pos;
+    uint32_t* list;
+  } at;
+} HashEntry;
+
+/**
+ * Hash index of a column: an open addressing table from value to the ids
+ * of the rows holding it, probed linearly from a multiplicative hash of the
+ * value. Deletes shift later entries back instead of leaving tombstones,
+ * so a probe ends at the first empty slot.
+ *
+ * Persisted in the column's idx directory as "hash": num_slots and
+ * num_keys, the slot array as it is, then the lists of the slots holding
+ * more than one row in slot order.
+ **/
+typedef struct HashIndex {
+  HashEntry* slots;
+  size_t num_slots;
+  size_t num_keys;
+} HashIndex;
+
+// Indexes data[i] under the row id ids[i].
+HashIndex* build_hash_index(int* data, uint32_t* ids, size_t length);
+void free_hash_index(HashIndex* index);
+
+// The slot of val, or NULL if no row holds it.
+HashEntry* hash_index_lookup(HashIndex* index, int val);
+
+uint32_t* hash_entry_positions(HashEntry* entry);
+
+// Keep the index current when the row id holding val is inserted or
+// deleted.
+void hash_index_insert(HashIndex* index, int val, uint32_t id);
+void hash_index_delete(HashIndex* index, int val, uint32_t id);
+
+void sync_hash_index(HashIndex* index, FILE* fp);
+HashIndex* load_hash_index(FILE* fp);
+
+#endif
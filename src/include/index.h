@@ -5,8 +5,14 @@ void init_sorted_index(Column* col, size_t* idxs);
 
 void delete_index(Column* col, size_t pos);
 
-void insert_index(Column* col, int val, size_t val_pos);
+void insert_index(Column* col, int val, size_t pos, uint32_t id);
 
 void rebuild_index(Column* col, size_t* idxs);
 
+void schedule_index_build(Column* col);
+bool index_ready(Column* col);
+bool ensure_index(Column* col);
+void wait_index_build(Column* col);
+void wait_index_builds(Table* tbl);
+
 #endif
\ No newline at end of file
@@ -2,6 +2,7 @@
 #define INSERT_H
 
 void insert_scheduler(Table* table, int* values);
+void load_scheduler(Table* table, int** vals, size_t size);
 
 void receive_and_load(int client_fd);
 
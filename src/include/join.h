@@ -1,15 +1,21 @@
 #ifndef JOIN_H__
 #define JOIN_H__
 
+#include "cs165_api.h"
 #include "hash_table.h"
 
+// One probe task of parallel_hash_join: probes val_r[start, end) and
+// collects its matches in private output buffers.
 typedef struct HashJoinArgs {
   HashTable* ha_tbl;
   int* val_r;
   int* pos_r;
+  size_t start;
+  size_t end;
   int* output_l;
   int* output_r;
-  size_t* offset;
+  size_t size;
+  size_t capacity;
 } HashJoinArgs;
 
 size_t nested_loop_join(int* val_l, int* pos_l, int* val_r, int* pos_r,
@@ -24,7 +30,10 @@ size_t hash_join(int* val_l, int* pos_l, int* val_r, int* pos_r, size_t size_l,
                  size_t size_r, int* output_l, int* output_r);
 
 size_t parallel_hash_join(int* val_l, int* pos_l, int* val_r, int* pos_r,
-                          size_t size_l, size_t size_r, int* output_l,
-                          int* output_r);
+                          size_t size_l, size_t size_r, int** output_l,
+                          int** output_r, size_t* capacity);
+
+size_t index_join(Column* col, int* val_r, int* pos_r, size_t size_r,
+                  int** output_l, int** output_r, size_t* capacity);
 
 #endif
\ No newline at end of file
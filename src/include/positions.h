@@ -0,0 +1,66 @@
+#ifndef POSITIONS_H__
+#define POSITIONS_H__
+
+#include <stdint.h>
+
+#include "cs165_api.h"
+
+/**
+ * A position list can be carried by a Result in more than one form:
+ *
+ *  data_type |  payload
+ * ---------- + -----------------------------------------------
+ *    INT     |  int[num_tuples], one position per tuple
+ * BITVECTOR  |  BitVector, bit i set <=> position i qualifies
+ *   SLICE    |  Slice, every position in [start, end)
+ *
+ * num_tuples is always the number of qualifying positions.
+ **/
+
+typedef struct Slice {
+  size_t start;
+  size_t end;
+} Slice;
+
+Result* slice_result(size_t start, size_t end);
+Result* copy_result(Result* res);
+
+typedef struct BitVector {
+  size_t length;
+  uint64_t words[];
+} BitVector;
+
+#define BITVECTOR_WORDS(length) (((length) + 63) / 64)
+
+BitVector* create_bitvector(size_t length);
+size_t bitvector_count(BitVector* bv);
+size_t bitvector_to_positions(BitVector* bv, int* output);
+// Sets every bit in [start, end).
+void bitvector_set_range(BitVector* bv, size_t start, size_t end);
+Result* bitvector_result(BitVector* bv, size_t num_tuples);
+
+/**
+ * Iterates over the set positions of a bit vector in ascending order.
+ * bitvector_next returns -1 once the vector is exhausted.
+ **/
+typedef struct BitVectorIterator {
+  BitVector* bv;
+  size_t word;
+  uint64_t bits;
+} BitVectorIterator;
+
+void bitvector_iterator(BitVectorIterator* it, BitVector* bv);
+int bitvector_next(BitVectorIterator* it);
+
+/**
+ * Returns the positions of a result as a plain int array, converting it if
+ * the result is not already an INT position list. The array must be handed
+ * back with release_positions.
+ **/
+int* materialize_positions(Result* res);
+void release_positions(Result* res, int* positions);
+
+// Whether res holds every position of a column of size rows, in order.
+bool all_positions(Result* res, size_t size);
+
+#endif
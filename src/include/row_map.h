@@ -0,0 +1,64 @@
+#ifndef ROW_MAP_H__
+#define ROW_MAP_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Position of a row id whose row was deleted. Row ids are never reused.
+#define ROW_DELETED UINT32_MAX
+
+/**
+ * Row ids of a table: every row gets the next id when it is inserted or
+ * loaded and keeps it until it is deleted, wherever clustered inserts and
+ * deletes move it. Indexes other than bitmaps hold row ids rather than
+ * positions, so a write never touches the entries of rows it merely moves;
+ * a read through one of them looks the positions up in pos.
+ *
+ *  array |  indexed by  |  holds
+ * ------ + ------------ + -----------------------------------------
+ *   ids  |  position    |  row id, as many as the table has rows
+ *   pos  |  row id      |  position or ROW_DELETED, next_id of them
+ *
+ * The columns of a table share its RowMap. Only ids and next_id are
+ * persisted, in the table directory as "row_ids"; pos is rebuilt from
+ * them on load. Both arrays double as the table and its ids grow.
+ **/
+typedef struct RowMap {
+  uint32_t* ids;
+  uint32_t* pos;
+  size_t next_id;
+  size_t capacity;
+  size_t pos_capacity;
+} RowMap;
+
+RowMap* create_row_map(size_t capacity);
+void free_row_map(RowMap* rows);
+
+// Gives a row inserted at pos into a table of size rows the next id, and
+// returns it.
+uint32_t row_map_insert(RowMap* rows, size_t pos, size_t size);
+
+// Drops the rows at the ascending positions pos from a table of size rows.
+void row_map_delete(RowMap* rows, int* pos, size_t num, size_t size);
+
+// Gives the num rows a load appended to a table of size rows their ids.
+void row_map_append(RowMap* rows, size_t size, size_t num);
+
+// Moves the ids of a table of size rows along with a clustered load that
+// put the row at order[i] in position i.
+void row_map_reorder(RowMap* rows, size_t* order, size_t size);
+
+// Renames each of the first size rows from id i to names[i] and sets the
+// next id, so that a copy of a table's rows carries the table's ids.
+void row_map_rename(RowMap* rows, uint32_t* names, size_t size,
+                    size_t next_id);
+
+// The ids of the first size rows in position order, as merge_sort and the
+// bulk loaders take them.
+size_t* row_ids(RowMap* rows, size_t size);
+
+void sync_row_map(RowMap* rows, size_t size, FILE* fp);
+RowMap* load_row_map(FILE* fp, size_t size);
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef SCAN_H__
+#define SCAN_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Vector kernels store a full register of positions past the last match, so
+// every output buffer handed to a scan kernel needs this many spare slots.
+#define SCAN_PADDING 8
+
+// A scalar scan keeps its branch when the estimated selectivity is below
+// this fraction or above one minus it, where the branch predictor is right
+// nearly every time. Vector kernels are faster at every selectivity.
+#define BRANCHING_SELECTIVITY 0.02
+
+// IN lists of at most this many values are matched by comparing every
+// value against each entry (broadcast compares on vector hardware); longer
+// lists probe a hash set.
+#define IN_LIST_BROADCAST 8
+
+typedef enum ScanKernel { PREDICATED, BRANCHING } ScanKernel;
+
+/**
+ * The distinct values of an IN list in ascending order, plus an open
+ * addressing hash set over them. Empty slots hold vals[0]: a probe stops
+ * at the first one, and since vals[0] is itself a member, matching it is
+ * never a wrong answer.
+ **/
+typedef struct ValueSet {
+  int* vals;
+  size_t num_vals;
+  int* slots;
+  unsigned bits;
+} ValueSet;
+
+/**
+ * Range scan kernels. Every kernel keeps the values v with low <= v <= high
+ * (both bounds inclusive) and writes qualifying positions to output in
+ * position order, returning the number of positions written.
+ *
+ * scan_range writes base + i for a qualifying input[i];
+ * scan_range_ids writes ids[i] for a qualifying input[i].
+ * scan_range_bits sets bit i of words for a qualifying input[i] instead of
+ * writing positions; every word covering input is overwritten.
+ *
+ * The plain kernels are branch free (vectorized when the CPU allows); the
+ * _branching variants test each value with a conditional jump.
+ **/
+size_t scan_range(const int* input, size_t length, int low, int high,
+                  size_t base, int* output);
+size_t scan_range_ids(const int* input, const int* ids, size_t length,
+                      int low, int high, int* output);
+size_t scan_range_bits(const int* input, size_t length, int low, int high,
+                       uint64_t* words);
+
+size_t scan_range_branching(const int* input, size_t length, int low,
+                            int high, size_t base, int* output);
+size_t scan_range_ids_branching(const int* input, const int* ids,
+                                size_t length, int low, int high, int* output);
+
+/**
+ * IN-list kernels, with the output contracts of the range kernels above:
+ * they keep the values v that are members of set.
+ **/
+void init_value_set(ValueSet* set, const int* vals, size_t num_vals);
+void free_value_set(ValueSet* set);
+bool value_set_contains(const ValueSet* set, int val);
+
+size_t scan_in(const int* input, size_t length, const ValueSet* set,
+               size_t base, int* output);
+size_t scan_in_ids(const int* input, const int* ids, size_t length,
+                   const ValueSet* set, int* output);
+size_t scan_in_bits(const int* input, size_t length, const ValueSet* set,
+                    uint64_t* words);
+
+ScanKernel choose_scan_kernel(double selectivity);
+const char* scan_kernel_name(ScanKernel kernel);
+
+#endif
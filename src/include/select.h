@@ -1,8 +1,38 @@
 #ifndef SELECT_H__
 #define SELECT_H__
 
+#include "cs165_api.h"
+
+// Scans expected to qualify at least this fraction of a column answer with
+// a BITVECTOR instead of an INT position list. A bit vector costs n / 8
+// bytes against 4 * selectivity * n, so it is already smaller above 1/32;
+// switching at 1/16 leaves room for sampling error.
+#define BITVECTOR_SELECTIVITY 0.0625
+#define SAMPLE_SIZE 1024
+
+// Rows a shared scan runs every batched query over before moving on; one
+// L1 cache worth of values, and a multiple of 64 so bit vector words are
+// never split between threads.
+#define SHARED_SCAN_CHUNK (CACHE_SIZE / sizeof(int))
+
+// Shared scans over more queries than this match each value against the
+// queries' elementary intervals instead of running one kernel per query,
+// searching the intervals of INTERVAL_LANES values at a time.
+#define SHARED_SCAN_INTERVALS 64
+#define INTERVAL_LANES 16
+
+// Single selects over at least MORSEL_THRESHOLD rows run in parallel,
+// with workers claiming MORSEL_SIZE row ranges (a multiple of 64).
+#define MORSEL_SIZE 65536
+#define MORSEL_THRESHOLD (1 << 20)
+
 Result* single_select(Comparator* cmp);
 
+Result* conjunctive_select(Comparator** comparators, size_t num);
+
+void select_fetch(Comparator* cmp, Column* vals_col, Result** positions,
+                  Result** values);
+
 void shared_select(BatchSelect* batch_pointer);
 
 #endif
@@ -0,0 +1,21 @@
+#ifndef SETOPS_H__
+#define SETOPS_H__
+
+#include "cs165_api.h"
+
+// Two position lists whose lengths differ by at least this factor are
+// combined by galloping through the longer list from each entry of the
+// shorter one; closer lengths are merged.
+#define GALLOP_RATIO 32
+
+/**
+ * Combines two position results with AND (intersection), OR (union) or
+ * ANDNOT (positions of left that are not in right). Inputs may be INT
+ * position lists in any order, BITVECTORs or SLICEs; the output is a
+ * SLICE when the answer is one contiguous range, a BITVECTOR when either
+ * input is one and the answer is not a subset of a list input, and an INT
+ * position list in ascending order otherwise.
+ **/
+Result* combine_positions(Result* left, Result* right, OperatorType op);
+
+#endif
@@ -0,0 +1,108 @@
+#ifndef STATS_H__
+#define STATS_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Buckets of an equi-depth histogram; each holds 1 / HISTOGRAM_BUCKETS of
+// the rows.
+#define HISTOGRAM_BUCKETS 64
+
+// Values analyze_column sorts for columns without a sorted copy at hand.
+#define STATS_SAMPLE 65536
+
+/**
+ * Optimizer statistics of a column, gathered on load and by analyze().
+ * They live in Column and so are persisted in col_meta with the rest of
+ * the catalog. rows is the column size at analysis time; rows == 0 means
+ * no statistics.
+ *
+ * bounds[b] .. bounds[b + 1] is the value range of bucket b, so bounds[0]
+ * is the minimum and bounds[HISTOGRAM_BUCKETS] the maximum.
+ **/
+typedef struct ColumnStats {
+  size_t rows;
+  size_t distinct;
+  int bounds[HISTOGRAM_BUCKETS + 1];
+} ColumnStats;
+
+/**
+ * Relative cost of each access path, in nanoseconds per unit as measured
+ * on 2M-row columns (make O=2):
+ *
+ * | Path            | Cost                                             |
+ * | --------------- | ------------------------------------------------ |
+ * | FULL_SCAN       | SCAN_VALUE_COST per value in straddling zones    |
+ * |                 | + POSITION_COST per position if not a bit vector |
+ * | SORTED_SEARCH   | two searches + SORTED_ENTRY_COST per position    |
+ * | BTREE_WALK      | two descents + BTREE_ENTRY_COST per position     |
+ * | CSS_SEARCH      | two descents of CSS_LEVEL_COST per line read     |
+ * |                 | + SORTED_ENTRY_COST per position                 |
+ * | HASH_PROBE      | HASH_PROBE_COST per value of the range or list   |
+ * |                 | + POSITION_COST per position                     |
+ * | BITMAP_OR       | BITMAP_WORD_COST per compressed word read        |
+ * |                 | + BITVECTOR_WORD_COST per 64 rows unless a       |
+ * |                 | single bitmap decodes straight to positions      |
+ * |                 | + POSITION_COST per position if not a bit vector |
+ * | CRACK_SEARCH    | two searches + SORTED_ENTRY_COST per position    |
+ * | PROJECTION      | two searches of the projection's sort key        |
+ * |                 | + PROJECTION_ROW_COST per position               |
+ *
+ * An IN list pays the searches of an index path once per list value. A
+ * clustered column is sorted itself and answers a range through any of
+ * these indexes with two searches and a slice of positions, so it pays no
+ * per-position cost; its IN lists pay POSITION_COST per position.
+ *
+ * A CSS-tree search reads a line per directory level and one leaf block,
+ * about 6 lines (300ns) on 2M rows against 21 binary search steps (420ns).
+ * A hash probe misses about once per value, 100ns on 2M distinct values,
+ * so a hash index only answers equalities, IN lists and short ranges.
+ *
+ * An unclustered sorted index wins up to about 25% selectivity and the
+ * B-tree up to about 12%. A bitmap index wins while the bitmaps it ORs
+ * hold fewer compressed words than about a tenth of the rows.
+ *
+ * A cracked index is costed as the sorted column it converges to. The
+ * partitioning a select does in the pieces holding its bounds is not
+ * charged: it is an investment that later selects near those bounds
+ * recover.
+ *
+ * A projection sorted on the column is a candidate next to its index. Its
+ * rows come in key order, each translated to a position through a random
+ * row map lookup, so it only beats a scan up to about 8% selectivity.
+ **/
+#define SCAN_VALUE_COST 0.5
+#define POSITION_COST 0.25
+#define SORTED_ENTRY_COST 2.0
+#define BTREE_ENTRY_COST 4.0
+#define SEARCH_STEP_COST 20.0
+#define BITMAP_WORD_COST 4.0
+#define BITVECTOR_WORD_COST 10.0
+#define CSS_LEVEL_COST 50.0
+#define HASH_PROBE_COST 100.0
+#define PROJECTION_ROW_COST 6.0
+
+typedef enum AccessPath {
+  FULL_SCAN,
+  SORTED_SEARCH,
+  BTREE_WALK,
+  BITMAP_OR,
+  CSS_SEARCH,
+  HASH_PROBE,
+  CRACK_SEARCH,
+  PROJECTION
+} AccessPath;
+
+struct Column;
+struct ValueSet;
+
+void analyze_column(struct Column* col);
+double estimate_range(ColumnStats* stats, int low, int high);
+double estimate_in_list(ColumnStats* stats, const struct ValueSet* set);
+AccessPath choose_access_path(struct Column* col, int low, int high,
+                              bool projected, double selectivity);
+AccessPath choose_in_list_path(struct Column* col, const struct ValueSet* set,
+                               bool projected, double selectivity);
+const char* access_path_name(AccessPath path);
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef THREAD_POOL_H__
+#define THREAD_POOL_H__
+
+#include <pthread.h>
+#include <stddef.h>
+
+/**
+ * A server-wide pool of worker threads, one per online processor, started
+ * once at startup. Each worker owns a deque: it pushes and pops its own
+ * tasks at the bottom while idle workers steal from the top of the others.
+ *
+ * Parallel operators spawn their tasks into a TaskGroup and then wait on
+ * it; a waiting thread runs queued tasks itself instead of blocking, so
+ * groups can be nested inside tasks. A group is initialized before its
+ * first spawn and released by the wait that finishes it.
+ **/
+
+typedef void (*TaskFunction)(void* args);
+
+typedef struct TaskGroup {
+  size_t pending;
+  pthread_mutex_t lock;
+  pthread_cond_t done;
+} TaskGroup;
+
+typedef struct ThreadPoolStats {
+  size_t workers;
+  size_t tasks;
+  size_t steals;
+  double idle_ms;
+} ThreadPoolStats;
+
+void init_thread_pool();
+void shutdown_thread_pool();
+
+size_t thread_pool_size();
+size_t parallel_degree(size_t work, size_t grain);
+
+void task_group_init(TaskGroup* group);
+void task_group_spawn(TaskGroup* group, TaskFunction fn, void* args);
+void task_group_wait(TaskGroup* group);
+
+ThreadPoolStats thread_pool_stats();
+void log_thread_pool_stats();
+
+#endif
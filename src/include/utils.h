@@ -37,6 +37,7 @@ void merge_sort(int* vals, size_t* idxs, size_t low, size_t high);
 char* trim_parenthesis(char* str);
 char* trim_whitespace(char* str);
 char* trim_quotes(char* str);
+char* path_join(char* path, const char* dir, const char* name);
 
 /**
  * log utilities
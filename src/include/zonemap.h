@@ -0,0 +1,54 @@
+#ifndef ZONEMAP_H__
+#define ZONEMAP_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "scan.h"
+
+// Values summarized by one zone. A multiple of 64, so zones never split a
+// bit vector word, and a divisor of SHARED_SCAN_CHUNK and MORSEL_SIZE, so
+// parallel scan ranges always start on a zone boundary.
+#define ZONE_SIZE 4096
+#define ZONE_COUNT(length) (((length) + ZONE_SIZE - 1) / ZONE_SIZE)
+
+/**
+ * Zone map of a column: min, max and sum of every ZONE_SIZE block of
+ * values, the last block possibly partial. Kept current by every write to
+ * the column and persisted next to its data as "zone_map".
+ *
+ * | Zone vs [low, high]         | Scan        |
+ * | --------------------------- | ----------- |
+ * | max < low or min > high     | skipped     |
+ * | low <= min and max <= high  | all qualify |
+ * | otherwise                   | scanned     |
+ **/
+typedef struct ZoneMap {
+  size_t num_zones;
+  size_t capacity;
+  int* mins;
+  int* maxs;
+  long* sums;
+} ZoneMap;
+
+struct Column;
+
+void init_zonemap(ZoneMap* zones);
+void free_zonemap(ZoneMap* zones);
+void refresh_zonemap(struct Column* col, size_t from);
+
+long zonemap_sum(ZoneMap* zones);
+size_t zonemap_scanned(ZoneMap* zones, size_t length, int low, int high);
+
+size_t scan_zones(struct Column* col, size_t start, size_t end, int low,
+                  int high, ScanKernel kernel, int* output);
+size_t scan_zones_bits(struct Column* col, size_t start, size_t end, int low,
+                       int high, uint64_t* words);
+
+size_t zonemap_scanned_in(ZoneMap* zones, size_t length, const ValueSet* set);
+size_t scan_zones_in(struct Column* col, size_t start, size_t end,
+                     const ValueSet* set, int* output);
+size_t scan_zones_in_bits(struct Column* col, size_t start, size_t end,
+                          const ValueSet* set, uint64_t* words);
+
+#endif
@@ -1,10 +1,16 @@
+#include <pthread.h>
 #include <stdio.h>
 #include <string.h>
 
+#include "bitmap.h"
 #include "btree.h"
 #include "client_context.h"
+#include "cracker.h"
 #include "cs165_api.h"
+#include "css_tree.h"
 #include "db_manager.h"
+#include "hash_index.h"
+#include "index.h"
 #include "utils.h"
 
 void init_sorted_index(Column* col, size_t* idxs) {
@@ -15,84 +21,122 @@ void init_sorted_index(Column* col, size_t* idxs) {
 
     for (size_t i = 0; i < col->size; i++) {
       vals[i] = col->data[i];
-      position[i] = idxs ? idxs[i] : i;
+      position[i] = idxs ? idxs[i] : col->rows->ids[i];
     }
 
     merge_sort(vals, position, 0, col->size - 1);
   }
+  if (col->index.type == CSS) {
+    CssIndex* index = (CssIndex*)(col->index.payload);
+    build_css_tree(&index->tree, index->sorted.vals, col->size);
+  }
 }
 
 /*=== INSERT INDEX ===*/
 
-void insert_sorted_index(Column* col, int val, size_t val_pos) {
+void insert_sorted_index(Column* col, int val, uint32_t id) {
   if (!col->clustered) {
     SortedIndex* payload = (SortedIndex*)(col->index.payload);
-    int* vals = payload->vals;
-    size_t* position = payload->pos;
-
-    size_t pos = pos_in_sorted(vals, col->size, val);
-    array_insert(vals, col->size, val, pos);
-    position[pos] = val_pos;
-
-    for (size_t i = 0; i < col->size; i++)
-      if (position[i] >= val_pos && i != pos) position[i]++;
+    size_t pos = pos_in_sorted(payload->vals, col->size, val);
+    array_insert(payload->vals, col->size, val, pos);
+    memmove(payload->pos + pos + 1, payload->pos + pos,
+            sizeof(size_t) * (col->size - pos));
+    payload->pos[pos] = id;
   }
 }
 
-void insert_btree_index(Column* col, int val, size_t val_pos) {
-  if (col->index.payload == NULL) {
-    size_t natural_order[col->size];
-    for (size_t i = 0; i < col->size; i++) natural_order[i] = i;
-    build_btree(col->data, natural_order, col->size);
-  }
+// The sorted copy takes the value; the directory over it waits for a read.
+void insert_css_index(Column* col, int val, uint32_t id) {
+  insert_sorted_index(col, val, id);
+  invalidate_css_tree(&((CssIndex*)(col->index.payload))->tree);
+}
 
-  BTreeNode* node = (BTreeNode*)(col->index.payload);
-  btree_insert(&node, val, val_pos, col->clustered);
-  col->index.payload = node;
-  // print_btree(node); printf("inserted %d at position %zu\n\n", val, val_pos);
+void insert_btree_index(Column* col, int val, uint32_t id) {
+  BTree* tree = (BTree*)(col->index.payload);
+  btree_insert(tree, val, id);
+  // print_btree(tree); printf("inserted %d as row %u\n\n", val, id);
 }
 
-void insert_index(Column* col, int val, size_t val_pos) {
+/**
+ * Adds val, inserted at pos as row id, to the index of col, before col
+ * counts it. Only a bitmap index holds positions and moves the later ones.
+ **/
+void insert_index(Column* col, int val, size_t pos, uint32_t id) {
+  // A pending index is rebuilt from the column when it is first used.
+  if (!index_ready(col)) return;
   switch (col->index.type) {
     case NONE:
       break;
     case SORTED:
-      insert_sorted_index(col, val, val_pos);
+      insert_sorted_index(col, val, id);
       break;
     case BTREE:
-      insert_btree_index(col, val, val_pos);
+      insert_btree_index(col, val, id);
+      break;
+    case BITMAP:
+      bitmap_insert((BitmapIndex*)(col->index.payload), val, pos, col->size);
+      break;
+    case CSS:
+      insert_css_index(col, val, id);
+      break;
+    case HASH:
+      hash_index_insert((HashIndex*)(col->index.payload), val, id);
+      break;
+    case CRACKED:
+      cracker_insert((CrackerIndex*)(col->index.payload), val, id);
       break;
   }
 }
 
 /*=== DELETE INDEX ===*/
 
-void delete_sorted_index(Column* col, size_t position) {
+// Finds the entry of row id among the copies of val and closes the gap.
+void delete_sorted_index(Column* col, int val, uint32_t id) {
   if (!col->clustered) {
     SortedIndex* payload = (SortedIndex*)(col->index.payload);
+    size_t slot = pos_in_sorted(payload->vals, col->size, val);
+    while (slot < col->size && payload->pos[slot] != id) slot++;
+    if (slot == col->size) return;
 
-    array_delete(payload->vals, col->size, position);
-    
-    for (size_t i = 0; i < col->size; i++)
-      if ((payload->pos)[i] >= position) (payload->pos)[i]--;
+    array_delete(payload->vals, col->size, slot);
+    memmove(payload->pos + slot, payload->pos + slot + 1,
+            sizeof(size_t) * (col->size - slot - 1));
   }
 }
 
-void delete_btree_index(Column* col, size_t pos) {
-  BTreeNode* node = (BTreeNode*)(col->index.payload);
-  btree_delete(node, pos);
-  // print_btree(node); printf(" deleted pos %zu\n\n", pos);
+void delete_css_index(Column* col, int val, uint32_t id) {
+  delete_sorted_index(col, val, id);
+  invalidate_css_tree(&((CssIndex*)(col->index.payload))->tree);
 }
 
+/**
+ * Drops the row at pos from the index of col, while col and its RowMap
+ * still hold it.
+ **/
 void delete_index(Column* col, size_t pos) {
+  if (!index_ready(col)) return;
+  int val = col->data[pos];
+  uint32_t id = col->rows->ids[pos];
   switch (col->index.type) {
     case NONE:
       break;
     case SORTED:
-      delete_sorted_index(col, pos);
+      delete_sorted_index(col, val, id);
       break;
     case BTREE:
-      delete_btree_index(col, pos);
+      btree_delete((BTree*)(col->index.payload), val, id);
+      break;
+    case BITMAP:
+      bitmap_delete((BitmapIndex*)(col->index.payload), pos);
+      break;
+    case CSS:
+      delete_css_index(col, val, id);
+      break;
+    case HASH:
+      hash_index_delete((HashIndex*)(col->index.payload), val, id);
+      break;
+    case CRACKED:
+      cracker_delete((CrackerIndex*)(col->index.payload), val, id);
       break;
   }
 }
@@ -104,18 +148,44 @@ void rebuild_sorted_index(Column* col, size_t* idxs) {
 }
 
 void rebuild_btree_index(Column* col, size_t* idxs) {
-  free_btree((BTreeNode*)(col->index.payload));
+  BTree* tree = (BTree*)(col->index.payload);
   if (col->clustered) {
-    col->index.payload = build_btree(col->data, idxs, col->size);
+    build_btree(tree, col->data, idxs, col->size);
   } else {
     int* data_copy = malloc(sizeof(int) * col->size);
     memcpy(data_copy, col->data, sizeof(int) * col->size);
     merge_sort(data_copy, idxs, 0, col->size - 1);
-    col->index.payload = build_btree(data_copy, idxs, col->size);
+    build_btree(tree, data_copy, idxs, col->size);
     free(data_copy);
   }
 }
 
+void rebuild_bitmap_index(Column* col) {
+  free_bitmap_index((BitmapIndex*)(col->index.payload));
+  col->index.payload = build_bitmap_index(col->data, col->size);
+}
+
+void rebuild_hash_index(Column* col) {
+  free_hash_index((HashIndex*)(col->index.payload));
+  col->index.payload = build_hash_index(col->data, col->rows->ids, col->size);
+}
+
+// A load starts the cracker column over in one piece.
+void rebuild_cracker_index(Column* col) {
+  free_cracker_index((CrackerIndex*)(col->index.payload));
+  col->index.payload =
+      build_cracker_index(col->data, col->rows->ids, col->size);
+}
+
+void rebuild_css_index(Column* col, size_t* idxs) {
+  if (col->clustered) {
+    CssIndex* index = (CssIndex*)(col->index.payload);
+    build_css_tree(&index->tree, col->data, col->size);
+  } else {
+    init_sorted_index(col, idxs);
+  }
+}
+
 void rebuild_index(Column* col, size_t* idxs) {
   switch (col->index.type) {
     case NONE:
@@ -126,5 +196,94 @@ void rebuild_index(Column* col, size_t* idxs) {
     case BTREE:
       rebuild_btree_index(col, idxs);
       break;
+    case BITMAP:
+      rebuild_bitmap_index(col);
+      break;
+    case CSS:
+      rebuild_css_index(col, idxs);
+      break;
+    case HASH:
+      rebuild_hash_index(col);
+      break;
+    case CRACKED:
+      rebuild_cracker_index(col);
+      break;
+  }
+}
+
+/*=== BUILD STATE ===*/
+
+bool index_ready(Column* col) {
+  return __atomic_load_n(&col->index.state, __ATOMIC_ACQUIRE) == INDEX_READY;
+}
+
+// Rebuilds the index of col from the column and publishes it.
+static void build_index(Column* col) {
+  size_t* ids = row_ids(col->rows, col->size);
+  rebuild_index(col, ids);
+  free(ids);
+  __atomic_store_n(&col->index.state, INDEX_READY, __ATOMIC_RELEASE);
+  cs165_log(stdout, "INDEX: %s ready\n", col->name);
+}
+
+static void* index_build_thread(void* args) {
+  Column* col = (Column*)args;
+  pthread_mutex_lock(&col->index.build_lock);
+  build_index(col);
+  pthread_mutex_unlock(&col->index.build_lock);
+  return NULL;
+}
+
+/**
+ * Leaves the index of col, which a load just appended to, to be rebuilt:
+ * by a builder thread started here, or by the first select that would use
+ * a lazy index. Selects scan until then. A clustered sorted index is the
+ * column itself and is ready as soon as the load sorted it.
+ **/
+void schedule_index_build(Column* col) {
+  if (col->index.type == NONE || (col->index.type == SORTED && col->clustered))
+    return;
+  wait_index_build(col);
+  if (col->index.lazy) {
+    __atomic_store_n(&col->index.state, INDEX_PENDING, __ATOMIC_RELEASE);
+    cs165_log(stdout, "INDEX: %s pending\n", col->name);
+    return;
+  }
+  __atomic_store_n(&col->index.state, INDEX_BUILDING, __ATOMIC_RELEASE);
+  cs165_log(stdout, "INDEX: %s building\n", col->name);
+  if (pthread_create(&col->index.builder, NULL, index_build_thread, col) != 0) {
+    build_index(col);
+    return;
+  }
+  col->index.building = true;
+}
+
+/**
+ * Makes the index of col usable by the select about to use it: builds a
+ * pending lazy index on the spot. Returns false while a builder thread
+ * still has it, and the select scans instead.
+ **/
+bool ensure_index(Column* col) {
+  if (index_ready(col)) return true;
+  if (!col->index.lazy) return false;
+  pthread_mutex_lock(&col->index.build_lock);
+  if (!index_ready(col)) {
+    cs165_log(stdout, "INDEX: %s building on first use\n", col->name);
+    build_index(col);
   }
+  pthread_mutex_unlock(&col->index.build_lock);
+  return true;
+}
+
+// Joins the builder of col, if one was started; writes and syncs need
+// the index finished.
+void wait_index_build(Column* col) {
+  if (!col->index.building) return;
+  pthread_join(col->index.builder, NULL);
+  col->index.building = false;
+}
+
+void wait_index_builds(Table* tbl) {
+  for (size_t i = 0; i < tbl->col_count; i++)
+    wait_index_build(tbl->columns + i);
 }
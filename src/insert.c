@@ -11,29 +11,47 @@
 #include "cs165_api.h"
 #include "db_manager.h"
 #include "index.h"
+#include "insert.h"
 #include "utils.h"
 
 /*=== INSERT ===*/
 
-void column_insert(Column* col, int val, size_t pos) {
+void column_insert(Column* col, int val, size_t pos, uint32_t id) {
   array_insert(col->data, col->size, val, pos);
-  insert_index(col, val, pos);
+  insert_index(col, val, pos, id);
   col->size++;
+  col->writes++;
+  refresh_zonemap(col, pos);
+  refresh_byteslices(col, pos);
 }
 
 void clustered_insert(Table* tbl, size_t clustered, int* vals) {
   size_t pos =
       pos_in_sorted(tbl->columns[clustered].data, tbl->size, vals[clustered]);
+  uint32_t id = row_map_insert(tbl->rows, pos, tbl->size);
   for (size_t i = 0; i < tbl->col_count; i++)
-    column_insert(tbl->columns + i, vals[i], pos);
+    column_insert(tbl->columns + i, vals[i], pos, id);
 }
 
 void unclustered_insert(Table* tbl, int* vals) {
+  uint32_t id = row_map_insert(tbl->rows, tbl->size, tbl->size);
   for (size_t i = 0; i < tbl->col_count; i++)
-    column_insert(tbl->columns + i, vals[i], tbl->size);
+    column_insert(tbl->columns + i, vals[i], tbl->size, id);
+}
+
+// Repeats an insert on the projections of tbl with the values they hold.
+static void insert_projections(Table* tbl, int* vals) {
+  for (size_t p = 0; p < tbl->num_projections; p++) {
+    Table* proj = tbl->projections[p];
+    int proj_vals[proj->col_count];
+    for (size_t i = 0; i < proj->col_count; i++)
+      proj_vals[i] = vals[lookup_column_idx(tbl, proj->columns[i].name)];
+    insert_scheduler(proj, proj_vals);
+  }
 }
 
 void insert_scheduler(Table* tbl, int* vals) {
+  wait_index_builds(tbl);
   if (tbl->capacity <= tbl->size) resize_table(tbl);
 
   size_t clustered = lookup_primary_column(tbl);
@@ -44,26 +62,28 @@ void insert_scheduler(Table* tbl, int* vals) {
   }
 
   tbl->size++;
+  insert_projections(tbl, vals);
 }
 
 /*=== LOAD ===*/
 
 void column_load(Column* col, int* vals, size_t* cluster_order, size_t size) {
+  size_t first_changed = cluster_order ? 0 : col->size;
   memmove(col->data + col->size, vals, sizeof(int) * size);
   col->size += size;
+  col->writes++;
 
   if (col->clustered) {
     merge_sort(col->data, cluster_order, 0, col->size - 1);
+    row_map_reorder(col->rows, cluster_order, col->size);
   } else if (cluster_order) {
     array_reorder(col->data, cluster_order, col->size);
   }
+  refresh_zonemap(col, first_changed);
+  refresh_byteslices(col, first_changed);
 
-  size_t* natural_order = malloc(sizeof(size_t) * col->size);
-  for (size_t i = 0; i < col->size; i++) natural_order[i] = i;
-
-  rebuild_index(col, natural_order);
-  
-  free(natural_order);
+  schedule_index_build(col);
+  analyze_column(col);
 }
 
 void clustered_load(Table* tbl, size_t clustered, int** vals, size_t size) {
@@ -84,8 +104,20 @@ void unclustered_load(Table* tbl, int** vals, size_t size) {
     column_load(tbl->columns + i, vals[i], NULL, size);
 }
 
+static void load_projections(Table* table, int** vals, size_t size) {
+  for (size_t p = 0; p < table->num_projections; p++) {
+    Table* proj = table->projections[p];
+    int* proj_vals[proj->col_count];
+    for (size_t i = 0; i < proj->col_count; i++)
+      proj_vals[i] = vals[lookup_column_idx(table, proj->columns[i].name)];
+    load_scheduler(proj, proj_vals, size);
+  }
+}
+
 void load_scheduler(Table* table, int** vals, size_t size) {
+  wait_index_builds(table);
   while (table->capacity <= table->size + size) resize_table(table);
+  row_map_append(table->rows, table->size, size);
 
   size_t clustered = lookup_primary_column(table);
 
@@ -96,6 +128,7 @@ void load_scheduler(Table* table, int** vals, size_t size) {
   }
 
   table->size += size;
+  load_projections(table, vals, size);
 }
 
 void receive_and_load(int client_fd) {
@@ -1,11 +1,13 @@
-#include <pthread.h>
 #include <stdio.h>
+#include <string.h>
 #include <sys/time.h>
 
 #include "cs165_api.h"
 #include "db_manager.h"
+#include "hash_index.h"
 #include "hash_table.h"
 #include "join.h"
+#include "thread_pool.h"
 #include "utils.h"
 
 struct timeval tm1, tm2;
@@ -100,45 +102,42 @@ size_t hash_join(int* val_l, int* pos_l, int* val_r, int* pos_r, size_t size_l,
 
 /*=== Parallel Hash Join ===*/
 
-static size_t jobs;
-static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
-static pthread_mutex_t res_lock = PTHREAD_MUTEX_INITIALIZER;
+// Probe keys handed to each pool task.
+#define PROBE_GRAIN 16384
 
-void* hashjoin_task(void* args) {
+static void hashjoin_task(void* args) {
   HashJoinArgs* arg = (HashJoinArgs*)args;
-  pthread_mutex_lock(&lock);
-  while (jobs) {
-    size_t i = --jobs;
-    pthread_mutex_unlock(&lock);
-
-    Result* res = calloc(sizeof(Result), 1);
-    res->payload = malloc(sizeof(int) * DEFAULT_CAPACITY);
-    res->data_type = INT;
+  Result* res = calloc(sizeof(Result), 1);
+  res->payload = malloc(sizeof(int) * DEFAULT_CAPACITY);
+  res->data_type = INT;
 
+  for (size_t i = arg->start; i < arg->end; i++) {
     hashtable_get(arg->ha_tbl, arg->val_r[i], res);
-
-    pthread_mutex_lock(&res_lock);
-    size_t offset = *(arg->offset);
-    *(arg->offset) += res->num_tuples;
-    pthread_mutex_unlock(&res_lock);
-
+    if (arg->size + res->num_tuples > arg->capacity) {
+      arg->capacity = 2 * arg->capacity + res->num_tuples;
+      arg->output_l = realloc(arg->output_l, sizeof(int) * arg->capacity);
+      arg->output_r = realloc(arg->output_r, sizeof(int) * arg->capacity);
+    }
     for (size_t j = 0; j < res->num_tuples; j++) {
-      arg->output_l[offset + j] = ((int*)res->payload)[j];
-      arg->output_r[offset + j] = arg->pos_r[i];
+      arg->output_l[arg->size + j] = ((int*)res->payload)[j];
+      arg->output_r[arg->size + j] = arg->pos_r[i];
     }
-    free_result(res);
-    pthread_mutex_lock(&lock);
+    arg->size += res->num_tuples;
   }
-  pthread_mutex_unlock(&lock);
-  return NULL;
+  free_result(res);
 }
 
+/**
+ * Builds on the smaller side and probes the larger one on the pool. A key
+ * can match many build rows, so the outputs grow as needed from capacity
+ * entries, as in index_join.
+ **/
 size_t parallel_hash_join(int* val_l, int* pos_l, int* val_r, int* pos_r,
-                          size_t size_l, size_t size_r, int* output_l,
-                          int* output_r) {
+                          size_t size_l, size_t size_r, int** output_l,
+                          int** output_r, size_t* capacity) {
   if (size_l > size_r)
     return parallel_hash_join(val_r, pos_r, val_l, pos_l, size_r, size_l,
-                              output_r, output_l);
+                              output_r, output_l, capacity);
 
   gettimeofday(&tm1, NULL);
 
@@ -153,24 +152,45 @@ size_t parallel_hash_join(int* val_l, int* pos_l, int* val_r, int* pos_r,
          (double)(tm2.tv_usec - tm1.tv_usec) / 1000 +
              (double)(tm2.tv_sec - tm1.tv_sec) * 1000);
 
-  size_t res_size = 0;
-
-  pthread_t thread[PROC_NUM];
-  jobs = size_r;
-  HashJoinArgs* args = malloc(sizeof(HashJoinArgs));
-  args->val_r = val_r;
-  args->pos_r = pos_r;
-  args->ha_tbl = ha_tbl;
-  args->output_l = output_l;
-  args->output_r = output_r;
-  args->offset = &res_size;
-
   gettimeofday(&tm1, NULL);
 
-  for (size_t i = 0; i < PROC_NUM; i++)
-    pthread_create(&thread[i], NULL, hashjoin_task, (void*)args);
+  // Each task probes a contiguous range of the probe side into private
+  // buffers; concatenating them in range order needs no locking and keeps
+  // the output in probe order, as in hash_join.
+  size_t num_tasks = parallel_degree(size_r, PROBE_GRAIN);
+  size_t per_task = (size_r + num_tasks - 1) / num_tasks;
+  HashJoinArgs* args = calloc(sizeof(HashJoinArgs), num_tasks);
+  TaskGroup group;
+  task_group_init(&group);
+  for (size_t t = 0; t < num_tasks; t++) {
+    args[t].ha_tbl = ha_tbl;
+    args[t].val_r = val_r;
+    args[t].pos_r = pos_r;
+    args[t].start = t * per_task < size_r ? t * per_task : size_r;
+    args[t].end = args[t].start + per_task < size_r ? args[t].start + per_task
+                                                     : size_r;
+    task_group_spawn(&group, hashjoin_task, (void*)(args + t));
+  }
+  task_group_wait(&group);
+
+  size_t total = 0;
+  for (size_t t = 0; t < num_tasks; t++) total += args[t].size;
+  if (total > *capacity) {
+    *capacity = total;
+    *output_l = realloc(*output_l, sizeof(int) * *capacity);
+    *output_r = realloc(*output_r, sizeof(int) * *capacity);
+  }
 
-  for (size_t i = 0; i < PROC_NUM; i++) pthread_join(thread[i], NULL);
+  size_t res_size = 0;
+  for (size_t t = 0; t < num_tasks; t++) {
+    memcpy(*output_l + res_size, args[t].output_l,
+           sizeof(int) * args[t].size);
+    memcpy(*output_r + res_size, args[t].output_r,
+           sizeof(int) * args[t].size);
+    res_size += args[t].size;
+    free(args[t].output_l);
+    free(args[t].output_r);
+  }
 
   gettimeofday(&tm2, NULL);
   printf("probe hashtable >> %.3f ms\n\n",
@@ -182,3 +202,41 @@ size_t parallel_hash_join(int* val_l, int* pos_l, int* val_r, int* pos_r,
 
   return res_size;
 }
+
+/*=== Index Join ===*/
+
+/**
+ * Joins a whole column against val_r through the column's hash index,
+ * which stands in for the build side: the matches of a probe are the
+ * column positions of the rows holding its value. The outputs grow as
+ * needed from capacity entries.
+ **/
+size_t index_join(Column* col, int* val_r, int* pos_r, size_t size_r,
+                  int** output_l, int** output_r, size_t* capacity) {
+  gettimeofday(&tm1, NULL);
+
+  HashIndex* index = (HashIndex*)(col->index.payload);
+  uint32_t* pos = col->rows->pos;
+  size_t res_size = 0;
+  for (size_t i = 0; i < size_r; i++) {
+    HashEntry* entry = hash_index_lookup(index, val_r[i]);
+    if (entry == NULL) continue;
+    if (res_size + entry->count > *capacity) {
+      *capacity = 2 * *capacity + entry->count;
+      *output_l = realloc(*output_l, sizeof(int) * *capacity);
+      *output_r = realloc(*output_r, sizeof(int) * *capacity);
+    }
+    uint32_t* ids = hash_entry_positions(entry);
+    for (size_t j = 0; j < entry->count; j++) {
+      (*output_l)[res_size + j] = pos[ids[j]];
+      (*output_r)[res_size + j] = pos_r[i];
+    }
+    res_size += entry->count;
+  }
+
+  gettimeofday(&tm2, NULL);
+  printf("probe hash index >> %.3f ms\n\n",
+         (double)(tm2.tv_usec - tm1.tv_usec) / 1000 +
+             (double)(tm2.tv_sec - tm1.tv_sec) * 1000);
+  return res_size;
+}
@@ -13,9 +13,14 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include "bitmap.h"
+#include "btree.h"
 #include "client_context.h"
+#include "cracker.h"
 #include "cs165_api.h"
+#include "css_tree.h"
 #include "db_manager.h"
+#include "hash_index.h"
 #include "index.h"
 #include "message.h"
 #include "parse.h"
@@ -57,11 +62,21 @@ void parse_create_col(char* create_arguments) {
   char* col_name = strsep(create_arguments_index, ",");
   char* db_name = strsep(create_arguments_index, ".");
   char* tbl_name = strsep(create_arguments_index, ",");
+  char* layout = strsep(create_arguments_index, ",");
 
   if (current_db == NULL || not_current_db(db_name))
     current_db = load_db(db_name);
 
-  tbl_name[strlen(tbl_name) - 1] = '\0';
+  if (layout) {
+    layout[strlen(layout) - 1] = '\0';
+  } else {
+    tbl_name[strlen(tbl_name) - 1] = '\0';
+  }
+  bool byte_sliced = layout && strcmp(layout, "bitsliced") == 0;
+  if (layout && !byte_sliced) {
+    log_err("Unknown column layout.");
+    return;
+  }
   Table* tbl = lookup_table(tbl_name);
   if (tbl == NULL) {
     log_err("Cannot find the table");
@@ -69,7 +84,7 @@ void parse_create_col(char* create_arguments) {
   }
   col_name = trim_quotes(col_name);
 
-  create_column(col_name, tbl);
+  create_column(col_name, tbl, byte_sliced);
 }
 
 void parse_create_idx(char* create_arguments) {
@@ -78,7 +93,8 @@ void parse_create_idx(char* create_arguments) {
   char* tbl_name = strsep(create_arguments_index, ".");
   char* col_name = strsep(create_arguments_index, ",");
   char* idx_type = strsep(create_arguments_index, ",");
-  char* cluster_type = strsep(create_arguments_index, ")");
+  char* build_mode = strsep(create_arguments_index, ")");
+  char* cluster_type = strsep(&build_mode, ",");
 
   if (current_db == NULL || not_current_db(db_name))
     current_db = load_db(db_name);
@@ -89,15 +105,57 @@ void parse_create_idx(char* create_arguments) {
     return;
   }
 
+  bool lazy = build_mode && strcmp(build_mode, "lazy") == 0;
+  if (build_mode && !lazy) {
+    log_err("Unknown index build mode.");
+    return;
+  }
+  wait_index_build(col);
+  col->index.lazy = lazy;
+  col->index.state = INDEX_READY;
+
   col->clustered = (strcmp(cluster_type, "clustered") == 0) ? true : false;
-  col->index.type = (strcmp(idx_type, "sorted") == 0) ? SORTED : BTREE;
+  if (strcmp(idx_type, "bitmap") == 0) {
+    if (col->clustered) {
+      log_err("Bitmap indexes cannot be clustered.");
+      col->clustered = false;
+      return;
+    }
+    col->index.type = BITMAP;
+  } else if (strcmp(idx_type, "cracked") == 0) {
+    if (col->clustered) {
+      log_err("Cracked indexes cannot be clustered.");
+      col->clustered = false;
+      return;
+    }
+    col->index.type = CRACKED;
+  } else if (strcmp(idx_type, "css") == 0) {
+    col->index.type = CSS;
+  } else if (strcmp(idx_type, "hash") == 0) {
+    col->index.type = HASH;
+  } else {
+    col->index.type = (strcmp(idx_type, "sorted") == 0) ? SORTED : BTREE;
+  }
 
   char idx_path[PATH_SIZE];
   sprintf(idx_path, "%s/%s/%s/%s/idx", DATA_DIR, db_name, tbl_name, col_name);
   mkdir(idx_path, 0777);
 
-  if (!col->clustered && col->index.type == SORTED) {
-    SortedIndex* sorted_index = malloc(sizeof(SortedIndex));
+  // A CSS index keeps its sorted copy where a sorted index does.
+  CssIndex* css_index = NULL;
+  if (col->index.type == CSS) {
+    css_index = calloc(sizeof(CssIndex), 1);
+    char css_path[PATH_SIZE];
+    path_join(css_path, idx_path, "css_tree");
+    open_css_tree(&css_index->tree,
+                  open(css_path, O_CREAT | O_RDWR, S_IRWXU));
+    col->index.payload = css_index;
+  }
+
+  if (!col->clustered &&
+      (col->index.type == SORTED || col->index.type == CSS)) {
+    SortedIndex* sorted_index =
+        css_index ? &css_index->sorted : malloc(sizeof(SortedIndex));
 
     char idx_data_path[PATH_SIZE];
     size_t length;
@@ -118,9 +176,89 @@ void parse_create_idx(char* create_arguments) {
         mmap(0, length, PROT_READ | PROT_WRITE, MAP_SHARED,
              sorted_index->pos_fd, 0);
 
-    col->index.payload = sorted_index;
+    if (!css_index) col->index.payload = sorted_index;
     init_sorted_index(col, NULL);
+  } else if (css_index) {
+    build_css_tree(&css_index->tree, col->data, col->size);
+  }
+
+  if (col->index.type == BTREE) {
+    char btree_path[PATH_SIZE];
+    path_join(btree_path, idx_path, "b_tree");
+    BTree* tree = malloc(sizeof(BTree));
+    open_btree(tree, open(btree_path, O_CREAT | O_RDWR | O_TRUNC, S_IRWXU));
+    col->index.payload = tree;
+    if (col->size > 0) {
+      size_t* ids = row_ids(col->rows, col->size);
+      rebuild_index(col, ids);
+      free(ids);
+    }
+  }
+  if (col->index.type == BITMAP)
+    col->index.payload = build_bitmap_index(col->data, col->size);
+  if (col->index.type == HASH)
+    col->index.payload =
+        build_hash_index(col->data, col->rows->ids, col->size);
+  if (col->index.type == CRACKED)
+    col->index.payload =
+        build_cracker_index(col->data, col->rows->ids, col->size);
+}
+
+/**
+ * create(proj,"name",db.tbl,key,col,...) copies the listed columns of tbl
+ * into a projection sorted on key, the first of them.
+ **/
+void parse_create_proj(char* create_arguments) {
+  char** create_arguments_index = &create_arguments;
+  char* proj_name = strsep(create_arguments_index, ",");
+  char* db_name = strsep(create_arguments_index, ".");
+  char* tbl_name = strsep(create_arguments_index, ",");
+  if (proj_name == NULL || tbl_name == NULL || create_arguments == NULL) {
+    log_err("Projections need a name, a table and a sort key.");
+    return;
+  }
+  create_arguments[strlen(create_arguments) - 1] = '\0';
+
+  if (current_db == NULL || not_current_db(db_name))
+    current_db = load_db(db_name);
+
+  Table* tbl = lookup_table(tbl_name);
+  if (tbl == NULL) {
+    log_err("Cannot find the table");
+    return;
+  }
+  proj_name = trim_quotes(proj_name);
+  bool taken = lookup_column_idx(tbl, proj_name) < tbl->col_count;
+  for (size_t i = 0; i < tbl->num_projections; i++)
+    taken = taken || strcmp(tbl->projections[i]->name, proj_name) == 0;
+  if (taken) {
+    log_err("Projection name already in use.");
+    return;
+  }
+
+  size_t cols[tbl->col_count];
+  size_t num_cols = 0;
+  char* col_name;
+  while ((col_name = strsep(create_arguments_index, ",")) != NULL) {
+    size_t idx = lookup_column_idx(tbl, col_name);
+    if (idx == tbl->col_count) {
+      log_err("Cannot find the column");
+      return;
+    }
+    for (size_t i = 0; i < num_cols; i++) {
+      if (cols[i] == idx) {
+        log_err("Column listed twice.");
+        return;
+      }
+    }
+    cols[num_cols++] = idx;
+  }
+  if (lookup_projection(tbl, tbl->columns[cols[0]].name)) {
+    log_err("A projection is already sorted on that column.");
+    return;
   }
+
+  create_projection(tbl, proj_name, cols, num_cols);
 }
 
 /**
@@ -148,6 +286,8 @@ void parse_create(char* create_arguments) {
       parse_create_col(tokenizer_copy);
     } else if (strcmp(token, "idx") == 0) {
       parse_create_idx(tokenizer_copy);
+    } else if (strcmp(token, "proj") == 0) {
+      parse_create_proj(tokenizer_copy);
     }
   }
   free(to_free);
@@ -278,6 +418,28 @@ void parse_batch(char* parse_arguments, ClientContext* context) {
   }
 }
 
+// Parses the low and high bound tokens of a select into cmp; either bound
+// may be null.
+static void parse_bounds(Comparator* cmp, char* low_token, char* high_token) {
+  cmp->p_vals = NULL;
+  cmp->num_vals = 0;
+  if (strcmp(low_token, "null") == 0) {
+    cmp->type1 = NO_COMPARISON;
+    cmp->p_low = INT_MIN;
+  } else {
+    cmp->type1 = GREATER_THAN_OR_EQUAL;
+    cmp->p_low = atoi(low_token);
+  }
+
+  if (strcmp(high_token, "null") == 0) {
+    cmp->type2 = NO_COMPARISON;
+    cmp->p_high = INT_MAX;
+  } else {
+    cmp->type2 = LESS_THAN;
+    cmp->p_high = atoi(high_token);
+  }
+}
+
 DbOperator* parse_select(char* query_command, ClientContext* context) {
   char* token = NULL;
   if (strncmp(query_command, "(", 1) == 0) {
@@ -322,29 +484,189 @@ DbOperator* parse_select(char* query_command, ClientContext* context) {
       cmp->gen_col->column_pointer.column = lookup_column(tbl_name, col_name);
     }
 
-    // parse low and/or high
-    char* val_token = strsep(command_index, ",");
-    if (strcmp(val_token, "null") == 0) {
-      cmp->type1 = NO_COMPARISON;
-      cmp->p_low = INT_MIN;
-    } else {
-      cmp->type1 = GREATER_THAN_OR_EQUAL;
-      cmp->p_low = atoi(val_token);
+    char* low_token = strsep(command_index, ",");
+    char* high_token = strsep(command_index, ")");
+    parse_bounds(cmp, low_token, high_token);
+    dbo->operator_fields.select_operator.comparator = cmp;
+    return dbo;
+  }
+  return NULL;
+}
+
+/**
+ * Parses an equality or IN-list select; a single value gives an EQUAL
+ * comparator, several an IN_LIST one:
+ * select_in(<col_name>,<val>,...) or select_in(<posn_vec>,<val_vec>,<val>,...)
+ **/
+DbOperator* parse_select_in(char* query_command, ClientContext* context) {
+  if (strncmp(query_command, "(", 1) != 0) return NULL;
+  query_command++;
+  char* end = strchr(query_command, ')');
+  if (end) *end = '\0';
+  char** command_index = &query_command;
+
+  char* token = strsep(command_index, ",");
+  GeneralizedColumn* gen_col = malloc(sizeof(GeneralizedColumn));
+  GeneralizedColumn* gen_col_id = NULL;
+  if (strchr(token, '.')) {
+    char* db_name = strsep(&token, ".");
+    if (current_db == NULL || not_current_db(db_name))
+      current_db = load_db(db_name);
+    char* tbl_name = strsep(&token, ".");
+    gen_col->column_type = COLUMN;
+    gen_col->column_pointer.column = token ? lookup_column(tbl_name, token)
+                                           : NULL;
+  } else {
+    char* val_handle = strsep(command_index, ",");
+    gen_col_id = malloc(sizeof(GeneralizedColumn));
+    gen_col_id->column_type = RESULT;
+    gen_col_id->column_pointer.result = lookup_handle_result(context, token);
+    gen_col->column_type = RESULT;
+    gen_col->column_pointer.result =
+        val_handle ? lookup_handle_result(context, val_handle) : NULL;
+  }
+
+  size_t num = 0;
+  size_t capacity = DEFAULT_CAPACITY;
+  int* vals = malloc(sizeof(int) * capacity);
+  while ((token = strsep(command_index, ","))) {
+    if (num >= capacity) resize_array(&vals, &capacity);
+    vals[num++] = atoi(token);
+  }
+
+  if (num == 0 || gen_col->column_pointer.column == NULL ||
+      (gen_col_id && gen_col_id->column_pointer.result == NULL)) {
+    free(vals);
+    free(gen_col);
+    free(gen_col_id);
+    return NULL;
+  }
+
+  Comparator* cmp = malloc(sizeof(Comparator));
+  cmp->gen_col = gen_col;
+  cmp->gen_col_id = gen_col_id;
+  cmp->type2 = NO_COMPARISON;
+  cmp->p_high = 0;
+  if (num == 1) {
+    cmp->type1 = EQUAL;
+    cmp->p_low = vals[0];
+    cmp->p_vals = NULL;
+    cmp->num_vals = 0;
+    free(vals);
+  } else {
+    cmp->type1 = IN_LIST;
+    cmp->p_low = 0;
+    cmp->p_vals = vals;
+    cmp->num_vals = num;
+  }
+
+  DbOperator* dbo = malloc(sizeof(DbOperator));
+  dbo->type = SELECT;
+  dbo->operator_fields.select_operator.comparator = cmp;
+  return dbo;
+}
+
+/**
+ * Parses a conjunction of range predicates on columns of one table:
+ * select_and(<col_name>,<low>,<high>,<col_name>,<low>,<high>,...)
+ **/
+DbOperator* parse_select_and(char* query_command) {
+  if (strncmp(query_command, "(", 1) != 0) return NULL;
+  query_command++;
+  char* end = strchr(query_command, ')');
+  if (end) *end = '\0';
+  char** command_index = &query_command;
+
+  Comparator** comparators = NULL;
+  size_t num = 0;
+  Table* tbl = NULL;
+  char* col_token;
+  while ((col_token = strsep(command_index, ","))) {
+    char* low_token = strsep(command_index, ",");
+    char* high_token = strsep(command_index, ",");
+    char* db_name = strsep(&col_token, ".");
+    char* tbl_name = strsep(&col_token, ".");
+    if (!low_token || !high_token || !tbl_name || !col_token) break;
+    if (current_db == NULL || not_current_db(db_name))
+      current_db = load_db(db_name);
+
+    Table* col_tbl = lookup_table(tbl_name);
+    if (tbl == NULL) tbl = col_tbl;
+    Column* col = col_tbl == tbl ? lookup_column(tbl_name, col_token) : NULL;
+    if (col == NULL) {
+      log_err("select_and predicates must be on columns of one table.\n");
+      break;
     }
 
-    val_token = strsep(command_index, ")");
-    if (strcmp(val_token, "null") == 0) {
-      cmp->type2 = NO_COMPARISON;
-      cmp->p_high = INT_MAX;
-    } else {
-      cmp->type2 = LESS_THAN;
-      cmp->p_high = atoi(val_token);
+    Comparator* cmp = malloc(sizeof(Comparator));
+    cmp->gen_col = malloc(sizeof(GeneralizedColumn));
+    cmp->gen_col_id = NULL;
+    cmp->gen_col->column_type = COLUMN;
+    cmp->gen_col->column_pointer.column = col;
+    parse_bounds(cmp, low_token, high_token);
+
+    comparators = realloc(comparators, sizeof(Comparator*) * (num + 1));
+    comparators[num++] = cmp;
+  }
+
+  if (col_token || num == 0) {
+    for (size_t i = 0; i < num; i++) {
+      free(comparators[i]->gen_col);
+      free(comparators[i]);
     }
+    free(comparators);
+    return NULL;
+  }
 
-    dbo->operator_fields.select_operator.comparator = cmp;
-    return dbo;
+  DbOperator* dbo = malloc(sizeof(DbOperator));
+  dbo->type = SELECT_AND;
+  dbo->operator_fields.select_and_operator.comparators = comparators;
+  dbo->operator_fields.select_and_operator.num = num;
+  return dbo;
+}
+
+/**
+ * Parses a column select with its values fetched from a second column:
+ * select_fetch(<col_name>,<vals_col_name>,<low>,<high>)
+ **/
+DbOperator* parse_select_fetch(char* query_command) {
+  if (strncmp(query_command, "(", 1) != 0) return NULL;
+  query_command++;
+  char** command_index = &query_command;
+
+  char* db_name = strsep(command_index, ".");
+  if (db_name == NULL) return NULL;
+  if (current_db == NULL || not_current_db(db_name))
+    current_db = load_db(db_name);
+  char* tbl_name = strsep(command_index, ".");
+  char* col_name = strsep(command_index, ",");
+  strsep(command_index, ".");
+  char* vals_tbl_name = strsep(command_index, ".");
+  char* vals_col_name = strsep(command_index, ",");
+  if (!tbl_name || !col_name || !vals_tbl_name || !vals_col_name) return NULL;
+
+  Column* col = lookup_column(tbl_name, col_name);
+  Column* vals_col = lookup_column(vals_tbl_name, vals_col_name);
+  if (col == NULL || vals_col == NULL) return NULL;
+  if (lookup_table(tbl_name) != lookup_table(vals_tbl_name)) {
+    log_err("select_fetch columns must be of one table.\n");
+    return NULL;
   }
-  return NULL;
+
+  Comparator* cmp = malloc(sizeof(Comparator));
+  cmp->gen_col = malloc(sizeof(GeneralizedColumn));
+  cmp->gen_col_id = NULL;
+  cmp->gen_col->column_type = COLUMN;
+  cmp->gen_col->column_pointer.column = col;
+  char* low_token = strsep(command_index, ",");
+  char* high_token = strsep(command_index, ")");
+  parse_bounds(cmp, low_token, high_token);
+
+  DbOperator* dbo = malloc(sizeof(DbOperator));
+  dbo->type = SELECT_FETCH;
+  dbo->operator_fields.select_fetch_operator.comparator = cmp;
+  dbo->operator_fields.select_fetch_operator.vals_col = vals_col;
+  return dbo;
 }
 
 DbOperator* parse_fetch(char* query_command, ClientContext* context) {
@@ -397,7 +719,7 @@ DbOperator* parse_join(char* query_command, ClientContext* context) {
     dbo->operator_fields.join_operator.val_r = val_2;
     dbo->operator_fields.join_operator.pos_r = pos_2;
     dbo->operator_fields.join_operator.join_type =
-        (strcmp(join_type, "nested-loop") == 0) ? NESTED : HASH;
+        (strcmp(join_type, "nested-loop") == 0) ? NESTED_LOOP : HASH_JOIN;
     return dbo;
   }
   return NULL;
@@ -478,6 +800,24 @@ DbOperator* parse_max_min(char* query_command, ClientContext* context,
   return NULL;
 }
 
+DbOperator* parse_and_or(char* query_command, ClientContext* context,
+                         OperatorType type) {
+  if (strncmp(query_command, "(", 1) != 0) return NULL;
+  query_command++;
+  char** command_index = &query_command;
+  char* handle_l = strsep(command_index, ",");
+  char* handle_r = strsep(command_index, ")");
+  if (handle_r == NULL) return NULL;
+
+  DbOperator* dbo = malloc(sizeof(DbOperator));
+  dbo->type = type;
+  dbo->operator_fields.and_or_operators.pos_l =
+      lookup_handle_result(context, handle_l);
+  dbo->operator_fields.and_or_operators.pos_r =
+      lookup_handle_result(context, handle_r);
+  return dbo;
+}
+
 DbOperator* parse_print(char* query_command) {
   DbOperator* dbo = malloc(sizeof(DbOperator));
   dbo->type = PRINT;
@@ -495,6 +835,24 @@ DbOperator* parse_print(char* query_command) {
   return dbo;
 }
 
+DbOperator* parse_analyze(char* query_command) {
+  trim_parenthesis(query_command);
+  char** command_index = &query_command;
+  char* db_name = strsep(command_index, ".");
+  char* table_name = strsep(command_index, ".");
+  char* col_name = *command_index;
+  if (!db_name || !table_name || !col_name) return NULL;
+  if (current_db == NULL) current_db = load_db(db_name);
+
+  Column* col = lookup_column(table_name, col_name);
+  if (col == NULL) return NULL;
+
+  DbOperator* dbo = malloc(sizeof(DbOperator));
+  dbo->type = ANALYZE;
+  dbo->operator_fields.analyze_operator.col = col;
+  return dbo;
+}
+
 /**
  * parse_command takes as input the send_message from the client and then
  * parses it into the appropriate query. Stores into send_message the
@@ -540,6 +898,29 @@ DbOperator* parse_command(char* query_command, int client_socket,
   } else if (strncmp(query_command, "batch", 5) == 0) {
     query_command += 5;
     parse_batch(query_command, context);
+  } else if (strncmp(query_command, "select_and", 10) == 0) {
+    query_command += 10;
+    dbo = parse_select_and(query_command);
+    if (dbo) strcpy(dbo->operator_fields.select_and_operator.handle, handle);
+  } else if (strncmp(query_command, "select_in", 9) == 0) {
+    query_command += 9;
+    dbo = parse_select_in(query_command, context);
+    if (dbo) strcpy(dbo->operator_fields.select_operator.handle, handle);
+  } else if (strncmp(query_command, "select_fetch", 12) == 0) {
+    query_command += 12;
+    dbo = parse_select_fetch(query_command);
+    if (dbo) {
+      SelectFetchOperator* op = &dbo->operator_fields.select_fetch_operator;
+      char* vals_handle = strchr(handle, ',');
+      if (vals_handle) {
+        *vals_handle++ = '\0';
+        strcpy(op->pos_handle, handle);
+        strcpy(op->vals_handle, vals_handle);
+      } else {
+        op->pos_handle[0] = '\0';
+        strcpy(op->vals_handle, handle);
+      }
+    }
   } else if (strncmp(query_command, "select", 6) == 0) {
     query_command += 6;
     dbo = parse_select(query_command, context);
@@ -580,9 +961,24 @@ DbOperator* parse_command(char* query_command, int client_socket,
     query_command += 3;
     dbo = parse_max_min(query_command, context, false);
     strcpy(dbo->operator_fields.max_min_operators.handle, handle);
+  } else if (strncmp(query_command, "andnot", 6) == 0) {
+    query_command += 6;
+    dbo = parse_and_or(query_command, context, ANDNOT);
+    if (dbo) strcpy(dbo->operator_fields.and_or_operators.handle, handle);
+  } else if (strncmp(query_command, "and", 3) == 0) {
+    query_command += 3;
+    dbo = parse_and_or(query_command, context, AND);
+    if (dbo) strcpy(dbo->operator_fields.and_or_operators.handle, handle);
+  } else if (strncmp(query_command, "or", 2) == 0) {
+    query_command += 2;
+    dbo = parse_and_or(query_command, context, OR);
+    if (dbo) strcpy(dbo->operator_fields.and_or_operators.handle, handle);
   } else if (strncmp(query_command, "print", 5) == 0) {
     query_command += 5;
     dbo = parse_print(query_command);
+  } else if (strncmp(query_command, "analyze", 7) == 0) {
+    query_command += 7;
+    dbo = parse_analyze(query_command);
   } else if (strncmp(query_command, "shutdown", 8) == 0) {
     dbo = malloc(sizeof(DbOperator));
     dbo->type = CLOSE;
@@ -0,0 +1,156 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "cs165_api.h"
+#include "positions.h"
+
+/*=== Bit Vector ===*/
+
+BitVector* create_bitvector(size_t length) {
+  size_t words = BITVECTOR_WORDS(length);
+  BitVector* bv = calloc(sizeof(BitVector) + sizeof(uint64_t) * words, 1);
+  bv->length = length;
+  return bv;
+}
+
+size_t bitvector_count(BitVector* bv) {
+  size_t count = 0;
+  size_t words = BITVECTOR_WORDS(bv->length);
+  for (size_t i = 0; i < words; i++)
+    count += __builtin_popcountll(bv->words[i]);
+  return count;
+}
+
+size_t bitvector_to_positions(BitVector* bv, int* output) {
+  size_t n = 0;
+  size_t words = BITVECTOR_WORDS(bv->length);
+  for (size_t i = 0; i < words; i++) {
+    uint64_t bits = bv->words[i];
+    while (bits) {
+      output[n++] = i * 64 + __builtin_ctzll(bits);
+      bits &= bits - 1;
+    }
+  }
+  return n;
+}
+
+void bitvector_set_range(BitVector* bv, size_t start, size_t end) {
+  for (; start < end && start % 64; start++)
+    bv->words[start / 64] |= UINT64_C(1) << (start % 64);
+  for (; start + 64 <= end; start += 64) bv->words[start / 64] = ~UINT64_C(0);
+  for (; start < end; start++)
+    bv->words[start / 64] |= UINT64_C(1) << (start % 64);
+}
+
+Result* bitvector_result(BitVector* bv, size_t num_tuples) {
+  Result* result = calloc(sizeof(Result), 1);
+  result->num_tuples = num_tuples;
+  result->data_type = BITVECTOR;
+  result->payload = bv;
+  return result;
+}
+
+void bitvector_iterator(BitVectorIterator* it, BitVector* bv) {
+  it->bv = bv;
+  it->word = 0;
+  it->bits = bv->length > 0 ? bv->words[0] : 0;
+}
+
+int bitvector_next(BitVectorIterator* it) {
+  size_t words = BITVECTOR_WORDS(it->bv->length);
+  while (it->bits == 0) {
+    if (++it->word >= words) return -1;
+    it->bits = it->bv->words[it->word];
+  }
+  int pos = it->word * 64 + __builtin_ctzll(it->bits);
+  it->bits &= it->bits - 1;
+  return pos;
+}
+
+/*=== Slice ===*/
+
+Result* slice_result(size_t start, size_t end) {
+  Slice* slice = malloc(sizeof(Slice));
+  slice->start = start;
+  slice->end = end > start ? end : start;
+
+  Result* result = calloc(sizeof(Result), 1);
+  result->num_tuples = slice->end - slice->start;
+  result->data_type = SLICE;
+  result->payload = slice;
+  return result;
+}
+
+/*=== Copy ===*/
+
+Result* copy_result(Result* res) {
+  if (res == NULL) return NULL;
+  size_t size = 0;
+  switch (res->data_type) {
+    case INT:
+      size = sizeof(int) * res->num_tuples;
+      break;
+    case LONG:
+      size = sizeof(long);
+      break;
+    case DOUBLE:
+      size = sizeof(double);
+      break;
+    case BITVECTOR:
+      size = sizeof(BitVector) +
+             sizeof(uint64_t) *
+                 BITVECTOR_WORDS(((BitVector*)res->payload)->length);
+      break;
+    case SLICE:
+      size = sizeof(Slice);
+  }
+
+  Result* copy = calloc(sizeof(Result), 1);
+  *copy = *res;
+  copy->payload = res->payload ? malloc(size + 1) : NULL;
+  if (copy->payload) memcpy(copy->payload, res->payload, size);
+  return copy;
+}
+
+/*=== Materialize ===*/
+
+int* materialize_positions(Result* res) {
+  switch (res->data_type) {
+    case SLICE: {
+      Slice* slice = (Slice*)res->payload;
+      int* positions = malloc(sizeof(int) * (res->num_tuples + 1));
+      for (size_t i = 0; i < res->num_tuples; i++)
+        positions[i] = slice->start + i;
+      return positions;
+    }
+    case BITVECTOR: {
+      int* positions = malloc(sizeof(int) * (res->num_tuples + 1));
+      bitvector_to_positions((BitVector*)res->payload, positions);
+      return positions;
+    }
+    default:
+      return (int*)res->payload;
+  }
+}
+
+void release_positions(Result* res, int* positions) {
+  if (positions != res->payload) free(positions);
+}
+
+bool all_positions(Result* res, size_t size) {
+  if (res->num_tuples != size) return false;
+  switch (res->data_type) {
+    case SLICE:
+      return ((Slice*)res->payload)->start == 0;
+    case BITVECTOR:
+      return ((BitVector*)res->payload)->length == size;
+    case INT: {
+      int* positions = (int*)res->payload;
+      for (size_t i = 0; i < size; i++)
+        if ((size_t)positions[i] != i) return false;
+      return true;
+    }
+    default:
+      return false;
+  }
+}
@@ -0,0 +1,126 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "row_map.h"
+
+/*=== Maintenance ===*/
+
+RowMap* create_row_map(size_t capacity) {
+  RowMap* rows = calloc(sizeof(RowMap), 1);
+  rows->capacity = capacity > 0 ? capacity : 1;
+  rows->ids = malloc(sizeof(uint32_t) * rows->capacity);
+  rows->pos_capacity = rows->capacity;
+  rows->pos = malloc(sizeof(uint32_t) * rows->pos_capacity);
+  return rows;
+}
+
+void free_row_map(RowMap* rows) {
+  free(rows->ids);
+  free(rows->pos);
+  free(rows);
+}
+
+// Makes room in ids for a table growing to size rows.
+static void reserve_rows(RowMap* rows, size_t size) {
+  if (size > rows->capacity) {
+    while (size > rows->capacity) rows->capacity *= 2;
+    rows->ids = realloc(rows->ids, sizeof(uint32_t) * rows->capacity);
+  }
+}
+
+// Hands out the next num ids, growing pos to hold them.
+static uint32_t next_ids(RowMap* rows, size_t num) {
+  if (rows->next_id + num > rows->pos_capacity) {
+    while (rows->next_id + num > rows->pos_capacity) rows->pos_capacity *= 2;
+    rows->pos = realloc(rows->pos, sizeof(uint32_t) * rows->pos_capacity);
+  }
+  uint32_t first = rows->next_id;
+  rows->next_id += num;
+  return first;
+}
+
+// Points pos back at the rows in positions [from, size).
+static void refresh_positions(RowMap* rows, size_t from, size_t size) {
+  for (size_t p = from; p < size; p++) rows->pos[rows->ids[p]] = p;
+}
+
+uint32_t row_map_insert(RowMap* rows, size_t pos, size_t size) {
+  uint32_t id = next_ids(rows, 1);
+  reserve_rows(rows, size + 1);
+  if (size > pos)
+    memmove(rows->ids + pos + 1, rows->ids + pos,
+            sizeof(uint32_t) * (size - pos));
+  rows->ids[pos] = id;
+  refresh_positions(rows, pos, size + 1);
+  return id;
+}
+
+void row_map_delete(RowMap* rows, int* pos, size_t num, size_t size) {
+  if (num == 0) return;
+  size_t kept = pos[0];
+  for (size_t p = pos[0], d = 0; p < size; p++) {
+    if (d < num && (size_t)pos[d] == p) {
+      rows->pos[rows->ids[p]] = ROW_DELETED;
+      d++;
+    } else {
+      rows->ids[kept++] = rows->ids[p];
+    }
+  }
+  refresh_positions(rows, pos[0], kept);
+}
+
+void row_map_append(RowMap* rows, size_t size, size_t num) {
+  uint32_t first = next_ids(rows, num);
+  reserve_rows(rows, size + num);
+  for (size_t i = 0; i < num; i++) rows->ids[size + i] = first + i;
+  refresh_positions(rows, size, size + num);
+}
+
+void row_map_reorder(RowMap* rows, size_t* order, size_t size) {
+  uint32_t* ids = malloc(sizeof(uint32_t) * (size + 1));
+  for (size_t i = 0; i < size; i++) ids[i] = rows->ids[order[i]];
+  memcpy(rows->ids, ids, sizeof(uint32_t) * size);
+  free(ids);
+  refresh_positions(rows, 0, size);
+}
+
+void row_map_rename(RowMap* rows, uint32_t* names, size_t size,
+                    size_t next_id) {
+  for (size_t p = 0; p < size; p++) rows->ids[p] = names[rows->ids[p]];
+  rows->next_id = 0;
+  next_ids(rows, next_id);
+  for (size_t id = 0; id < next_id; id++) rows->pos[id] = ROW_DELETED;
+  refresh_positions(rows, 0, size);
+}
+
+size_t* row_ids(RowMap* rows, size_t size) {
+  size_t* ids = malloc(sizeof(size_t) * (size + 1));
+  for (size_t i = 0; i < size; i++) ids[i] = rows->ids[i];
+  return ids;
+}
+
+/*=== Persistence ===*/
+
+void sync_row_map(RowMap* rows, size_t size, FILE* fp) {
+  fwrite(&rows->next_id, sizeof(size_t), 1, fp);
+  fwrite(rows->ids, sizeof(uint32_t), size, fp);
+}
+
+/**
+ * A table saved before it had row ids has indexes holding positions, which
+ * become its ids.
+ **/
+RowMap* load_row_map(FILE* fp, size_t size) {
+  RowMap* rows = create_row_map(size);
+  size_t next_id = size;
+  if (fp) {
+    fread(&next_id, sizeof(size_t), 1, fp);
+    fread(rows->ids, sizeof(uint32_t), size, fp);
+  } else {
+    for (size_t i = 0; i < size; i++) rows->ids[i] = i;
+  }
+  next_ids(rows, next_id);
+  for (size_t id = 0; id < next_id; id++) rows->pos[id] = ROW_DELETED;
+  refresh_positions(rows, 0, size);
+  return rows;
+}
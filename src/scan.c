@@ -0,0 +1,475 @@
+#include <immintrin.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "scan.h"
+
+/**
+ * Scan kernels are picked once at runtime from what the CPU supports:
+ *
+ *    kernel   |  values per step  |  compaction
+ * ----------- + ----------------- + ----------------------------------------
+ *     avx2    |        8          |  movemask -> permutevar8x32 lookup table
+ *     sse4    |        4          |  movemask -> pshufb lookup table
+ *  predicated |        1          |  cursor advances by the comparison result
+ *
+ * The vector kernels compare a register of values against both bounds,
+ * turn the result into a bit mask, and use the mask to look up a
+ * permutation that packs the qualifying positions to the front of the
+ * register. The register is stored unconditionally and the output cursor
+ * advances by popcount(mask), so there is no branch per value. The bit
+ * vector kernels skip the compaction and OR the masks into 64-bit words.
+ *
+ * The branching kernels are kept apart from this dispatch; they only pay
+ * off on scalar hardware when the predicate almost never (or almost always)
+ * holds, see choose_scan_kernel.
+ *
+ * IN-list kernels match 64 values at a time into a bit mask: short lists
+ * OR together one broadcast compare per list entry, long lists probe the
+ * hash set value by value. Position output is then read off the mask.
+ **/
+
+typedef size_t (*RangeKernel)(const int*, size_t, int, int, size_t, int*);
+typedef size_t (*RangeIdsKernel)(const int*, const int*, size_t, int, int,
+                                 int*);
+typedef size_t (*RangeBitsKernel)(const int*, size_t, int, int, uint64_t*);
+typedef uint64_t (*InWordKernel)(const int*, const ValueSet*);
+
+static RangeKernel range_kernel;
+static RangeIdsKernel range_ids_kernel;
+static RangeBitsKernel range_bits_kernel;
+static InWordKernel in_word_kernel;
+static const char* kernel_name;
+static pthread_once_t kernel_once = PTHREAD_ONCE_INIT;
+
+static int32_t lut_avx2[256][8] __attribute__((aligned(32)));
+static uint8_t lut_sse4[16][16] __attribute__((aligned(16)));
+
+/*=== Scalar ===*/
+
+static size_t range_branching(const int* input, size_t length, int low,
+                              int high, size_t base, int* output) {
+  size_t n = 0;
+  for (size_t i = 0; i < length; i++)
+    if (input[i] >= low && input[i] <= high) output[n++] = base + i;
+  return n;
+}
+
+static size_t range_predicated(const int* input, size_t length, int low,
+                               int high, size_t base, int* output) {
+  size_t n = 0;
+  for (size_t i = 0; i < length; i++) {
+    output[n] = base + i;
+    n += (input[i] >= low) & (input[i] <= high);
+  }
+  return n;
+}
+
+static size_t range_ids_branching(const int* input, const int* ids,
+                                  size_t length, int low, int high,
+                                  int* output) {
+  size_t n = 0;
+  for (size_t i = 0; i < length; i++)
+    if (input[i] >= low && input[i] <= high) output[n++] = ids[i];
+  return n;
+}
+
+static size_t range_ids_predicated(const int* input, const int* ids,
+                                   size_t length, int low, int high,
+                                   int* output) {
+  size_t n = 0;
+  for (size_t i = 0; i < length; i++) {
+    output[n] = ids[i];
+    n += (input[i] >= low) & (input[i] <= high);
+  }
+  return n;
+}
+
+static size_t range_bits_predicated(const int* input, size_t length, int low,
+                                int high, uint64_t* words) {
+  size_t n = 0;
+  for (size_t w = 0; w * 64 < length; w++) {
+    uint64_t word = 0;
+    for (size_t i = w * 64; i < length && i < (w + 1) * 64; i++)
+      word |= (uint64_t)(input[i] >= low && input[i] <= high) << (i % 64);
+    words[w] = word;
+    n += __builtin_popcountll(word);
+  }
+  return n;
+}
+
+/*=== SSE4 ===*/
+
+__attribute__((target("sse4.1"))) static size_t range_sse4(
+    const int* input, size_t length, int low, int high, size_t base,
+    int* output) {
+  __m128i lo = _mm_set1_epi32(low);
+  __m128i hi = _mm_set1_epi32(high);
+  __m128i ids = _mm_add_epi32(_mm_setr_epi32(0, 1, 2, 3),
+                              _mm_set1_epi32((int)base));
+  __m128i step = _mm_set1_epi32(4);
+
+  size_t n = 0;
+  size_t i = 0;
+  for (; i + 4 <= length; i += 4) {
+    __m128i v = _mm_loadu_si128((const __m128i*)(input + i));
+    __m128i out = _mm_or_si128(_mm_cmpgt_epi32(lo, v), _mm_cmpgt_epi32(v, hi));
+    int mask = ~_mm_movemask_ps(_mm_castsi128_ps(out)) & 0xF;
+    __m128i perm = _mm_load_si128((const __m128i*)lut_sse4[mask]);
+    _mm_storeu_si128((__m128i*)(output + n), _mm_shuffle_epi8(ids, perm));
+    n += __builtin_popcount(mask);
+    ids = _mm_add_epi32(ids, step);
+  }
+  return n + range_predicated(input + i, length - i, low, high, base + i,
+                              output + n);
+}
+
+__attribute__((target("sse4.1"))) static size_t range_ids_sse4(
+    const int* input, const int* ids, size_t length, int low, int high,
+    int* output) {
+  __m128i lo = _mm_set1_epi32(low);
+  __m128i hi = _mm_set1_epi32(high);
+
+  size_t n = 0;
+  size_t i = 0;
+  for (; i + 4 <= length; i += 4) {
+    __m128i v = _mm_loadu_si128((const __m128i*)(input + i));
+    __m128i id = _mm_loadu_si128((const __m128i*)(ids + i));
+    __m128i out = _mm_or_si128(_mm_cmpgt_epi32(lo, v), _mm_cmpgt_epi32(v, hi));
+    int mask = ~_mm_movemask_ps(_mm_castsi128_ps(out)) & 0xF;
+    __m128i perm = _mm_load_si128((const __m128i*)lut_sse4[mask]);
+    _mm_storeu_si128((__m128i*)(output + n), _mm_shuffle_epi8(id, perm));
+    n += __builtin_popcount(mask);
+  }
+  return n + range_ids_predicated(input + i, ids + i, length - i, low, high,
+                                  output + n);
+}
+
+__attribute__((target("sse4.1"))) static size_t range_bits_sse4(
+    const int* input, size_t length, int low, int high, uint64_t* words) {
+  __m128i lo = _mm_set1_epi32(low);
+  __m128i hi = _mm_set1_epi32(high);
+
+  size_t n = 0;
+  size_t w = 0;
+  for (; (w + 1) * 64 <= length; w++) {
+    uint64_t word = 0;
+    for (size_t k = 0; k < 16; k++) {
+      __m128i v = _mm_loadu_si128((const __m128i*)(input + w * 64 + k * 4));
+      __m128i out =
+          _mm_or_si128(_mm_cmpgt_epi32(lo, v), _mm_cmpgt_epi32(v, hi));
+      uint64_t mask = ~_mm_movemask_ps(_mm_castsi128_ps(out)) & 0xF;
+      word |= mask << (k * 4);
+    }
+    words[w] = word;
+    n += __builtin_popcountll(word);
+  }
+  return n + range_bits_predicated(input + w * 64, length - w * 64, low, high,
+                               words + w);
+}
+
+/*=== AVX2 ===*/
+
+__attribute__((target("avx2"))) static size_t range_avx2(
+    const int* input, size_t length, int low, int high, size_t base,
+    int* output) {
+  __m256i lo = _mm256_set1_epi32(low);
+  __m256i hi = _mm256_set1_epi32(high);
+  __m256i ids = _mm256_add_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+                                 _mm256_set1_epi32((int)base));
+  __m256i step = _mm256_set1_epi32(8);
+
+  size_t n = 0;
+  size_t i = 0;
+  for (; i + 8 <= length; i += 8) {
+    __m256i v = _mm256_loadu_si256((const __m256i*)(input + i));
+    __m256i out =
+        _mm256_or_si256(_mm256_cmpgt_epi32(lo, v), _mm256_cmpgt_epi32(v, hi));
+    int mask = ~_mm256_movemask_ps(_mm256_castsi256_ps(out)) & 0xFF;
+    __m256i perm = _mm256_load_si256((const __m256i*)lut_avx2[mask]);
+    _mm256_storeu_si256((__m256i*)(output + n),
+                        _mm256_permutevar8x32_epi32(ids, perm));
+    n += __builtin_popcount(mask);
+    ids = _mm256_add_epi32(ids, step);
+  }
+  return n + range_predicated(input + i, length - i, low, high, base + i,
+                              output + n);
+}
+
+__attribute__((target("avx2"))) static size_t range_ids_avx2(
+    const int* input, const int* ids, size_t length, int low, int high,
+    int* output) {
+  __m256i lo = _mm256_set1_epi32(low);
+  __m256i hi = _mm256_set1_epi32(high);
+
+  size_t n = 0;
+  size_t i = 0;
+  for (; i + 8 <= length; i += 8) {
+    __m256i v = _mm256_loadu_si256((const __m256i*)(input + i));
+    __m256i id = _mm256_loadu_si256((const __m256i*)(ids + i));
+    __m256i out =
+        _mm256_or_si256(_mm256_cmpgt_epi32(lo, v), _mm256_cmpgt_epi32(v, hi));
+    int mask = ~_mm256_movemask_ps(_mm256_castsi256_ps(out)) & 0xFF;
+    __m256i perm = _mm256_load_si256((const __m256i*)lut_avx2[mask]);
+    _mm256_storeu_si256((__m256i*)(output + n),
+                        _mm256_permutevar8x32_epi32(id, perm));
+    n += __builtin_popcount(mask);
+  }
+  return n + range_ids_predicated(input + i, ids + i, length - i, low, high,
+                                  output + n);
+}
+
+__attribute__((target("avx2"))) static size_t range_bits_avx2(
+    const int* input, size_t length, int low, int high, uint64_t* words) {
+  __m256i lo = _mm256_set1_epi32(low);
+  __m256i hi = _mm256_set1_epi32(high);
+
+  size_t n = 0;
+  size_t w = 0;
+  for (; (w + 1) * 64 <= length; w++) {
+    uint64_t word = 0;
+    for (size_t k = 0; k < 8; k++) {
+      __m256i v = _mm256_loadu_si256((const __m256i*)(input + w * 64 + k * 8));
+      __m256i out = _mm256_or_si256(_mm256_cmpgt_epi32(lo, v),
+                                    _mm256_cmpgt_epi32(v, hi));
+      uint64_t mask = ~_mm256_movemask_ps(_mm256_castsi256_ps(out)) & 0xFF;
+      word |= mask << (k * 8);
+    }
+    words[w] = word;
+    n += __builtin_popcountll(word);
+  }
+  return n + range_bits_predicated(input + w * 64, length - w * 64, low, high,
+                               words + w);
+}
+
+/*=== IN List ===*/
+
+static size_t hash_value(int val, unsigned bits) {
+  return ((uint32_t)val * UINT32_C(2654435761)) >> (32 - bits);
+}
+
+static int compare_ints(const void* a, const void* b) {
+  int x = *(const int*)a;
+  int y = *(const int*)b;
+  return (x > y) - (x < y);
+}
+
+// Sorts and deduplicates vals (num_vals >= 1) and, for long lists, builds
+// a hash set at most half full.
+void init_value_set(ValueSet* set, const int* vals, size_t num_vals) {
+  set->vals = malloc(sizeof(int) * num_vals);
+  memcpy(set->vals, vals, sizeof(int) * num_vals);
+  qsort(set->vals, num_vals, sizeof(int), compare_ints);
+  size_t n = 1;
+  for (size_t i = 1; i < num_vals; i++)
+    if (set->vals[i] != set->vals[n - 1]) set->vals[n++] = set->vals[i];
+  set->num_vals = n;
+  set->slots = NULL;
+  set->bits = 0;
+  if (n <= IN_LIST_BROADCAST) return;
+
+  set->bits = 1;
+  while (((size_t)1 << set->bits) < 2 * n) set->bits++;
+  size_t capacity = (size_t)1 << set->bits;
+  set->slots = malloc(sizeof(int) * capacity);
+  for (size_t s = 0; s < capacity; s++) set->slots[s] = set->vals[0];
+  for (size_t i = 1; i < n; i++) {
+    size_t s = hash_value(set->vals[i], set->bits);
+    while (set->slots[s] != set->vals[0]) s = (s + 1) & (capacity - 1);
+    set->slots[s] = set->vals[i];
+  }
+}
+
+void free_value_set(ValueSet* set) {
+  free(set->vals);
+  free(set->slots);
+  set->vals = NULL;
+  set->slots = NULL;
+}
+
+bool value_set_contains(const ValueSet* set, int val) {
+  if (!set->slots) {
+    bool found = false;
+    for (size_t k = 0; k < set->num_vals; k++) found |= val == set->vals[k];
+    return found;
+  }
+  size_t mask = ((size_t)1 << set->bits) - 1;
+  for (size_t s = hash_value(val, set->bits);; s = (s + 1) & mask) {
+    if (set->slots[s] == val) return true;
+    if (set->slots[s] == set->vals[0]) return false;
+  }
+}
+
+static uint64_t in_word_predicated(const int* input, size_t length,
+                                   const ValueSet* set) {
+  uint64_t word = 0;
+  for (size_t i = 0; i < length; i++)
+    word |= (uint64_t)value_set_contains(set, input[i]) << i;
+  return word;
+}
+
+static uint64_t in_word_scalar(const int* input, const ValueSet* set) {
+  return in_word_predicated(input, 64, set);
+}
+
+__attribute__((target("sse4.1"))) static uint64_t in_word_sse4(
+    const int* input, const ValueSet* set) {
+  __m128i keys[IN_LIST_BROADCAST];
+  for (size_t k = 0; k < set->num_vals; k++)
+    keys[k] = _mm_set1_epi32(set->vals[k]);
+
+  uint64_t word = 0;
+  for (size_t j = 0; j < 16; j++) {
+    __m128i v = _mm_loadu_si128((const __m128i*)(input + j * 4));
+    __m128i eq = _mm_setzero_si128();
+    for (size_t k = 0; k < set->num_vals; k++)
+      eq = _mm_or_si128(eq, _mm_cmpeq_epi32(v, keys[k]));
+    word |= (uint64_t)_mm_movemask_ps(_mm_castsi128_ps(eq)) << (j * 4);
+  }
+  return word;
+}
+
+__attribute__((target("avx2"))) static uint64_t in_word_avx2(
+    const int* input, const ValueSet* set) {
+  __m256i keys[IN_LIST_BROADCAST];
+  for (size_t k = 0; k < set->num_vals; k++)
+    keys[k] = _mm256_set1_epi32(set->vals[k]);
+
+  uint64_t word = 0;
+  for (size_t j = 0; j < 8; j++) {
+    __m256i v = _mm256_loadu_si256((const __m256i*)(input + j * 8));
+    __m256i eq = _mm256_setzero_si256();
+    for (size_t k = 0; k < set->num_vals; k++)
+      eq = _mm256_or_si256(eq, _mm256_cmpeq_epi32(v, keys[k]));
+    word |= (uint64_t)_mm256_movemask_ps(_mm256_castsi256_ps(eq)) << (j * 8);
+  }
+  return word;
+}
+
+// Members among the first min(length, 64) values of input, as a bit mask.
+static uint64_t in_word(const int* input, size_t length, const ValueSet* set) {
+  if (length < 64) return in_word_predicated(input, length, set);
+  return set->slots ? in_word_scalar(input, set) : in_word_kernel(input, set);
+}
+
+/*=== Dispatch ===*/
+
+static void init_lookup_tables() {
+  for (int mask = 0; mask < 256; mask++) {
+    int k = 0;
+    for (int bit = 0; bit < 8; bit++)
+      if (mask & (1 << bit)) lut_avx2[mask][k++] = bit;
+    while (k < 8) lut_avx2[mask][k++] = 0;
+  }
+  for (int mask = 0; mask < 16; mask++) {
+    int k = 0;
+    for (int lane = 0; lane < 4; lane++)
+      if (mask & (1 << lane))
+        for (int byte = 0; byte < 4; byte++)
+          lut_sse4[mask][k++] = (uint8_t)(lane * 4 + byte);
+    while (k < 16) lut_sse4[mask][k++] = 0x80;
+  }
+}
+
+static void init_kernels() {
+  init_lookup_tables();
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    range_kernel = range_avx2;
+    range_ids_kernel = range_ids_avx2;
+    range_bits_kernel = range_bits_avx2;
+    in_word_kernel = in_word_avx2;
+    kernel_name = "avx2";
+  } else if (__builtin_cpu_supports("sse4.1")) {
+    range_kernel = range_sse4;
+    range_ids_kernel = range_ids_sse4;
+    range_bits_kernel = range_bits_sse4;
+    in_word_kernel = in_word_sse4;
+    kernel_name = "sse4";
+  } else {
+    range_kernel = range_predicated;
+    range_ids_kernel = range_ids_predicated;
+    range_bits_kernel = range_bits_predicated;
+    in_word_kernel = in_word_scalar;
+    kernel_name = "predicated";
+  }
+}
+
+size_t scan_range(const int* input, size_t length, int low, int high,
+                  size_t base, int* output) {
+  pthread_once(&kernel_once, init_kernels);
+  return range_kernel(input, length, low, high, base, output);
+}
+
+size_t scan_range_ids(const int* input, const int* ids, size_t length,
+                      int low, int high, int* output) {
+  pthread_once(&kernel_once, init_kernels);
+  return range_ids_kernel(input, ids, length, low, high, output);
+}
+
+size_t scan_range_bits(const int* input, size_t length, int low, int high,
+                       uint64_t* words) {
+  pthread_once(&kernel_once, init_kernels);
+  return range_bits_kernel(input, length, low, high, words);
+}
+
+size_t scan_range_branching(const int* input, size_t length, int low,
+                            int high, size_t base, int* output) {
+  return range_branching(input, length, low, high, base, output);
+}
+
+size_t scan_range_ids_branching(const int* input, const int* ids,
+                                size_t length, int low, int high,
+                                int* output) {
+  return range_ids_branching(input, ids, length, low, high, output);
+}
+
+size_t scan_in(const int* input, size_t length, const ValueSet* set,
+               size_t base, int* output) {
+  pthread_once(&kernel_once, init_kernels);
+  size_t n = 0;
+  for (size_t i = 0; i < length; i += 64) {
+    uint64_t word = in_word(input + i, length - i, set);
+    for (; word; word &= word - 1)
+      output[n++] = base + i + __builtin_ctzll(word);
+  }
+  return n;
+}
+
+size_t scan_in_ids(const int* input, const int* ids, size_t length,
+                   const ValueSet* set, int* output) {
+  pthread_once(&kernel_once, init_kernels);
+  size_t n = 0;
+  for (size_t i = 0; i < length; i += 64) {
+    uint64_t word = in_word(input + i, length - i, set);
+    for (; word; word &= word - 1) output[n++] = ids[i + __builtin_ctzll(word)];
+  }
+  return n;
+}
+
+size_t scan_in_bits(const int* input, size_t length, const ValueSet* set,
+                    uint64_t* words) {
+  pthread_once(&kernel_once, init_kernels);
+  size_t n = 0;
+  for (size_t w = 0; w * 64 < length; w++) {
+    words[w] = in_word(input + w * 64, length - w * 64, set);
+    n += __builtin_popcountll(words[w]);
+  }
+  return n;
+}
+
+ScanKernel choose_scan_kernel(double selectivity) {
+  pthread_once(&kernel_once, init_kernels);
+  if (range_kernel != range_predicated) return PREDICATED;
+  if (selectivity < BRANCHING_SELECTIVITY ||
+      selectivity > 1 - BRANCHING_SELECTIVITY)
+    return BRANCHING;
+  return PREDICATED;
+}
+
+const char* scan_kernel_name(ScanKernel kernel) {
+  pthread_once(&kernel_once, init_kernels);
+  return kernel == BRANCHING ? "branching" : kernel_name;
+}
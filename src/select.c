@@ -1,42 +1,241 @@
-#include <pthread.h>
+#include <limits.h>
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
 
+#include "bitmap.h"
 #include "btree.h"
+#include "client_context.h"
 #include "cs165_api.h"
+#include "cracker.h"
+#include "css_tree.h"
+#include "db_manager.h"
+#include "hash_index.h"
+#include "index.h"
+#include "positions.h"
+#include "scan.h"
+#include "select.h"
+#include "thread_pool.h"
 #include "utils.h"
 
 /*=== Select ===*/
 
-Result* select_from_sorted(Comparator* cmp) {
-  Column* col = cmp->gen_col->column_pointer.column;
+/**
+ * Translates a comparator into inclusive [low, high] scan bounds. An empty
+ * range comes back as low > high. Returns false for comparisons that are
+ * not a single range (IN lists).
+ **/
+static bool comparator_bounds(Comparator* cmp, int* low, int* high) {
+  long p_low = INT_MIN;
+  long p_high = (long)INT_MAX + 1;
+  switch (cmp->type1 + cmp->type2) {
+    case NO_COMPARISON:
+      break;
+    case LESS_THAN:
+      p_high = cmp->p_high;
+      break;
+    case GREATER_THAN_OR_EQUAL:
+      p_low = cmp->p_low;
+      break;
+    case RANGE:
+      p_low = cmp->p_low;
+      p_high = cmp->p_high;
+      break;
+    case EQUAL:
+      p_low = cmp->p_low;
+      p_high = cmp->p_low + 1;
+      break;
+    default:
+      return false;
+  }
+  if (p_high <= p_low) {
+    *low = INT_MAX;
+    *high = INT_MIN;
+  } else {
+    *low = p_low;
+    *high = p_high - 1;
+  }
+  return true;
+}
+
+static void free_comparator(Comparator* cmp) {
+  free(cmp->gen_col);
+  if (cmp->gen_col_id) free(cmp->gen_col_id);
+  free(cmp->p_vals);
+  free(cmp);
+}
+
+/**
+ * Estimates the fraction of input in [low, high] from an evenly strided
+ * sample of at most SAMPLE_SIZE values. A strided sample rather than a
+ * prefix keeps the estimate honest on sorted and time-ordered columns.
+ **/
+static double estimate_selectivity(int* input, size_t length, int low,
+                                   int high) {
+  if (length == 0) return 0;
+  size_t step = length > SAMPLE_SIZE ? length / SAMPLE_SIZE : 1;
+  size_t hits = 0;
+  size_t samples = 0;
+  for (size_t i = 0; i < length; i += step, samples++)
+    hits += input[i] >= low && input[i] <= high;
+  return (double)hits / samples;
+}
+
+static double estimate_in_selectivity(int* input, size_t length,
+                                      const ValueSet* set) {
+  if (length == 0) return 0;
+  size_t step = length > SAMPLE_SIZE ? length / SAMPLE_SIZE : 1;
+  size_t hits = 0;
+  size_t samples = 0;
+  for (size_t i = 0; i < length; i += step, samples++)
+    hits += value_set_contains(set, input[i]);
+  return (double)hits / samples;
+}
+
+// First index of sorted vals holding a value >= val, or length if none.
+static size_t lower_bound(int* vals, size_t length, long val) {
+  size_t low = 0;
+  size_t high = length;
+  while (low < high) {
+    size_t mid = low + (high - low) / 2;
+    if (vals[mid] < val)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  return low;
+}
+
+/**
+ * The CSS-tree of col if it has one, rebuilt first if writes left it
+ * stale. It indexes col->data on a clustered column, the sorted copy
+ * otherwise.
+ **/
+static CssTree* css_tree_of(Column* col) {
+  if (col->index.type != CSS) return NULL;
+  CssIndex* index = (CssIndex*)(col->index.payload);
+  refresh_css_tree(&index->tree,
+                   col->clustered ? col->data : index->sorted.vals, col->size);
+  return &index->tree;
+}
 
+// First index from on of the sorted input holding a value >= val, through
+// the CSS-tree when there is one.
+static size_t search_sorted(Column* col, CssTree* tree, int* input,
+                            size_t from, long val) {
+  if (tree) {
+    size_t found = css_lower_bound(tree, input, val);
+    return found > from ? found : from;
+  }
+  return from + lower_bound(input + from, col->size - from, val);
+}
+
+static Result* int_result(int* payload, size_t num_tuples) {
+  Result* result = calloc(sizeof(Result), 1);
+  result->num_tuples = num_tuples;
+  result->data_type = INT;
+  result->payload = payload;
+  return result;
+}
+
+// On a clustered column the positions in [low, high] are contiguous and
+// come back as a slice found by two binary searches.
+static Result* select_slice(Column* col, int low, int high) {
+  CssTree* tree = css_tree_of(col);
+  size_t start = search_sorted(col, tree, col->data, 0, low);
+  size_t end = search_sorted(col, tree, col->data, 0, (long)high + 1);
+  return slice_result(start, end);
+}
+
+static Result* select_from_sorted(Column* col, int low, int high) {
+  SortedIndex* payload = (SortedIndex*)(col->index.payload);
+  int* input = payload->vals;
+  size_t* ids = payload->pos;
+  uint32_t* pos = col->rows->pos;
+
+  CssTree* tree = css_tree_of(col);
+  size_t pos_low = search_sorted(col, tree, input, 0, low);
+  size_t pos_high = search_sorted(col, tree, input, 0, (long)high + 1);
+  size_t res_size = pos_high > pos_low ? pos_high - pos_low : 0;
+  int* output = malloc(sizeof(int) * (res_size + 1));
+  for (size_t i = 0; i < res_size; i++) output[i] = pos[ids[i + pos_low]];
+
+  Result* result = calloc(sizeof(Result), 1);
+  result->num_tuples = res_size;
+  result->data_type = INT;
+  result->payload = output;
+  return result;
+}
+
+/**
+ * Answers an IN list from a sorted copy of the column: two searches per
+ * list value, each starting where the previous value's matches ended
+ * since the values come in ascending order. On a clustered column the
+ * positions come out sorted.
+ **/
+static Result* select_in_sorted(Column* col, const ValueSet* set) {
   int* input = NULL;
-  size_t* pos = NULL;
+  size_t* ids = NULL;
 
   if (col->clustered) {
     input = col->data;
   } else {
     SortedIndex* payload = (SortedIndex*)(col->index.payload);
     input = payload->vals;
-    pos = payload->pos;
+    ids = payload->pos;
   }
 
-  size_t pos_low = binary_search(input, col->size, cmp->p_low);
-  size_t pos_high = binary_search(input, col->size, cmp->p_high);
-  if (cmp->p_low > input[pos_low]) pos_low++;
-  if (cmp->p_high <= input[pos_high]) pos_high--;
+  CssTree* tree = css_tree_of(col);
+  size_t* bounds = malloc(sizeof(size_t) * 2 * set->num_vals);
+  size_t from = 0;
+  size_t res_size = 0;
+  for (size_t k = 0; k < set->num_vals; k++) {
+    bounds[2 * k] = search_sorted(col, tree, input, from, set->vals[k]);
+    from = bounds[2 * k];
+    bounds[2 * k + 1] =
+        search_sorted(col, tree, input, from, (long)set->vals[k] + 1);
+    from = bounds[2 * k + 1];
+    res_size += bounds[2 * k + 1] - bounds[2 * k];
+  }
 
-  size_t res_size = pos_high - pos_low + 1;
-  int* output = malloc(sizeof(int) * res_size);
+  int* output = malloc(sizeof(int) * (res_size + 1));
+  size_t n = 0;
+  for (size_t k = 0; k < set->num_vals; k++)
+    for (size_t i = bounds[2 * k]; i < bounds[2 * k + 1]; i++)
+      output[n++] = col->clustered ? (int)i : (int)col->rows->pos[ids[i]];
+  free(bounds);
 
-  if (col->clustered) {
-    for (size_t i = 0; i < res_size; i++) output[i] = i + pos_low;
-  } else {
-    for (size_t i = 0; i < res_size; i++)
-      output[i] = pos[i + pos_low];
+  Result* result = calloc(sizeof(Result), 1);
+  result->num_tuples = res_size;
+  result->data_type = INT;
+  result->payload = output;
+  return result;
+}
+
+// Appends the positions of the B-tree entries in [low, high] to output,
+// looking up the rows the entries name in pos.
+static void walk_btree(BTree* tree, uint32_t* pos, int low, int high,
+                       int** output, size_t* res_size, size_t* res_capacity) {
+  if (low > high) return;
+  size_t i;
+  for (BTreeLeaf* cur = btree_search(tree, low, &i); cur;
+       cur = btree_next_leaf(tree, cur), i = 0) {
+    if (cur->next) __builtin_prefetch(btree_next_leaf(tree, cur));
+    size_t length = cur->header.length;
+    for (; i < length && cur->vals[i] <= high; i++) {
+      if (*res_size >= *res_capacity) resize_array(output, res_capacity);
+      (*output)[(*res_size)++] = pos[cur->idxs[i]];
+    }
+    if (i < length) break;
   }
+}
+
+static Result* select_from_btree(Column* col, int low, int high) {
+  size_t res_size = 0;
+  size_t res_capacity = DEFAULT_CAPACITY;
+  int* output = malloc(sizeof(int) * res_capacity);
+  walk_btree((BTree*)(col->index.payload), col->rows->pos, low, high,
+             &output, &res_size, &res_capacity);
 
   Result* result = calloc(sizeof(Result), 1);
   result->num_tuples = res_size;
@@ -45,37 +244,440 @@ Result* select_from_sorted(Comparator* cmp) {
   return result;
 }
 
-Result* select_from_btree(Comparator* cmp) {
-  Column* col = cmp->gen_col->column_pointer.column;
-  BTreeNode* root = (BTreeNode*)(col->index.payload);
+// Answers an IN list with one B-tree descent per list value.
+static Result* select_in_btree(Column* col, const ValueSet* set) {
+  size_t res_size = 0;
+  size_t res_capacity = DEFAULT_CAPACITY;
+  int* output = malloc(sizeof(int) * res_capacity);
+  for (size_t k = 0; k < set->num_vals; k++)
+    walk_btree((BTree*)(col->index.payload), col->rows->pos, set->vals[k],
+               set->vals[k], &output, &res_size, &res_capacity);
+
+  Result* result = calloc(sizeof(Result), 1);
+  result->num_tuples = res_size;
+  result->data_type = INT;
+  result->payload = output;
+  return result;
+}
 
-  int p_low = cmp->p_low;
-  int p_high = cmp->p_high;
+/**
+ * Answers a predicate from a bitmap index without reading the column. A
+ * single bitmap decodes straight to positions; several are ORed into a bit
+ * vector, which is handed back as is when dense and turned into positions
+ * otherwise.
+ **/
+static Result* select_bitmaps(Column* col, WahBitmap** bitmaps, size_t num) {
+  size_t res_size = 0;
+  size_t words = 0;
+  for (size_t b = 0; b < num; b++) {
+    res_size += bitmaps[b]->count;
+    words += bitmaps[b]->num_words;
+  }
+  bool dense = res_size >= BITVECTOR_SELECTIVITY * col->size;
+  cs165_log(stdout, "BITMAP: %s bitmaps=%zu words=%zu output=%s\n",
+            col->name, num, words, dense ? "bitvector" : "positions");
 
-  BTreeNode* node_low = btree_search(root, p_low);
-  BTreeNode* node_high = btree_search(root, p_high);
-  BTreeNode* cur = node_low;
+  if (num == 1 && !dense) {
+    int* output = malloc(sizeof(int) * (res_size + 1));
+    wah_positions(bitmaps[0], output);
+    return int_result(output, res_size);
+  }
 
+  BitVector* bv = create_bitvector(col->size);
+  for (size_t b = 0; b < num; b++) wah_or(bitmaps[b], bv);
+  if (dense) return bitvector_result(bv, res_size);
+
+  int* output = malloc(sizeof(int) * (res_size + 1));
+  bitvector_to_positions(bv, output);
+  free(bv);
+  return int_result(output, res_size);
+}
+
+static Result* select_from_bitmap(Column* col, int low, int high) {
+  BitmapIndex* index = (BitmapIndex*)(col->index.payload);
+  size_t first = bitmap_lower_bound(index, low);
+  size_t num = 0;
+  while (first + num < index->num_values && index->values[first + num] <= high)
+    num++;
+
+  // As many bitmaps as distinct values in the range, so not on the stack
+  // of a pool worker.
+  WahBitmap** bitmaps = malloc(sizeof(WahBitmap*) * (num + 1));
+  for (size_t b = 0; b < num; b++) bitmaps[b] = index->bitmaps + first + b;
+  Result* result = select_bitmaps(col, bitmaps, num);
+  free(bitmaps);
+  return result;
+}
+
+static Result* select_in_bitmap(Column* col, const ValueSet* set) {
+  BitmapIndex* index = (BitmapIndex*)(col->index.payload);
+  WahBitmap** bitmaps = malloc(sizeof(WahBitmap*) * (set->num_vals + 1));
+  size_t num = 0;
+  for (size_t k = 0; k < set->num_vals; k++) {
+    size_t v = bitmap_lower_bound(index, set->vals[k]);
+    if (v < index->num_values && index->values[v] == set->vals[k])
+      bitmaps[num++] = index->bitmaps + v;
+  }
+  Result* result = select_bitmaps(col, bitmaps, num);
+  free(bitmaps);
+  return result;
+}
+
+/**
+ * Answers an equality, a short range or an IN list from a hash index, one
+ * probe per value. The positions come out grouped by value, each group in
+ * row id order, which a clustered insert may have made differ from
+ * position order.
+ **/
+static void probe_hash(HashIndex* index, uint32_t* pos, int val, int** output,
+                       size_t* res_size, size_t* res_capacity) {
+  HashEntry* entry = hash_index_lookup(index, val);
+  if (entry == NULL) return;
+  uint32_t* ids = hash_entry_positions(entry);
+  for (size_t i = 0; i < entry->count; i++) {
+    if (*res_size >= *res_capacity) resize_array(output, res_capacity);
+    (*output)[(*res_size)++] = pos[ids[i]];
+  }
+}
+
+static Result* select_from_hash(Column* col, int low, int high) {
+  HashIndex* index = (HashIndex*)(col->index.payload);
   size_t res_size = 0;
   size_t res_capacity = DEFAULT_CAPACITY;
   int* output = malloc(sizeof(int) * res_capacity);
+  for (long val = low; val <= high; val++)
+    probe_hash(index, col->rows->pos, val, &output, &res_size, &res_capacity);
+  cs165_log(stdout, "HASH: %s probes=%ld output=%zu\n", col->name,
+            low <= high ? (long)high - low + 1 : 0, res_size);
+  return int_result(output, res_size);
+}
 
-  while (cur) {
-    for (size_t i = 0; i < cur->length; i++) {
-      if (cur->vals[i] < p_low) {
-        continue;
-      } else if (cur->vals[i] >= p_high) {
-        break;
-      }
-      else {
-        if (res_size >= res_capacity) resize_array(&output, &res_capacity);
-        output[res_size++] = cur->idxs[i];
-      }
+static Result* select_in_hash(Column* col, const ValueSet* set) {
+  HashIndex* index = (HashIndex*)(col->index.payload);
+  size_t res_size = 0;
+  size_t res_capacity = DEFAULT_CAPACITY;
+  int* output = malloc(sizeof(int) * res_capacity);
+  for (size_t k = 0; k < set->num_vals; k++)
+    probe_hash(index, col->rows->pos, set->vals[k], &output, &res_size,
+               &res_capacity);
+  cs165_log(stdout, "HASH: %s probes=%zu output=%zu\n", col->name,
+            set->num_vals, res_size);
+  return int_result(output, res_size);
+}
+
+/**
+ * Answers a range or an IN list from a cracked index, cracking the column
+ * copy at the bounds of every range. The positions come out in the order
+ * the pieces left them.
+ **/
+static Result* select_from_cracked(Column* col, int low, int high) {
+  CrackerIndex* index = (CrackerIndex*)(col->index.payload);
+  size_t res_size = 0;
+  size_t res_capacity = DEFAULT_CAPACITY;
+  int* output = malloc(sizeof(int) * res_capacity);
+  cracker_select(index, col->rows->pos, low, high, &output, &res_size,
+                 &res_capacity);
+  cs165_log(stdout, "CRACK: %s pieces=%zu output=%zu\n", col->name,
+            index->num_bounds + 1, res_size);
+  return int_result(output, res_size);
+}
+
+static Result* select_in_cracked(Column* col, const ValueSet* set) {
+  CrackerIndex* index = (CrackerIndex*)(col->index.payload);
+  size_t res_size = 0;
+  size_t res_capacity = DEFAULT_CAPACITY;
+  int* output = malloc(sizeof(int) * res_capacity);
+  for (size_t k = 0; k < set->num_vals; k++)
+    cracker_select(index, col->rows->pos, set->vals[k], set->vals[k], &output,
+                   &res_size, &res_capacity);
+  cs165_log(stdout, "CRACK: %s pieces=%zu output=%zu\n", col->name,
+            index->num_bounds + 1, res_size);
+  return int_result(output, res_size);
+}
+
+// The projection sorted on col, unless col is itself clustered.
+static Table* projection_of(Column* col) {
+  if (col->clustered) return NULL;
+  Table* tbl = lookup_column_table(col);
+  return tbl ? lookup_projection(tbl, col->name) : NULL;
+}
+
+/**
+ * Answers [low, high] with the slice of the projection proj sorted on col,
+ * translated to positions of col's table through the shared row ids. The
+ * positions come out in key order, and fetches of the columns proj holds
+ * copy the slice instead of gathering them.
+ **/
+static Result* select_from_projection(Table* proj, Column* col, int low,
+                                      int high) {
+  Column* key = proj->columns;
+  CssTree* tree = css_tree_of(key);
+  size_t start = search_sorted(key, tree, key->data, 0, low);
+  size_t end = search_sorted(key, tree, key->data, 0, (long)high + 1);
+  size_t res_size = end > start ? end - start : 0;
+
+  uint32_t* ids = proj->rows->ids + start;
+  uint32_t* pos = col->rows->pos;
+  int* output = malloc(sizeof(int) * (res_size + 1));
+  for (size_t i = 0; i < res_size; i++) output[i] = pos[ids[i]];
+  cs165_log(stdout, "PROJECTION: %s -> %s rows=[%zu, %zu)\n", col->name,
+            proj->name, start, start + res_size);
+
+  Result* result = int_result(output, res_size);
+  result->projection = proj;
+  result->proj_start = start;
+  result->proj_writes = key->writes;
+  return result;
+}
+
+/**
+ * IN-list counterpart of select_from_projection: a slice of proj per list
+ * value, translated to positions of col's table. The slices are not
+ * contiguous, so fetches gather as after any index.
+ **/
+static Result* select_in_projection(Table* proj, Column* col,
+                                    const ValueSet* set) {
+  Column* key = proj->columns;
+  CssTree* tree = css_tree_of(key);
+  size_t* bounds = malloc(sizeof(size_t) * 2 * set->num_vals);
+  size_t from = 0;
+  size_t res_size = 0;
+  for (size_t k = 0; k < set->num_vals; k++) {
+    bounds[2 * k] = search_sorted(key, tree, key->data, from, set->vals[k]);
+    from = bounds[2 * k];
+    bounds[2 * k + 1] =
+        search_sorted(key, tree, key->data, from, (long)set->vals[k] + 1);
+    from = bounds[2 * k + 1];
+    res_size += bounds[2 * k + 1] - bounds[2 * k];
+  }
+
+  uint32_t* ids = proj->rows->ids;
+  uint32_t* pos = col->rows->pos;
+  int* output = malloc(sizeof(int) * (res_size + 1));
+  size_t n = 0;
+  for (size_t k = 0; k < set->num_vals; k++)
+    for (size_t i = bounds[2 * k]; i < bounds[2 * k + 1]; i++)
+      output[n++] = pos[ids[i]];
+  free(bounds);
+  cs165_log(stdout, "PROJECTION: %s -> %s values=%zu rows=%zu\n", col->name,
+            proj->name, set->num_vals, res_size);
+  return int_result(output, res_size);
+}
+
+/*=== Morsel-driven Select ===*/
+
+/**
+ * Large single selects are split into MORSEL_SIZE row ranges that worker
+ * threads claim one at a time from a shared counter, so a slow worker
+ * never holds up a fixed share of the column. Each worker appends its
+ * morsels' positions to a private buffer and records where each morsel
+ * landed; a prefix sum over the per-morsel counts then gives every morsel
+ * its offset in the final list, which keeps the output in position order.
+ * Bit vector output needs no stitching since morsels cover whole words.
+ * With a value set the morsels are matched against the IN list instead of
+ * [low, high].
+ **/
+
+typedef struct MorselScan {
+  Column* col;
+  size_t input_size;
+  int low;
+  int high;
+  const ValueSet* set;
+  ScanKernel kernel;
+  BitVector* bv;
+  size_t next_morsel;
+  size_t num_morsels;
+  size_t* morsel_counts;
+  size_t* morsel_offsets;
+  size_t* morsel_workers;
+} MorselScan;
+
+typedef struct MorselWorker {
+  MorselScan* scan;
+  size_t id;
+  int* output;
+  size_t size;
+  size_t capacity;
+} MorselWorker;
+
+static void morsel_task(void* args) {
+  MorselWorker* worker = (MorselWorker*)args;
+  MorselScan* scan = worker->scan;
+
+  size_t m;
+  while ((m = __sync_fetch_and_add(&scan->next_morsel, 1)) <
+         scan->num_morsels) {
+    size_t start = m * MORSEL_SIZE;
+    size_t length = scan->input_size - start < MORSEL_SIZE
+                        ? scan->input_size - start
+                        : MORSEL_SIZE;
+
+    if (scan->bv) {
+      uint64_t* words = scan->bv->words + start / 64;
+      scan->morsel_counts[m] =
+          scan->set ? scan_zones_in_bits(scan->col, start, start + length,
+                                         scan->set, words)
+                    : scan_zones_bits(scan->col, start, start + length,
+                                      scan->low, scan->high, words);
+      continue;
+    }
+
+    if (worker->size + length + SCAN_PADDING > worker->capacity) {
+      worker->capacity = 2 * worker->capacity + length + SCAN_PADDING;
+      worker->output = realloc(worker->output, sizeof(int) * worker->capacity);
     }
-    if (cur == node_high) break;
-    cur = cur->next;
+    int* output = worker->output + worker->size;
+    scan->morsel_counts[m] =
+        scan->set ? scan_zones_in(scan->col, start, start + length, scan->set,
+                                  output)
+                  : scan_zones(scan->col, start, start + length, scan->low,
+                               scan->high, scan->kernel, output);
+    scan->morsel_offsets[m] = worker->size;
+    scan->morsel_workers[m] = worker->id;
+    worker->size += scan->morsel_counts[m];
+  }
+}
+
+static Result* morsel_select(Column* col, int low, int high,
+                             const ValueSet* set, ScanKernel kernel,
+                             bool dense) {
+  MorselScan scan;
+  scan.col = col;
+  scan.input_size = col->size;
+  scan.low = low;
+  scan.high = high;
+  scan.set = set;
+  scan.kernel = kernel;
+  scan.bv = dense ? create_bitvector(col->size) : NULL;
+  scan.next_morsel = 0;
+  scan.num_morsels = (col->size + MORSEL_SIZE - 1) / MORSEL_SIZE;
+  scan.morsel_counts = calloc(sizeof(size_t), scan.num_morsels);
+  scan.morsel_offsets = calloc(sizeof(size_t), scan.num_morsels);
+  scan.morsel_workers = calloc(sizeof(size_t), scan.num_morsels);
+
+  size_t num_workers = parallel_degree(scan.num_morsels, 1);
+  MorselWorker workers[num_workers];
+  TaskGroup group;
+  task_group_init(&group);
+  for (size_t w = 0; w < num_workers; w++) {
+    workers[w].scan = &scan;
+    workers[w].id = w;
+    workers[w].output = NULL;
+    workers[w].size = 0;
+    workers[w].capacity = 0;
+    task_group_spawn(&group, morsel_task, (void*)(workers + w));
+  }
+  task_group_wait(&group);
+
+  size_t res_size = 0;
+  for (size_t m = 0; m < scan.num_morsels; m++) {
+    size_t count = scan.morsel_counts[m];
+    scan.morsel_counts[m] = res_size;
+    res_size += count;
+  }
+
+  Result* result;
+  if (dense) {
+    result = bitvector_result(scan.bv, res_size);
+  } else {
+    int* output = malloc(sizeof(int) * (res_size + 1));
+    for (size_t m = 0; m < scan.num_morsels; m++) {
+      size_t end = m + 1 < scan.num_morsels ? scan.morsel_counts[m + 1]
+                                            : res_size;
+      MorselWorker* worker = workers + scan.morsel_workers[m];
+      memcpy(output + scan.morsel_counts[m],
+             worker->output + scan.morsel_offsets[m],
+             sizeof(int) * (end - scan.morsel_counts[m]));
+    }
+    result = calloc(sizeof(Result), 1);
+    result->num_tuples = res_size;
+    result->data_type = INT;
+    result->payload = output;
+  }
+
+  for (size_t w = 0; w < num_workers; w++) free(workers[w].output);
+  free(scan.morsel_counts);
+  free(scan.morsel_offsets);
+  free(scan.morsel_workers);
+  return result;
+}
+
+/**
+ * Estimates the selectivity from the column's histogram (falling back to a
+ * sample when it was never analyzed) and picks the access path with the
+ * cost model, weighing the projection sorted on col too when projected.
+ **/
+static AccessPath plan_select(Column* col, int low, int high, bool projected,
+                              double* selectivity) {
+  *selectivity = col->stats.rows > 0
+                     ? estimate_range(&col->stats, low, high)
+                     : estimate_selectivity(col->data, col->size, low, high);
+  projected = projected && projection_of(col);
+  AccessPath path = choose_access_path(col, low, high, projected, *selectivity);
+  // The first select planned through a lazy index builds it.
+  if (path != FULL_SCAN && path != PROJECTION && !ensure_index(col))
+    path = FULL_SCAN;
+  return path;
+}
+
+// Answers [low, high] on col through a path chosen by plan_select.
+static Result* select_with_path(Column* col, int low, int high,
+                                AccessPath path, double selectivity) {
+  size_t input_size = col->size;
+
+  switch (path) {
+    case SORTED_SEARCH:
+      if (col->clustered) return select_slice(col, low, high);
+      return select_from_sorted(col, low, high);
+    case BTREE_WALK:
+      if (col->clustered) return select_slice(col, low, high);
+      return select_from_btree(col, low, high);
+    case BITMAP_OR:
+      return select_from_bitmap(col, low, high);
+    case CSS_SEARCH:
+      if (col->clustered) return select_slice(col, low, high);
+      return select_from_sorted(col, low, high);
+    case HASH_PROBE:
+      return select_from_hash(col, low, high);
+    case CRACK_SEARCH:
+      return select_from_cracked(col, low, high);
+    case PROJECTION:
+      return select_from_projection(projection_of(col), col, low, high);
+    case FULL_SCAN:
+      break;
   }
 
+  ScanKernel kernel = choose_scan_kernel(selectivity);
+  bool dense = selectivity >= BITVECTOR_SELECTIVITY;
+  const char* kernel_name =
+      col->byte_sliced ? "byteslice"
+                       : scan_kernel_name(dense ? PREDICATED : kernel);
+
+  if (input_size >= MORSEL_THRESHOLD) {
+    cs165_log(stdout, "SCAN: %s est=%.3f kernel=%s output=%s morsels=%zu\n",
+              col->name, selectivity, kernel_name,
+              dense ? "bitvector" : "positions",
+              (input_size + MORSEL_SIZE - 1) / MORSEL_SIZE);
+    return morsel_select(col, low, high, NULL, kernel, dense);
+  }
+
+  if (dense) {
+    cs165_log(stdout, "SCAN: %s est=%.3f kernel=%s output=bitvector\n",
+              col->name, selectivity, kernel_name);
+    BitVector* bv = create_bitvector(input_size);
+    size_t res_size =
+        scan_zones_bits(col, 0, input_size, low, high, bv->words);
+    return bitvector_result(bv, res_size);
+  }
+
+  cs165_log(stdout, "SCAN: %s est=%.3f kernel=%s output=positions\n",
+            col->name, selectivity, kernel_name);
+  int* output = malloc(sizeof(int) * (input_size + SCAN_PADDING));
+  size_t res_size =
+      scan_zones(col, 0, input_size, low, high, kernel, output);
+  output = realloc(output, sizeof(int) * (res_size + 1));
+
   Result* result = calloc(sizeof(Result), 1);
   result->num_tuples = res_size;
   result->data_type = INT;
@@ -83,53 +685,133 @@ Result* select_from_btree(Comparator* cmp) {
   return result;
 }
 
-Result* select_from_column(Comparator* cmp) {
-  Column* col = cmp->gen_col->column_pointer.column;
-  switch (col->index.type) {
-    case NONE:
+/**
+ * IN-list counterpart of plan_select and select_with_path: index paths
+ * search once per list value, scans match against the value set.
+ **/
+static Result* select_in_column(Column* col, const ValueSet* set) {
+  double selectivity = col->stats.rows > 0
+                           ? estimate_in_list(&col->stats, set)
+                           : estimate_in_selectivity(col->data, col->size, set);
+  AccessPath path =
+      choose_in_list_path(col, set, projection_of(col) != NULL, selectivity);
+  if (path != FULL_SCAN && path != PROJECTION && !ensure_index(col))
+    path = FULL_SCAN;
+  switch (path) {
+    case SORTED_SEARCH:
+      return select_in_sorted(col, set);
+    case BTREE_WALK:
+      return col->clustered ? select_in_sorted(col, set)
+                            : select_in_btree(col, set);
+    case BITMAP_OR:
+      return select_in_bitmap(col, set);
+    case CSS_SEARCH:
+      return select_in_sorted(col, set);
+    case HASH_PROBE:
+      return select_in_hash(col, set);
+    case CRACK_SEARCH:
+      return select_in_cracked(col, set);
+    case PROJECTION:
+      return select_in_projection(projection_of(col), col, set);
+    case FULL_SCAN:
       break;
-    case SORTED:
-      return select_from_sorted(cmp);
-    case BTREE:
-      return select_from_btree(cmp);
   }
 
-  int* input = col->data;
   size_t input_size = col->size;
+  bool dense = selectivity >= BITVECTOR_SELECTIVITY;
+  const char* kernel = set->slots ? "hash" : "broadcast";
 
-  int p_low = cmp->p_low;
-  int p_high = cmp->p_high;
-  int cmp_type = cmp->type1 + cmp->type2;
+  if (input_size >= MORSEL_THRESHOLD) {
+    cs165_log(stdout, "SCAN: %s est=%.3f kernel=%s output=%s morsels=%zu\n",
+              col->name, selectivity, kernel,
+              dense ? "bitvector" : "positions",
+              (input_size + MORSEL_SIZE - 1) / MORSEL_SIZE);
+    return morsel_select(col, 0, 0, set, PREDICATED, dense);
+  }
 
-  size_t res_size = 0;
-  size_t res_capacity = DEFAULT_CAPACITY;
-  int* output = malloc(sizeof(int) * res_capacity);
+  cs165_log(stdout, "SCAN: %s est=%.3f kernel=%s output=%s\n", col->name,
+            selectivity, kernel, dense ? "bitvector" : "positions");
+  if (dense) {
+    BitVector* bv = create_bitvector(input_size);
+    size_t res_size = scan_zones_in_bits(col, 0, input_size, set, bv->words);
+    return bitvector_result(bv, res_size);
+  }
 
-  switch (cmp_type) {
-    case LESS_THAN: {
-      for (size_t i = 0; i < input_size; i++) {
-        if (res_size >= res_capacity) resize_array(&output, &res_capacity);
-        if (input[i] < p_high) output[res_size++] = i;
-      }
-      break;
-    }
-    case GREATER_THAN_OR_EQUAL: {
-      for (size_t i = 0; i < input_size; i++) {
-        if (res_size >= res_capacity) resize_array(&output, &res_capacity);
-        if (input[i] >= p_low) output[res_size++] = i;
-      }
-      break;
-    }
-    case RANGE: {
-      for (size_t i = 0; i < input_size; i++) {
-        if (res_size >= res_capacity) resize_array(&output, &res_capacity);
-        if (input[i] >= p_low && input[i] < p_high) output[res_size++] = i;
-      }
-      break;
+  int* output = malloc(sizeof(int) * (input_size + 1));
+  size_t res_size = scan_zones_in(col, 0, input_size, set, output);
+  output = realloc(output, sizeof(int) * (res_size + 1));
+
+  Result* result = calloc(sizeof(Result), 1);
+  result->num_tuples = res_size;
+  result->data_type = INT;
+  result->payload = output;
+  return result;
+}
+
+Result* select_from_column(Comparator* cmp) {
+  Column* col = cmp->gen_col->column_pointer.column;
+
+  if (cmp->type1 == IN_LIST) {
+    ValueSet set;
+    init_value_set(&set, cmp->p_vals, cmp->num_vals);
+    Result* result = select_in_column(col, &set);
+    free_value_set(&set);
+    return result;
+  }
+
+  int low, high;
+  if (!comparator_bounds(cmp, &low, &high)) return NULL;
+
+  double selectivity;
+  AccessPath path = plan_select(col, low, high, true, &selectivity);
+  return select_with_path(col, low, high, path, selectivity);
+}
+
+/**
+ * Filters a bit vector of positions by the values fetched for them, kept
+ * when in [low, high] or, given a set, when members of it. The surviving
+ * bits of each word are collected into a mask and ANDed into the copy word
+ * by word.
+ **/
+static Result* select_from_bitvector(BitVector* ids, int* input, int low,
+                                     int high, const ValueSet* set) {
+  size_t words = BITVECTOR_WORDS(ids->length);
+  BitVector* bv = create_bitvector(ids->length);
+
+  size_t res_size = 0;
+  size_t j = 0;
+  for (size_t w = 0; w < words; w++) {
+    uint64_t bits = ids->words[w];
+    uint64_t keep = 0;
+    while (bits) {
+      uint64_t bit = bits & -bits;
+      int val = input[j++];
+      bool hit = set ? value_set_contains(set, val) : val >= low && val <= high;
+      keep |= hit ? bit : 0;
+      bits ^= bit;
     }
-    default:
-      return NULL;
+    bv->words[w] = ids->words[w] & keep;
+    res_size += __builtin_popcountll(bv->words[w]);
   }
+  return bitvector_result(bv, res_size);
+}
+
+static Result* select_in_result(Result* ids_res, int* input,
+                                const ValueSet* set) {
+  if (ids_res->data_type == BITVECTOR)
+    return select_from_bitvector((BitVector*)ids_res->payload, input, 0, 0,
+                                 set);
+
+  cs165_log(stdout, "SCAN: result kernel=%s output=positions\n",
+            set->slots ? "hash" : "broadcast");
+  int* output = malloc(sizeof(int) * (ids_res->num_tuples + 1));
+  size_t res_size =
+      ids_res->data_type == SLICE
+          ? scan_in(input, ids_res->num_tuples, set,
+                    ((Slice*)ids_res->payload)->start, output)
+          : scan_in_ids(input, (int*)ids_res->payload, ids_res->num_tuples,
+                        set, output);
+  output = realloc(output, sizeof(int) * (res_size + 1));
 
   Result* result = calloc(sizeof(Result), 1);
   result->num_tuples = res_size;
@@ -143,38 +825,45 @@ Result* select_from_result(Comparator* cmp) {
   size_t input_size = cmp->gen_col->column_pointer.result->num_tuples;
   if (input_size != input_id_size) return NULL;
 
-  int p_low = cmp->p_low;
-  int p_high = cmp->p_high;
-  int cmp_type = cmp->type1 + cmp->type2;
-
-  int* input_id = (int*)cmp->gen_col_id->column_pointer.result->payload;
+  Result* ids_res = cmp->gen_col_id->column_pointer.result;
   int* input = (int*)cmp->gen_col->column_pointer.result->payload;
-  int* output = malloc(sizeof(int) * input_id_size);
-  size_t res_size = 0;
+  if (cmp->type1 == IN_LIST) {
+    ValueSet set;
+    init_value_set(&set, cmp->p_vals, cmp->num_vals);
+    Result* result = select_in_result(ids_res, input, &set);
+    free_value_set(&set);
+    return result;
+  }
 
-  switch (cmp_type) {
-    case LESS_THAN: {
-      for (size_t i = 0; i < input_id_size; i++) {
-        if (input[i] < p_high) output[res_size++] = input_id[i];
-      }
-      break;
-    }
-    case GREATER_THAN_OR_EQUAL: {
-      for (size_t i = 0; i < input_id_size; i++) {
-        if (input[i] >= p_low) output[res_size++] = input_id[i];
-      }
-      break;
-    }
-    case RANGE: {
-      for (size_t i = 0; i < input_id_size; i++) {
-        if (input[i] >= p_low && input[i] < p_high)
-          output[res_size++] = input_id[i];
-      }
-      break;
-    }
-    default:
-      return NULL;
+  int low, high;
+  if (!comparator_bounds(cmp, &low, &high)) return NULL;
+  if (ids_res->data_type == BITVECTOR)
+    return select_from_bitvector((BitVector*)ids_res->payload, input, low,
+                                 high, NULL);
+
+  double selectivity = estimate_selectivity(input, input_size, low, high);
+  ScanKernel kernel = choose_scan_kernel(selectivity);
+  cs165_log(stdout, "SCAN: result est=%.3f kernel=%s output=positions\n",
+            selectivity, scan_kernel_name(kernel));
+
+  int* output = malloc(sizeof(int) * (input_id_size + SCAN_PADDING));
+  size_t res_size = 0;
+  if (ids_res->data_type == SLICE) {
+    // The ids of a slice are implicit: base + i for the i-th value.
+    size_t base = ((Slice*)ids_res->payload)->start;
+    res_size = kernel == BRANCHING
+                   ? scan_range_branching(input, input_size, low, high, base,
+                                          output)
+                   : scan_range(input, input_size, low, high, base, output);
+  } else {
+    int* input_id = (int*)ids_res->payload;
+    res_size = kernel == BRANCHING
+                   ? scan_range_ids_branching(input, input_id, input_id_size,
+                                              low, high, output)
+                   : scan_range_ids(input, input_id, input_id_size, low,
+                                    high, output);
   }
+  output = realloc(output, sizeof(int) * (res_size + 1));
 
   Result* result = calloc(sizeof(Result), 1);
   result->num_tuples = res_size;
@@ -197,36 +886,998 @@ Result* single_select(Comparator* cmp) {
     default:
       break;
   }
-  free(cmp->gen_col);
-  if (cmp->gen_col_id) free(cmp->gen_col_id);
-  free(cmp);
+  free_comparator(cmp);
   return res;
 }
 
+/*=== Select Fetch ===*/
+
+/**
+ * select_fetch answers select(col) followed by fetch(vals_col) without
+ * materializing the whole position list in between: every
+ * SHARED_SCAN_CHUNK of col is scanned into a chunk-sized position buffer
+ * that stays in L1, and the matching vals_col values are gathered from it
+ * straight away. Large columns are split into chunk-aligned ranges that
+ * run as pool tasks and are concatenated in range order.
+ **/
+
+typedef struct FusedScan {
+  Column* col;
+  Column* vals_col;
+  int low;
+  int high;
+  ScanKernel kernel;
+  bool keep_positions;
+  double selectivity;
+} FusedScan;
+
+typedef struct FusedScanTask {
+  FusedScan* scan;
+  size_t start;
+  size_t end;
+  int* positions;
+  int* values;
+  size_t size;
+  size_t capacity;
+} FusedScanTask;
+
+static void fused_scan_task(void* args) {
+  FusedScanTask* task = (FusedScanTask*)args;
+  FusedScan* scan = task->scan;
+  int* vals = scan->vals_col->data;
+  int chunk_positions[SHARED_SCAN_CHUNK + SCAN_PADDING];
+
+  for (size_t chunk = task->start; chunk < task->end;
+       chunk += SHARED_SCAN_CHUNK) {
+    size_t end = task->end - chunk < SHARED_SCAN_CHUNK
+                     ? task->end
+                     : chunk + SHARED_SCAN_CHUNK;
+    size_t n = scan_zones(scan->col, chunk, end, scan->low, scan->high,
+                          scan->kernel, chunk_positions);
+    if (task->size + n > task->capacity) {
+      task->capacity = 2 * task->capacity + n;
+      task->values = realloc(task->values, sizeof(int) * task->capacity);
+      if (scan->keep_positions)
+        task->positions =
+            realloc(task->positions, sizeof(int) * task->capacity);
+    }
+    for (size_t i = 0; i < n; i++)
+      task->values[task->size + i] = vals[chunk_positions[i]];
+    if (scan->keep_positions)
+      memcpy(task->positions + task->size, chunk_positions, sizeof(int) * n);
+    task->size += n;
+  }
+}
+
+static void fused_scan(FusedScan* scan, Result** positions, Result** values) {
+  size_t input_size = scan->col->size;
+  size_t num_chunks = (input_size + SHARED_SCAN_CHUNK - 1) / SHARED_SCAN_CHUNK;
+  size_t num_tasks =
+      parallel_degree(num_chunks, MORSEL_SIZE / SHARED_SCAN_CHUNK);
+  size_t chunks_per_task = (num_chunks + num_tasks - 1) / num_tasks;
+
+  FusedScanTask task[num_tasks];
+  TaskGroup group;
+  task_group_init(&group);
+  for (size_t t = 0; t < num_tasks; t++) {
+    size_t start = t * chunks_per_task * SHARED_SCAN_CHUNK;
+    size_t end = start + chunks_per_task * SHARED_SCAN_CHUNK;
+    task[t].scan = scan;
+    task[t].start = start < input_size ? start : input_size;
+    task[t].end = end < input_size ? end : input_size;
+    // Sized for the estimated matches so that most tasks never regrow.
+    task[t].capacity = scan->selectivity * 1.1 * (task[t].end - task[t].start);
+    task[t].values = malloc(sizeof(int) * (task[t].capacity + 1));
+    task[t].positions = scan->keep_positions
+                            ? malloc(sizeof(int) * (task[t].capacity + 1))
+                            : NULL;
+    task[t].size = 0;
+    task_group_spawn(&group, fused_scan_task, (void*)(task + t));
+  }
+  task_group_wait(&group);
+
+  if (num_tasks == 1) {
+    *values = int_result(task[0].values, task[0].size);
+    if (positions) *positions = int_result(task[0].positions, task[0].size);
+    return;
+  }
+
+  size_t res_size = 0;
+  for (size_t t = 0; t < num_tasks; t++) res_size += task[t].size;
+  int* output_vals = malloc(sizeof(int) * (res_size + 1));
+  int* output_pos =
+      scan->keep_positions ? malloc(sizeof(int) * (res_size + 1)) : NULL;
+
+  size_t offset = 0;
+  for (size_t t = 0; t < num_tasks; t++) {
+    memcpy(output_vals + offset, task[t].values, sizeof(int) * task[t].size);
+    if (output_pos)
+      memcpy(output_pos + offset, task[t].positions,
+             sizeof(int) * task[t].size);
+    offset += task[t].size;
+    free(task[t].values);
+    free(task[t].positions);
+  }
+
+  *values = int_result(output_vals, res_size);
+  if (positions) *positions = int_result(output_pos, res_size);
+}
+
+/**
+ * Selects from the column of cmp and fetches vals_col at the qualifying
+ * positions. The positions are only kept when positions is not NULL.
+ * Columns the cost model sends to an index or to the projection sorted on
+ * them select through it first and gather from the resulting position
+ * list (or copy from the projection when it holds vals_col).
+ **/
+void select_fetch(Comparator* cmp, Column* vals_col, Result** positions,
+                  Result** values) {
+  Column* col = cmp->gen_col->column_pointer.column;
+  *values = NULL;
+  if (positions) *positions = NULL;
+
+  int low, high;
+  bool supported = comparator_bounds(cmp, &low, &high);
+  free_comparator(cmp);
+  if (!supported) return;
+
+  Result* pos = NULL;
+  double selectivity = 0;
+  AccessPath path = plan_select(col, low, high, true, &selectivity);
+  if (path != FULL_SCAN)
+    pos = select_with_path(col, low, high, path, selectivity);
+  if (pos) {
+    int* output = malloc(sizeof(int) * (pos->num_tuples + 1));
+    Column* proj_vals = lookup_projection_column(pos, vals_col);
+    if (proj_vals) {
+      memcpy(output, proj_vals->data + pos->proj_start,
+             sizeof(int) * pos->num_tuples);
+    } else if (pos->data_type == SLICE) {
+      memcpy(output, vals_col->data + ((Slice*)pos->payload)->start,
+             sizeof(int) * pos->num_tuples);
+    } else {
+      int* ids = materialize_positions(pos);
+      for (size_t i = 0; i < pos->num_tuples; i++)
+        output[i] = vals_col->data[ids[i]];
+      release_positions(pos, ids);
+    }
+    *values = int_result(output, pos->num_tuples);
+    (*values)->source = vals_col;
+    (*values)->whole_source = all_positions(pos, vals_col->size);
+    (*values)->source_writes = vals_col->writes;
+    if (positions)
+      *positions = pos;
+    else
+      free_result(pos);
+    return;
+  }
+
+  FusedScan scan = {col,  vals_col, low, high, choose_scan_kernel(selectivity),
+                    positions != NULL, selectivity};
+  cs165_log(stdout, "SELECT FETCH: %s -> %s est=%.3f kernel=%s\n", col->name,
+            vals_col->name, selectivity, scan_kernel_name(scan.kernel));
+  fused_scan(&scan, positions, values);
+  if (*values) {
+    // The scan keeps positions in order, so all of them is the whole column.
+    (*values)->source = vals_col;
+    (*values)->whole_source = (*values)->num_tuples == vals_col->size;
+    (*values)->source_writes = vals_col->writes;
+  }
+}
+
+/*=== Conjunctive Select ===*/
+
+/**
+ * conjunctive_select answers a conjunction of range predicates on columns
+ * of one table. Predicates run from the most to the least selective
+ * estimate: the first through its own access path, the others only over
+ * the positions that survived so far.
+ *
+ * | Survivors           | Next predicate                                 |
+ * | ------------------- | ---------------------------------------------- |
+ * | position list       | gathers and compares each survivor in place    |
+ * | bit vector          | scans the zones holding survivors, ANDs words  |
+ * | slice               | scans its range of the next column             |
+ * | any, indexed column | through the index when it yields fewer         |
+ * |                     | candidates than there are survivors            |
+ **/
+
+typedef struct Predicate {
+  Column* col;
+  int low;
+  int high;
+  double selectivity;
+  AccessPath path;
+} Predicate;
+
+static int compare_predicates(const void* a, const void* b) {
+  double x = ((const Predicate*)a)->selectivity;
+  double y = ((const Predicate*)b)->selectivity;
+  return (x > y) - (x < y);
+}
+
+static int compare_positions(const void* a, const void* b) {
+  return *(const int*)a - *(const int*)b;
+}
+
+static BitVector* positions_to_bitvector(int* positions, size_t num,
+                                         size_t length) {
+  BitVector* bv = create_bitvector(length);
+  for (size_t i = 0; i < num; i++)
+    bv->words[positions[i] / 64] |= UINT64_C(1) << (positions[i] % 64);
+  return bv;
+}
+
+// Keeps the positions whose value lies in [low, high], in place.
+static size_t filter_positions(int* positions, size_t num, int* data, int low,
+                               int high) {
+  size_t res_size = 0;
+  for (size_t i = 0; i < num; i++) {
+    int pos = positions[i];
+    positions[res_size] = pos;
+    res_size += data[pos] >= low && data[pos] <= high;
+  }
+  return res_size;
+}
+
+// ANDs the bit vector of [low, high] on col into bv, one zone at a time,
+// skipping zones without survivors.
+static size_t filter_bitvector(BitVector* bv, Column* col, int low, int high) {
+  uint64_t words[ZONE_SIZE / 64];
+  size_t res_size = 0;
+  for (size_t start = 0; start < bv->length; start += ZONE_SIZE) {
+    size_t end =
+        bv->length - start < ZONE_SIZE ? bv->length : start + ZONE_SIZE;
+    uint64_t* zone_words = bv->words + start / 64;
+    size_t num_words = (end - start + 63) / 64;
+
+    uint64_t any = 0;
+    for (size_t w = 0; w < num_words; w++) any |= zone_words[w];
+    if (!any) continue;
+
+    scan_zones_bits(col, start, end, low, high, words);
+    for (size_t w = 0; w < num_words; w++) {
+      zone_words[w] &= words[w];
+      res_size += __builtin_popcountll(zone_words[w]);
+    }
+  }
+  return res_size;
+}
+
+// Positions of a slice whose value on col lies in [low, high].
+static Result* filter_slice(Result* slice_res, Column* col, int low,
+                            int high) {
+  Slice* slice = (Slice*)slice_res->payload;
+  int* output = malloc(sizeof(int) * (slice_res->num_tuples + SCAN_PADDING));
+  size_t res_size = scan_range(col->data + slice->start, slice_res->num_tuples,
+                               low, high, slice->start, output);
+  return int_result(realloc(output, sizeof(int) * (res_size + 1)), res_size);
+}
+
+Result* conjunctive_select(Comparator** comparators, size_t num) {
+  Predicate preds[num];
+  size_t num_preds = 0;
+  bool supported = true;
+  for (size_t i = 0; i < num; i++) {
+    Predicate* pred = preds + num_preds++;
+    pred->col = comparators[i]->gen_col->column_pointer.column;
+    supported &= comparator_bounds(comparators[i], &pred->low, &pred->high);
+    free_comparator(comparators[i]);
+    if (supported)
+      pred->path = plan_select(pred->col, pred->low, pred->high, false,
+                               &pred->selectivity);
+  }
+  if (!supported || num_preds == 0) return NULL;
+  qsort(preds, num_preds, sizeof(Predicate), compare_predicates);
+
+  size_t length = preds[0].col->size;
+  Result* result = select_with_path(preds[0].col, preds[0].low, preds[0].high,
+                                    preds[0].path, preds[0].selectivity);
+  // Unclustered indexes answer in value order, a hash index in row id
+  // order within a value and a cracked one in piece order; later steps and
+  // the caller expect position order.
+  if (result->data_type == INT &&
+      (preds[0].path == HASH_PROBE || preds[0].path == CRACK_SEARCH ||
+       ((preds[0].path == SORTED_SEARCH || preds[0].path == BTREE_WALK ||
+         preds[0].path == CSS_SEARCH) &&
+        !preds[0].col->clustered)))
+    qsort(result->payload, result->num_tuples, sizeof(int), compare_positions);
+
+  for (size_t p = 1; p < num_preds && result->num_tuples > 0; p++) {
+    Predicate* pred = preds + p;
+    const char* method;
+    if (pred->path != FULL_SCAN &&
+        pred->selectivity * length < result->num_tuples) {
+      method = access_path_name(pred->path);
+      Result* candidates = select_with_path(pred->col, pred->low, pred->high,
+                                            pred->path, pred->selectivity);
+      int* ids = materialize_positions(candidates);
+      BitVector* mask =
+          positions_to_bitvector(ids, candidates->num_tuples, length);
+      release_positions(candidates, ids);
+      free_result(candidates);
+
+      if (result->data_type == SLICE) {
+        Result* positions = int_result(materialize_positions(result),
+                                       result->num_tuples);
+        free_result(result);
+        result = positions;
+      }
+
+      if (result->data_type == INT) {
+        int* positions = (int*)result->payload;
+        size_t res_size = 0;
+        for (size_t i = 0; i < result->num_tuples; i++) {
+          int pos = positions[i];
+          positions[res_size] = pos;
+          res_size += (mask->words[pos / 64] >> (pos % 64)) & 1;
+        }
+        result->num_tuples = res_size;
+      } else {
+        BitVector* bv = (BitVector*)result->payload;
+        size_t res_size = 0;
+        for (size_t w = 0; w < BITVECTOR_WORDS(length); w++) {
+          bv->words[w] &= mask->words[w];
+          res_size += __builtin_popcountll(bv->words[w]);
+        }
+        result->num_tuples = res_size;
+      }
+      free(mask);
+    } else if (result->data_type == SLICE) {
+      method = "slice";
+      Result* survivors =
+          filter_slice(result, pred->col, pred->low, pred->high);
+      free_result(result);
+      result = survivors;
+    } else if (result->data_type == INT) {
+      method = "positions";
+      result->num_tuples =
+          filter_positions((int*)result->payload, result->num_tuples,
+                           pred->col->data, pred->low, pred->high);
+    } else {
+      method = "bitvector";
+      result->num_tuples = filter_bitvector((BitVector*)result->payload,
+                                            pred->col, pred->low, pred->high);
+    }
+    cs165_log(stdout, "CONJUNCTION: %s est=%.3f via=%s survivors=%zu\n",
+              pred->col->name, pred->selectivity, method, result->num_tuples);
+  }
+  return result;
+}
+
 /*=== Shared Scan ===*/
 
-static size_t jobs;
-static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+/**
+ * A shared scan answers every batched select planned as a scan of one
+ * column in a single pass. The column is split into contiguous row ranges,
+ * one per thread, and each thread walks its range in SHARED_SCAN_CHUNK
+ * sized chunks, running every query's kernel over a chunk while it is
+ * still in L1 before moving on to the next one.
+ *
+ * Past SHARED_SCAN_INTERVALS queries, one kernel pass per query costs more
+ * than matching every value once: the query bounds cut the values into
+ * elementary intervals, each covered by a fixed set of queries, and a
+ * binary search over the bounds finds the interval of a value. A zone
+ * whose [min, max] lies in one interval goes to its queries whole.
+ *
+ * Dense queries write straight into a shared bit vector (thread ranges are
+ * chunk aligned, so threads never touch the same word); the others collect
+ * positions in per-thread buffers that are concatenated in range order.
+ **/
+
+typedef struct BatchQuery {
+  size_t id;
+  Column* col;
+  int low;
+  int high;
+  double selectivity;
+  AccessPath path;
+} BatchQuery;
+
+/**
+ * Interval s holds the values v with bounds[s - 1] <= v < bounds[s] (no
+ * lower limit for s = 0, no upper one for s = num_bounds) and is covered
+ * by queries[offsets[s]] .. queries[offsets[s + 1] - 1].
+ **/
+typedef struct Intervals {
+  long* bounds;
+  size_t num_bounds;
+  size_t* offsets;
+  size_t* queries;
+} Intervals;
+
+typedef struct SharedScan {
+  Column* col;
+  BatchQuery* queries;
+  size_t num_queries;
+  BitVector** bitvectors;
+  Intervals* intervals;
+} SharedScan;
+
+typedef struct SharedScanTask {
+  SharedScan* scan;
+  size_t start;
+  size_t end;
+  int** outputs;
+  size_t* sizes;
+  size_t* capacities;
+} SharedScanTask;
+
+static int compare_longs(const void* a, const void* b) {
+  long x = *(const long*)a;
+  long y = *(const long*)b;
+  return (x > y) - (x < y);
+}
+
+// Number of bounds <= val, which is the interval holding val.
+static size_t find_interval(const long* bounds, size_t num_bounds, long val) {
+  size_t low = 0;
+  size_t high = num_bounds;
+  while (low < high) {
+    size_t mid = low + (high - low) / 2;
+    if (bounds[mid] <= val)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  return low;
+}
+
+/**
+ * find_interval for INTERVAL_LANES values at once. Each step of a binary
+ * search waits on the load of the step before; running the lanes' searches
+ * in lockstep, with conditional moves instead of branches, keeps that many
+ * loads in flight.
+ **/
+static void find_intervals(const long* bounds, size_t num_bounds,
+                           const int* vals, size_t* intervals) {
+  size_t base[INTERVAL_LANES] = {0};
+  for (size_t length = num_bounds; length > 1; length -= length / 2) {
+    size_t half = length / 2;
+    for (size_t l = 0; l < INTERVAL_LANES; l++)
+      base[l] += bounds[base[l] + half - 1] <= vals[l] ? half : 0;
+  }
+  for (size_t l = 0; l < INTERVAL_LANES; l++)
+    intervals[l] = base[l] + (bounds[base[l]] <= vals[l]);
+}
+
+static void build_intervals(Intervals* iv, BatchQuery* queries, size_t num) {
+  iv->bounds = malloc(sizeof(long) * 2 * num);
+  for (size_t q = 0; q < num; q++) {
+    iv->bounds[2 * q] = queries[q].low;
+    iv->bounds[2 * q + 1] = (long)queries[q].high + 1;
+  }
+  qsort(iv->bounds, 2 * num, sizeof(long), compare_longs);
+  size_t n = 1;
+  for (size_t i = 1; i < 2 * num; i++)
+    if (iv->bounds[i] != iv->bounds[n - 1]) iv->bounds[n++] = iv->bounds[i];
+  iv->num_bounds = n;
+
+  // Query q covers the intervals from the one starting at its low up to
+  // the one ending at its high + 1.
+  size_t* first = malloc(sizeof(size_t) * num);
+  size_t* last = malloc(sizeof(size_t) * num);
+  iv->offsets = calloc(sizeof(size_t), n + 2);
+  for (size_t q = 0; q < num; q++) {
+    first[q] = find_interval(iv->bounds, n, queries[q].low);
+    last[q] = find_interval(iv->bounds, n, queries[q].high);
+    for (size_t s = first[q]; s <= last[q] && queries[q].low <= queries[q].high;
+         s++)
+      iv->offsets[s + 1]++;
+  }
+  for (size_t s = 0; s <= n; s++) iv->offsets[s + 1] += iv->offsets[s];
+
+  iv->queries = malloc(sizeof(size_t) * (iv->offsets[n + 1] + 1));
+  size_t* fill = calloc(sizeof(size_t), n + 1);
+  for (size_t q = 0; q < num; q++)
+    for (size_t s = first[q]; s <= last[q] && queries[q].low <= queries[q].high;
+         s++)
+      iv->queries[iv->offsets[s] + fill[s]++] = q;
+  free(fill);
+  free(first);
+  free(last);
+}
+
+static void free_intervals(Intervals* iv) {
+  free(iv->bounds);
+  free(iv->offsets);
+  free(iv->queries);
+}
+
+// Hands every position in [start, end) to query q.
+static void shared_scan_accept(SharedScan* scan, SharedScanTask* task,
+                               size_t q, size_t start, size_t end) {
+  if (scan->bitvectors[q]) {
+    uint64_t* words = scan->bitvectors[q]->words;
+    for (size_t pos = start; pos < end; pos++)
+      words[pos / 64] |= UINT64_C(1) << (pos % 64);
+  } else {
+    int* output = task->outputs[q] + task->sizes[q];
+    for (size_t pos = start; pos < end; pos++) output[pos - start] = pos;
+  }
+  task->sizes[q] += end - start;
+}
+
+static void shared_scan_intervals(SharedScan* scan, SharedScanTask* task,
+                                  size_t chunk, size_t length) {
+  Intervals* iv = scan->intervals;
+  ZoneMap* zones = &scan->col->zones;
+  int* data = scan->col->data;
+
+  for (size_t start = chunk; start < chunk + length; start += ZONE_SIZE) {
+    size_t end = chunk + length - start < ZONE_SIZE ? chunk + length
+                                                    : start + ZONE_SIZE;
+    size_t z = start / ZONE_SIZE;
+    size_t s = find_interval(iv->bounds, iv->num_bounds, zones->mins[z]);
+    if (s == find_interval(iv->bounds, iv->num_bounds, zones->maxs[z])) {
+      for (size_t k = iv->offsets[s]; k < iv->offsets[s + 1]; k++)
+        shared_scan_accept(scan, task, iv->queries[k], start, end);
+      continue;
+    }
+
+    size_t intervals[INTERVAL_LANES];
+    for (size_t pos = start; pos < end; pos++) {
+      size_t lane = (pos - start) % INTERVAL_LANES;
+      if (lane == 0) {
+        if (end - pos >= INTERVAL_LANES) {
+          find_intervals(iv->bounds, iv->num_bounds, data + pos, intervals);
+        } else {
+          for (size_t l = 0; l < end - pos; l++)
+            intervals[l] =
+                find_interval(iv->bounds, iv->num_bounds, data[pos + l]);
+        }
+      }
+      s = intervals[lane];
+      for (size_t k = iv->offsets[s]; k < iv->offsets[s + 1]; k++) {
+        size_t q = iv->queries[k];
+        if (scan->bitvectors[q])
+          scan->bitvectors[q]->words[pos / 64] |= UINT64_C(1) << (pos % 64);
+        else
+          task->outputs[q][task->sizes[q]] = pos;
+        task->sizes[q]++;
+      }
+    }
+  }
+}
+
+static void shared_scan_task(void* args) {
+  SharedScanTask* task = (SharedScanTask*)args;
+  SharedScan* scan = task->scan;
+
+  for (size_t chunk = task->start; chunk < task->end;
+       chunk += SHARED_SCAN_CHUNK) {
+    size_t length = task->end - chunk < SHARED_SCAN_CHUNK ? task->end - chunk
+                                                          : SHARED_SCAN_CHUNK;
+    for (size_t q = 0; q < scan->num_queries; q++) {
+      if (scan->bitvectors[q] ||
+          task->sizes[q] + length + SCAN_PADDING <= task->capacities[q])
+        continue;
+      task->capacities[q] = 2 * task->capacities[q] + length + SCAN_PADDING;
+      task->outputs[q] =
+          realloc(task->outputs[q], sizeof(int) * task->capacities[q]);
+    }
+
+    if (scan->intervals) {
+      shared_scan_intervals(scan, task, chunk, length);
+      continue;
+    }
+
+    for (size_t q = 0; q < scan->num_queries; q++) {
+      BatchQuery* query = scan->queries + q;
+      if (scan->bitvectors[q])
+        task->sizes[q] += scan_zones_bits(
+            scan->col, chunk, chunk + length, query->low, query->high,
+            scan->bitvectors[q]->words + chunk / 64);
+      else
+        task->sizes[q] += scan_zones(scan->col, chunk, chunk + length,
+                                     query->low, query->high, PREDICATED,
+                                     task->outputs[q] + task->sizes[q]);
+    }
+  }
+}
+
+static void run_shared_scan(BatchQuery* queries, size_t num_queries,
+                            Result** results) {
+  SharedScan scan;
+  scan.col = queries[0].col;
+  scan.queries = queries;
+  scan.num_queries = num_queries;
+  scan.bitvectors = malloc(sizeof(BitVector*) * num_queries);
+  scan.intervals = NULL;
+
+  Intervals intervals;
+  if (num_queries > SHARED_SCAN_INTERVALS) {
+    build_intervals(&intervals, queries, num_queries);
+    scan.intervals = &intervals;
+  }
 
-void* select_task(void* args) {
-  BatchSelect* batch = (BatchSelect*)args;
-  pthread_mutex_lock(&lock);
-  while (jobs) {
-    size_t idx = --jobs;
-    pthread_mutex_unlock(&lock);
-    batch->results[idx] = single_select(batch->comparators[idx]);
-    pthread_mutex_lock(&lock);
+  size_t input_size = scan.col->size;
+  size_t num_chunks = (input_size + SHARED_SCAN_CHUNK - 1) / SHARED_SCAN_CHUNK;
+  size_t num_threads = parallel_degree(num_chunks, 1);
+
+  for (size_t q = 0; q < num_queries; q++)
+    scan.bitvectors[q] = queries[q].selectivity >= BITVECTOR_SELECTIVITY
+                             ? create_bitvector(input_size)
+                             : NULL;
+  cs165_log(stdout, "SHARED SCAN: %s queries=%zu threads=%zu kernel=%s\n",
+            scan.col->name, num_queries, num_threads,
+            scan.intervals ? "intervals" : scan_kernel_name(PREDICATED));
+
+  SharedScanTask task[num_threads];
+  TaskGroup group;
+  task_group_init(&group);
+  size_t chunks_per_thread = num_chunks / num_threads;
+  size_t extra_chunks = num_chunks % num_threads;
+  size_t start = 0;
+
+  for (size_t t = 0; t < num_threads; t++) {
+    size_t chunks = chunks_per_thread + (t < extra_chunks ? 1 : 0);
+    size_t end = start + chunks * SHARED_SCAN_CHUNK;
+    task[t].scan = &scan;
+    task[t].start = start;
+    task[t].end = end < input_size ? end : input_size;
+    task[t].outputs = calloc(sizeof(int*), num_queries);
+    task[t].sizes = calloc(sizeof(size_t), num_queries);
+    task[t].capacities = calloc(sizeof(size_t), num_queries);
+    start = end;
+    task_group_spawn(&group, shared_scan_task, (void*)(task + t));
   }
-  pthread_mutex_unlock(&lock);
-  return NULL;
+  task_group_wait(&group);
+
+  for (size_t q = 0; q < num_queries; q++) {
+    size_t res_size = 0;
+    for (size_t t = 0; t < num_threads; t++) res_size += task[t].sizes[q];
+
+    if (scan.bitvectors[q]) {
+      results[queries[q].id] = bitvector_result(scan.bitvectors[q], res_size);
+      continue;
+    }
+
+    int* output = malloc(sizeof(int) * (res_size + 1));
+    size_t offset = 0;
+    for (size_t t = 0; t < num_threads; t++) {
+      memcpy(output + offset, task[t].outputs[q],
+             sizeof(int) * task[t].sizes[q]);
+      offset += task[t].sizes[q];
+    }
+    results[queries[q].id] = int_result(output, res_size);
+  }
+
+  for (size_t t = 0; t < num_threads; t++) {
+    for (size_t q = 0; q < num_queries; q++) free(task[t].outputs[q]);
+    free(task[t].outputs);
+    free(task[t].sizes);
+    free(task[t].capacities);
+  }
+  if (scan.intervals) free_intervals(&intervals);
+  free(scan.bitvectors);
+}
+
+/*=== Shared Index Pass ===*/
+
+/**
+ * Batched ranges on one indexed column share a single ordered pass over
+ * the index. On a sorted copy (or a clustered column) the bounds of all
+ * ranges are searched in ascending order, each search starting where the
+ * previous one ended. On a B-tree the ranges, sorted by low, are merged
+ * into runs of overlapping ranges; a run costs one descent and one leaf
+ * walk that hands every entry to the ranges of the run holding it, so
+ * contained and overlapping ranges never walk the same leaves twice. On a
+ * bitmap or hash index there is nothing to share: every range ORs its own
+ * bitmaps or probes its own values.
+ **/
+
+typedef struct IndexPass {
+  BatchQuery* queries;
+  size_t num_queries;
+  Result** results;
+} IndexPass;
+
+typedef struct BatchBound {
+  long val;
+  size_t idx;
+} BatchBound;
+
+static int compare_batch_bounds(const void* a, const void* b) {
+  long x = ((const BatchBound*)a)->val;
+  long y = ((const BatchBound*)b)->val;
+  return (x > y) - (x < y);
+}
+
+static void sorted_pass(IndexPass* pass) {
+  Column* col = pass->queries[0].col;
+  int* input = col->data;
+  size_t* ids = NULL;
+  if (!col->clustered) {
+    SortedIndex* payload = (SortedIndex*)(col->index.payload);
+    input = payload->vals;
+    ids = payload->pos;
+  }
+
+  size_t num_bounds = 2 * pass->num_queries;
+  BatchBound* bounds = malloc(sizeof(BatchBound) * num_bounds);
+  for (size_t q = 0; q < pass->num_queries; q++) {
+    bounds[2 * q].val = pass->queries[q].low;
+    bounds[2 * q].idx = 2 * q;
+    bounds[2 * q + 1].val = (long)pass->queries[q].high + 1;
+    bounds[2 * q + 1].idx = 2 * q + 1;
+  }
+  qsort(bounds, num_bounds, sizeof(BatchBound), compare_batch_bounds);
+
+  CssTree* tree = css_tree_of(col);
+  size_t* found = malloc(sizeof(size_t) * num_bounds);
+  size_t from = 0;
+  for (size_t b = 0; b < num_bounds; b++) {
+    from = search_sorted(col, tree, input, from, bounds[b].val);
+    found[bounds[b].idx] = from;
+  }
+
+  for (size_t q = 0; q < pass->num_queries; q++) {
+    size_t start = found[2 * q];
+    size_t end = found[2 * q + 1] > start ? found[2 * q + 1] : start;
+    Result* result;
+    if (col->clustered) {
+      result = slice_result(start, end);
+    } else {
+      int* output = malloc(sizeof(int) * (end - start + 1));
+      for (size_t i = start; i < end; i++)
+        output[i - start] = col->rows->pos[ids[i]];
+      result = int_result(output, end - start);
+    }
+    pass->results[pass->queries[q].id] = result;
+  }
+  cs165_log(stdout, "SHARED INDEX: %s queries=%zu searches=%zu\n", col->name,
+            pass->num_queries, num_bounds);
+  free(bounds);
+  free(found);
+}
+
+static void btree_pass(IndexPass* pass) {
+  Column* col = pass->queries[0].col;
+  BTree* tree = (BTree*)(col->index.payload);
+  BatchQuery* queries = pass->queries;
+  size_t num = pass->num_queries;
+
+  int** outputs = malloc(sizeof(int*) * num);
+  size_t* sizes = calloc(sizeof(size_t), num);
+  size_t* capacities = malloc(sizeof(size_t) * num);
+  for (size_t q = 0; q < num; q++) {
+    capacities[q] = DEFAULT_CAPACITY;
+    outputs[q] = malloc(sizeof(int) * capacities[q]);
+  }
+
+  size_t descents = 0;
+  for (size_t run = 0, run_end; run < num; run = run_end) {
+    long run_high = queries[run].high;
+    for (run_end = run + 1;
+         run_end < num && queries[run_end].low <= run_high + 1; run_end++)
+      if (queries[run_end].high > run_high) run_high = queries[run_end].high;
+    if (queries[run].low > run_high) continue;
+
+    descents++;
+    size_t i;
+    for (BTreeLeaf* cur = btree_search(tree, queries[run].low, &i); cur;
+         cur = btree_next_leaf(tree, cur), i = 0) {
+      size_t length = cur->header.length;
+      for (; i < length && cur->vals[i] <= run_high; i++) {
+        int val = cur->vals[i];
+        for (size_t q = run; q < run_end && queries[q].low <= val; q++) {
+          if (val > queries[q].high) continue;
+          if (sizes[q] >= capacities[q])
+            resize_array(outputs + q, capacities + q);
+          outputs[q][sizes[q]++] = col->rows->pos[cur->idxs[i]];
+        }
+      }
+      if (i < length) break;
+    }
+  }
+
+  for (size_t q = 0; q < num; q++)
+    pass->results[queries[q].id] = int_result(outputs[q], sizes[q]);
+  cs165_log(stdout, "SHARED INDEX: %s queries=%zu descents=%zu\n", col->name,
+            num, descents);
+  free(outputs);
+  free(sizes);
+  free(capacities);
+}
+
+static void index_pass_task(void* args) {
+  IndexPass* pass = (IndexPass*)args;
+  Column* col = pass->queries[0].col;
+  if (col->index.type == BITMAP) {
+    for (size_t q = 0; q < pass->num_queries; q++) {
+      BatchQuery* query = pass->queries + q;
+      pass->results[query->id] =
+          select_from_bitmap(col, query->low, query->high);
+    }
+  } else if (col->index.type == HASH) {
+    for (size_t q = 0; q < pass->num_queries; q++) {
+      BatchQuery* query = pass->queries + q;
+      pass->results[query->id] =
+          select_from_hash(col, query->low, query->high);
+    }
+  } else if (col->index.type == CRACKED) {
+    for (size_t q = 0; q < pass->num_queries; q++) {
+      BatchQuery* query = pass->queries + q;
+      pass->results[query->id] =
+          select_from_cracked(col, query->low, query->high);
+    }
+  } else if (col->clustered || col->index.type == SORTED ||
+             col->index.type == CSS) {
+    sorted_pass(pass);
+  } else {
+    btree_pass(pass);
+  }
+}
+
+/*=== Batch ===*/
+
+/**
+ * batch_execute canonicalizes the batch before running it:
+ *
+ * 1. identical selects (same input, same bounds or values) run once, and
+ *    every other handle asking for them gets a copy of the result;
+ * 2. range selects on base columns without a projection sorted on them
+ *    are planned one by one and grouped by column: the ones planned as
+ *    scans share one scan, the ones planned through the index share one
+ *    pass over it;
+ * 3. what is left (selects on intermediates, IN lists and selects
+ *    answered from projections) runs as one pool task per select.
+ *
+ * A BATCH: trace line reports how many selects each step took.
+ **/
+
+static bool same_select(Comparator* a, Comparator* b) {
+  if (a->gen_col->column_type != b->gen_col->column_type) return false;
+  if (a->gen_col->column_type == COLUMN
+          ? a->gen_col->column_pointer.column !=
+                b->gen_col->column_pointer.column
+          : a->gen_col->column_pointer.result !=
+                b->gen_col->column_pointer.result)
+    return false;
+  if ((a->gen_col_id == NULL) != (b->gen_col_id == NULL)) return false;
+  if (a->gen_col_id && a->gen_col_id->column_pointer.result !=
+                           b->gen_col_id->column_pointer.result)
+    return false;
+
+  if (a->type1 == IN_LIST || b->type1 == IN_LIST)
+    return a->type1 == b->type1 && a->num_vals == b->num_vals &&
+           memcmp(a->p_vals, b->p_vals, sizeof(int) * a->num_vals) == 0;
+  int a_low, a_high, b_low, b_high;
+  return comparator_bounds(a, &a_low, &a_high) &&
+         comparator_bounds(b, &b_low, &b_high) && a_low == b_low &&
+         a_high == b_high;
+}
+
+// Points canonical[i] at the first select identical to select i and drops
+// the repeats from the batch. Returns the number dropped.
+static size_t deduplicate_batch(BatchSelect* batch, size_t* canonical) {
+  size_t dropped = 0;
+  for (size_t i = 0; i < batch->size; i++) {
+    canonical[i] = i;
+    if (!batch->comparators[i]) continue;
+    for (size_t j = 0; j < i; j++) {
+      if (canonical[j] != j || !batch->comparators[j] ||
+          !same_select(batch->comparators[i], batch->comparators[j]))
+        continue;
+      canonical[i] = j;
+      free_comparator(batch->comparators[i]);
+      batch->comparators[i] = NULL;
+      dropped++;
+      break;
+    }
+  }
+  return dropped;
+}
+
+// Plans the range selects on base columns and takes them out of the batch.
+static size_t plan_batch(BatchSelect* batch, BatchQuery* queries) {
+  size_t num_queries = 0;
+  for (size_t i = 0; i < batch->size; i++) {
+    Comparator* cmp = batch->comparators[i];
+    if (!cmp || cmp->type1 == IN_LIST ||
+        cmp->gen_col->column_type != COLUMN ||
+        projection_of(cmp->gen_col->column_pointer.column))
+      continue;
+    BatchQuery* query = queries + num_queries;
+    query->id = i;
+    query->col = cmp->gen_col->column_pointer.column;
+    if (comparator_bounds(cmp, &query->low, &query->high)) {
+      query->path = plan_select(query->col, query->low, query->high, false,
+                                &query->selectivity);
+      num_queries++;
+    }
+    free_comparator(cmp);
+    batch->comparators[i] = NULL;
+  }
+  return num_queries;
+}
+
+// Orders planned selects by column, scans before index passes, then low.
+static int compare_batch_queries(const void* a, const void* b) {
+  const BatchQuery* x = (const BatchQuery*)a;
+  const BatchQuery* y = (const BatchQuery*)b;
+  if (x->col != y->col) return (uintptr_t)x->col < (uintptr_t)y->col ? -1 : 1;
+  bool x_scan = x->path == FULL_SCAN;
+  bool y_scan = y->path == FULL_SCAN;
+  if (x_scan != y_scan) return x_scan ? -1 : 1;
+  return (x->low > y->low) - (x->low < y->low);
+}
+
+typedef struct SelectTask {
+  BatchSelect* batch;
+  size_t idx;
+} SelectTask;
+
+static void select_task(void* args) {
+  SelectTask* task = (SelectTask*)args;
+  BatchSelect* batch = task->batch;
+  batch->results[task->idx] = single_select(batch->comparators[task->idx]);
 }
 
 void shared_select(BatchSelect* batch) {
-  pthread_t thread[PROC_NUM];
-  jobs = batch->size;
+  size_t* canonical = malloc(sizeof(size_t) * (batch->size + 1));
+  size_t deduplicated = deduplicate_batch(batch, canonical);
+
+  BatchQuery* queries = malloc(sizeof(BatchQuery) * (batch->size + 1));
+  size_t num_queries = plan_batch(batch, queries);
+  qsort(queries, num_queries, sizeof(BatchQuery), compare_batch_queries);
+
+  // Index passes and the remaining selects go to the pool first; shared
+  // scans then run in parallel with them.
+  TaskGroup group;
+  task_group_init(&group);
+  IndexPass* passes = malloc(sizeof(IndexPass) * (num_queries + 1));
+  size_t num_passes = 0;
+  size_t indexed = 0;
+  for (size_t g = 0, h; g < num_queries; g = h) {
+    for (h = g + 1; h < num_queries && queries[h].col == queries[g].col &&
+                    queries[h].path == queries[g].path;
+         h++)
+      ;
+    if (queries[g].path == FULL_SCAN) continue;
+    IndexPass* pass = passes + num_passes++;
+    pass->queries = queries + g;
+    pass->num_queries = h - g;
+    pass->results = batch->results;
+    indexed += h - g;
+    task_group_spawn(&group, index_pass_task, (void*)pass);
+  }
+
+  SelectTask* tasks = malloc(sizeof(SelectTask) * (batch->size + 1));
+  size_t num_single = 0;
+  for (size_t i = 0; i < batch->size; i++) {
+    if (!batch->comparators[i]) continue;
+    SelectTask* task = tasks + num_single++;
+    task->batch = batch;
+    task->idx = i;
+    task_group_spawn(&group, select_task, (void*)task);
+  }
+
+  size_t num_scans = 0;
+  for (size_t g = 0, h; g < num_queries; g = h) {
+    for (h = g + 1; h < num_queries && queries[h].col == queries[g].col &&
+                    queries[h].path == FULL_SCAN;
+         h++)
+      ;
+    if (queries[g].path != FULL_SCAN) continue;
+    run_shared_scan(queries + g, h - g, batch->results);
+    num_scans++;
+  }
+  task_group_wait(&group);
 
-  for (size_t i = 0; i < PROC_NUM; i++)
-    pthread_create(&thread[i], NULL, select_task, (void*)batch);
+  for (size_t i = 0; i < batch->size; i++)
+    if (canonical[i] != i)
+      batch->results[i] = copy_result(batch->results[canonical[i]]);
 
-  for (size_t i = 0; i < PROC_NUM; i++) pthread_join(thread[i], NULL);
+  cs165_log(stdout,
+            "BATCH: selects=%zu deduplicated=%zu scanned=%zu in %zu scans "
+            "indexed=%zu in %zu passes single=%zu\n",
+            batch->size, deduplicated, num_queries - indexed, num_scans,
+            indexed, num_passes, num_single);
+  log_thread_pool_stats();
+  free(canonical);
+  free(queries);
+  free(passes);
+  free(tasks);
 }
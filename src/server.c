@@ -28,6 +28,7 @@
 #include "execute.h"
 #include "message.h"
 #include "parse.h"
+#include "thread_pool.h"
 #include "utils.h"
 
 /**
@@ -144,6 +145,7 @@ int main(void) {
   if (server_socket < 0) {
     exit(1);
   }
+  init_thread_pool();
 
   bool done = false;
   while (!done) {
@@ -162,5 +164,6 @@ int main(void) {
     done = handle_client(client_socket);
   }
 
+  shutdown_thread_pool();
   return 0;
 }
@@ -0,0 +1,491 @@
+#include <immintrin.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "positions.h"
+#include "scan.h"
+#include "setops.h"
+#include "utils.h"
+
+/**
+ * and / or / andnot pick a method from the forms and sizes of their inputs:
+ *
+ *      inputs       |  method  |  cost
+ * ----------------- + -------- + -----------------------------------------
+ *  slice, slice     |  slice   |  O(1) when the answer is one range
+ *  list, slice      |  cut     |  two binary searches, one copy (and,
+ *                   |          |  list andnot slice)
+ *  list, bitvector  |  probe   |  one bit test per listed position (and,
+ *                   |          |  list andnot bitvector)
+ *  any bitvector    |  bitmap  |  word-wise ops over length / 64 words
+ *  lists, ratio     |  gallop  |  O(short * log(long / short)), runs of
+ *   >= GALLOP_RATIO |          |  the long list are copied with memcpy
+ *  lists otherwise  |  merge   |  O(short + long), branch free; and
+ *                   |          |  compares 4x4 blocks with SSE4.1
+ *
+ * Any other combination (a slice that has to be unioned with a list, say)
+ * materializes the slice and falls through to the list methods. INT
+ * position lists are not necessarily in position order (index selects on
+ * unclustered columns return them in value order), so such lists are
+ * sorted into a copy first.
+ **/
+
+typedef size_t (*IntersectKernel)(const int*, size_t, const int*, size_t,
+                                  int*);
+
+static IntersectKernel intersect_kernel;
+static const char* intersect_name;
+static pthread_once_t kernel_once = PTHREAD_ONCE_INIT;
+
+static uint8_t lut_sse4[16][16] __attribute__((aligned(16)));
+
+static void init_kernels();
+
+/*=== Sorted Lists ===*/
+
+typedef struct SortedList {
+  Result* res;
+  int* vals;
+  size_t num;
+} SortedList;
+
+static int compare_ints(const void* a, const void* b) {
+  int x = *(const int*)a;
+  int y = *(const int*)b;
+  return (x > y) - (x < y);
+}
+
+static void sorted_list(SortedList* list, Result* res) {
+  list->res = res;
+  list->num = res->num_tuples;
+  list->vals = materialize_positions(res);
+  if (res->data_type != INT) return;
+
+  size_t i = 1;
+  while (i < list->num && list->vals[i - 1] < list->vals[i]) i++;
+  if (i >= list->num) return;
+  int* sorted = malloc(sizeof(int) * list->num);
+  memcpy(sorted, list->vals, sizeof(int) * list->num);
+  qsort(sorted, list->num, sizeof(int), compare_ints);
+  list->vals = sorted;
+}
+
+static void release_list(SortedList* list) {
+  release_positions(list->res, list->vals);
+}
+
+// First index in [from, num) whose value is >= target, num if none.
+static size_t gallop(const int* vals, size_t from, size_t num, int target) {
+  size_t low = from;
+  size_t high = from;
+  size_t step = 1;
+  while (high < num && vals[high] < target) {
+    low = high + 1;
+    high += step;
+    step <<= 1;
+  }
+  if (high > num) high = num;
+  while (low < high) {
+    size_t mid = low + (high - low) / 2;
+    if (vals[mid] < target)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  return low;
+}
+
+static Result* list_result(int* vals, size_t num) {
+  Result* result = calloc(sizeof(Result), 1);
+  result->num_tuples = num;
+  result->data_type = INT;
+  result->payload = vals;
+  return result;
+}
+
+/*=== Merge ===*/
+
+static size_t intersect_scalar(const int* a, size_t n, const int* b,
+                               size_t m, int* output) {
+  size_t i = 0, j = 0, k = 0;
+  while (i < n && j < m) {
+    int x = a[i], y = b[j];
+    output[k] = x;
+    k += x == y;
+    i += x <= y;
+    j += y <= x;
+  }
+  return k;
+}
+
+/**
+ * Compares a block of 4 positions from each list all against all (the
+ * second block rotated three times), packs the matches of the first block
+ * with pshufb and advances whichever block ends first.
+ **/
+__attribute__((target("sse4.1"))) static size_t intersect_sse4(
+    const int* a, size_t n, const int* b, size_t m, int* output) {
+  size_t i = 0, j = 0, k = 0;
+  size_t n4 = n & ~(size_t)3;
+  size_t m4 = m & ~(size_t)3;
+  while (i < n4 && j < m4) {
+    __m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+    __m128i vb = _mm_loadu_si128((const __m128i*)(b + j));
+    __m128i rot1 = _mm_shuffle_epi32(vb, _MM_SHUFFLE(0, 3, 2, 1));
+    __m128i rot2 = _mm_shuffle_epi32(vb, _MM_SHUFFLE(1, 0, 3, 2));
+    __m128i rot3 = _mm_shuffle_epi32(vb, _MM_SHUFFLE(2, 1, 0, 3));
+    __m128i eq = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi32(va, vb), _mm_cmpeq_epi32(va, rot1)),
+        _mm_or_si128(_mm_cmpeq_epi32(va, rot2), _mm_cmpeq_epi32(va, rot3)));
+    int mask = _mm_movemask_ps(_mm_castsi128_ps(eq));
+    __m128i perm = _mm_load_si128((const __m128i*)lut_sse4[mask]);
+    _mm_storeu_si128((__m128i*)(output + k), _mm_shuffle_epi8(va, perm));
+    k += __builtin_popcount(mask);
+    int last_a = a[i + 3], last_b = b[j + 3];
+    i += (last_a <= last_b) * 4;
+    j += (last_b <= last_a) * 4;
+  }
+  return k + intersect_scalar(a + i, n - i, b + j, m - j, output + k);
+}
+
+static size_t union_merge(const int* a, size_t n, const int* b, size_t m,
+                          int* output) {
+  size_t i = 0, j = 0, k = 0;
+  while (i < n && j < m) {
+    int x = a[i], y = b[j];
+    output[k++] = x < y ? x : y;
+    i += x <= y;
+    j += y <= x;
+  }
+  memcpy(output + k, a + i, sizeof(int) * (n - i));
+  k += n - i;
+  memcpy(output + k, b + j, sizeof(int) * (m - j));
+  return k + m - j;
+}
+
+static size_t difference_merge(const int* a, size_t n, const int* b,
+                               size_t m, int* output) {
+  size_t i = 0, j = 0, k = 0;
+  while (i < n && j < m) {
+    int x = a[i], y = b[j];
+    output[k] = x;
+    k += x < y;
+    i += x <= y;
+    j += y <= x;
+  }
+  memcpy(output + k, a + i, sizeof(int) * (n - i));
+  return k + n - i;
+}
+
+/*=== Gallop ===*/
+
+static size_t intersect_gallop(const int* small, size_t n, const int* large,
+                               size_t m, int* output) {
+  size_t j = 0, k = 0;
+  for (size_t i = 0; i < n; i++) {
+    j = gallop(large, j, m, small[i]);
+    if (j == m) break;
+    output[k] = small[i];
+    k += large[j] == small[i];
+  }
+  return k;
+}
+
+static size_t union_gallop(const int* small, size_t n, const int* large,
+                           size_t m, int* output) {
+  size_t j = 0, k = 0;
+  for (size_t i = 0; i < n; i++) {
+    size_t next = gallop(large, j, m, small[i]);
+    memcpy(output + k, large + j, sizeof(int) * (next - j));
+    k += next - j;
+    output[k++] = small[i];
+    j = next + (next < m && large[next] == small[i]);
+  }
+  memcpy(output + k, large + j, sizeof(int) * (m - j));
+  return k + m - j;
+}
+
+// a much shorter than b: look every entry of a up in b.
+static size_t difference_gallop_left(const int* a, size_t n, const int* b,
+                                     size_t m, int* output) {
+  size_t j = 0, k = 0;
+  for (size_t i = 0; i < n; i++) {
+    j = gallop(b, j, m, a[i]);
+    output[k] = a[i];
+    k += j == m || b[j] != a[i];
+  }
+  return k;
+}
+
+// b much shorter than a: copy the runs of a between entries of b.
+static size_t difference_gallop_right(const int* a, size_t n, const int* b,
+                                      size_t m, int* output) {
+  size_t i = 0, k = 0;
+  for (size_t j = 0; j < m && i < n; j++) {
+    size_t next = gallop(a, i, n, b[j]);
+    memcpy(output + k, a + i, sizeof(int) * (next - i));
+    k += next - i;
+    i = next + (next < n && a[next] == b[j]);
+  }
+  memcpy(output + k, a + i, sizeof(int) * (n - i));
+  return k + n - i;
+}
+
+static Result* combine_lists(SortedList* l, SortedList* r, OperatorType op,
+                             const char** method) {
+  size_t n = l->num, m = r->num;
+  size_t shorter = n < m ? n : m;
+  size_t longer = n < m ? m : n;
+  bool skewed = shorter * GALLOP_RATIO <= longer;
+  int* output;
+  size_t k;
+
+  switch (op) {
+    case AND:
+      output = malloc(sizeof(int) * (shorter + SCAN_PADDING));
+      if (skewed) {
+        k = n < m ? intersect_gallop(l->vals, n, r->vals, m, output)
+                  : intersect_gallop(r->vals, m, l->vals, n, output);
+        *method = "gallop";
+      } else {
+        pthread_once(&kernel_once, init_kernels);
+        k = intersect_kernel(l->vals, n, r->vals, m, output);
+        *method = intersect_name;
+      }
+      break;
+    case OR:
+      output = malloc(sizeof(int) * (n + m + 1));
+      if (skewed) {
+        k = n < m ? union_gallop(l->vals, n, r->vals, m, output)
+                  : union_gallop(r->vals, m, l->vals, n, output);
+        *method = "gallop";
+      } else {
+        k = union_merge(l->vals, n, r->vals, m, output);
+        *method = "merge";
+      }
+      break;
+    default:
+      output = malloc(sizeof(int) * (n + 1));
+      if (skewed) {
+        k = n < m ? difference_gallop_left(l->vals, n, r->vals, m, output)
+                  : difference_gallop_right(l->vals, n, r->vals, m, output);
+        *method = "gallop";
+      } else {
+        k = difference_merge(l->vals, n, r->vals, m, output);
+        *method = "merge";
+      }
+  }
+  return list_result(output, k);
+}
+
+/*=== Slices ===*/
+
+static Result* combine_slices(Slice* l, Slice* r, OperatorType op) {
+  switch (op) {
+    case AND:
+      return slice_result(l->start > r->start ? l->start : r->start,
+                          l->end < r->end ? l->end : r->end);
+    case OR:
+      if (l->start == l->end) return slice_result(r->start, r->end);
+      if (r->start == r->end) return slice_result(l->start, l->end);
+      if (l->start > r->end || r->start > l->end) return NULL;
+      return slice_result(l->start < r->start ? l->start : r->start,
+                          l->end > r->end ? l->end : r->end);
+    default:
+      if (r->start >= l->end || r->end <= l->start || r->start == r->end)
+        return slice_result(l->start, l->end);
+      if (r->start <= l->start) return slice_result(r->end, l->end);
+      if (r->end >= l->end) return slice_result(l->start, r->start);
+      return NULL;
+  }
+}
+
+// Positions of a sorted list inside [start, end) (or outside it).
+static Result* cut_list(SortedList* list, Slice* slice, bool inside) {
+  size_t from = gallop(list->vals, 0, list->num, (int)slice->start);
+  size_t to = from;
+  if (slice->end > slice->start)
+    to = gallop(list->vals, from, list->num, (int)slice->end);
+  size_t num = inside ? to - from : list->num - (to - from);
+  int* output = malloc(sizeof(int) * (num + 1));
+  if (inside) {
+    memcpy(output, list->vals + from, sizeof(int) * num);
+  } else {
+    memcpy(output, list->vals, sizeof(int) * from);
+    memcpy(output + from, list->vals + to, sizeof(int) * (list->num - to));
+  }
+  return list_result(output, num);
+}
+
+/*=== Bitmaps ===*/
+
+static bool test_bit(BitVector* bv, int pos) {
+  return pos >= 0 && (size_t)pos < bv->length &&
+         (bv->words[pos / 64] >> (pos % 64) & 1);
+}
+
+static Result* probe_bitvector(SortedList* list, BitVector* bv, bool keep) {
+  int* output = malloc(sizeof(int) * (list->num + 1));
+  size_t k = 0;
+  for (size_t i = 0; i < list->num; i++) {
+    output[k] = list->vals[i];
+    k += test_bit(bv, list->vals[i]) == keep;
+  }
+  return list_result(output, k);
+}
+
+static size_t position_domain(Result* res) {
+  switch (res->data_type) {
+    case BITVECTOR:
+      return ((BitVector*)res->payload)->length;
+    case SLICE:
+      return ((Slice*)res->payload)->end;
+    default: {
+      int* vals = (int*)res->payload;
+      int max = -1;
+      for (size_t i = 0; i < res->num_tuples; i++)
+        if (vals[i] > max) max = vals[i];
+      return max + 1;
+    }
+  }
+}
+
+static BitVector* to_bitvector(Result* res, size_t length) {
+  BitVector* bv = create_bitvector(length);
+  switch (res->data_type) {
+    case BITVECTOR: {
+      BitVector* src = (BitVector*)res->payload;
+      memcpy(bv->words, src->words,
+             sizeof(uint64_t) * BITVECTOR_WORDS(src->length));
+      break;
+    }
+    case SLICE: {
+      Slice* slice = (Slice*)res->payload;
+      bitvector_set_range(bv, slice->start, slice->end);
+      break;
+    }
+    default: {
+      int* vals = (int*)res->payload;
+      for (size_t i = 0; i < res->num_tuples; i++)
+        bv->words[vals[i] / 64] |= 1ULL << (vals[i] % 64);
+    }
+  }
+  return bv;
+}
+
+static Result* combine_bitmaps(Result* left, Result* right, OperatorType op) {
+  size_t l_len = position_domain(left);
+  size_t r_len = position_domain(right);
+  size_t length = l_len > r_len ? l_len : r_len;
+  size_t words = BITVECTOR_WORDS(length);
+  BitVector* bv = to_bitvector(left, length);
+
+  if (right->data_type == INT) {
+    int* vals = (int*)right->payload;
+    if (op == OR) {
+      for (size_t i = 0; i < right->num_tuples; i++)
+        bv->words[vals[i] / 64] |= 1ULL << (vals[i] % 64);
+    } else {
+      for (size_t i = 0; i < right->num_tuples; i++)
+        bv->words[vals[i] / 64] &= ~(1ULL << (vals[i] % 64));
+    }
+  } else {
+    BitVector* other = to_bitvector(right, length);
+    switch (op) {
+      case AND:
+        for (size_t i = 0; i < words; i++) bv->words[i] &= other->words[i];
+        break;
+      case OR:
+        for (size_t i = 0; i < words; i++) bv->words[i] |= other->words[i];
+        break;
+      default:
+        for (size_t i = 0; i < words; i++) bv->words[i] &= ~other->words[i];
+    }
+    free(other);
+  }
+  return bitvector_result(bv, bitvector_count(bv));
+}
+
+/*=== Dispatch ===*/
+
+static void init_kernels() {
+  for (int mask = 0; mask < 16; mask++) {
+    int k = 0;
+    for (int lane = 0; lane < 4; lane++)
+      if (mask & (1 << lane))
+        for (int byte = 0; byte < 4; byte++)
+          lut_sse4[mask][k++] = (uint8_t)(lane * 4 + byte);
+    while (k < 16) lut_sse4[mask][k++] = 0x80;
+  }
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("sse4.1")) {
+    intersect_kernel = intersect_sse4;
+    intersect_name = "merge-sse4";
+  } else {
+    intersect_kernel = intersect_scalar;
+    intersect_name = "merge";
+  }
+}
+
+static const char* op_name(OperatorType op) {
+  return op == AND ? "and" : op == OR ? "or" : "andnot";
+}
+
+static const char* form_name(Result* res) {
+  return res->data_type == BITVECTOR ? "bitvector"
+         : res->data_type == SLICE   ? "slice"
+                                     : "positions";
+}
+
+Result* combine_positions(Result* left, Result* right, OperatorType op) {
+  Result* result = NULL;
+  const char* method = NULL;
+  DataType l_type = left->data_type;
+  DataType r_type = right->data_type;
+
+  if (l_type == SLICE && r_type == SLICE) {
+    result = combine_slices((Slice*)left->payload, (Slice*)right->payload, op);
+    method = "slice";
+  } else if (l_type == BITVECTOR || r_type == BITVECTOR) {
+    // Only a list side narrows the answer to a list; probe it.
+    SortedList list;
+    if (op != OR && l_type != BITVECTOR && l_type != SLICE) {
+      sorted_list(&list, left);
+      result = probe_bitvector(&list, (BitVector*)right->payload, op == AND);
+      release_list(&list);
+      method = "probe";
+    } else if (op == AND && r_type != BITVECTOR && r_type != SLICE) {
+      sorted_list(&list, right);
+      result = probe_bitvector(&list, (BitVector*)left->payload, true);
+      release_list(&list);
+      method = "probe";
+    } else {
+      result = combine_bitmaps(left, right, op);
+      method = "bitmap";
+    }
+  } else if (op != OR && (l_type == SLICE) != (r_type == SLICE) &&
+             (op == AND || r_type == SLICE)) {
+    SortedList list;
+    sorted_list(&list, l_type == SLICE ? right : left);
+    Slice* slice = (Slice*)(l_type == SLICE ? left : right)->payload;
+    result = cut_list(&list, slice, op == AND);
+    release_list(&list);
+    method = "cut";
+  }
+
+  if (result == NULL) {
+    SortedList l, r;
+    sorted_list(&l, left);
+    sorted_list(&r, right);
+    result = combine_lists(&l, &r, op, &method);
+    release_list(&l);
+    release_list(&r);
+  }
+
+  cs165_log(stdout, "POSITIONS: %s %s=%zu %s=%zu method=%s output=%s=%zu\n",
+            op_name(op), form_name(left), left->num_tuples, form_name(right),
+            right->num_tuples, method, form_name(result), result->num_tuples);
+  return result;
+}
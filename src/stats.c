@@ -0,0 +1,305 @@
+#include <math.h>
+#include <string.h>
+
+#include "bitmap.h"
+#include "cs165_api.h"
+#include "css_tree.h"
+#include "index.h"
+#include "scan.h"
+#include "select.h"
+#include "stats.h"
+#include "utils.h"
+
+/*=== Analyze ===*/
+
+static int compare_ints(const void* a, const void* b) {
+  int x = *(const int*)a;
+  int y = *(const int*)b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * Rebuilds the statistics of col from its values in sorted order. Clustered
+ * columns and unclustered sorted indexes already hold them; anything else
+ * sorts an evenly strided sample of at most STATS_SAMPLE values. A sampled
+ * distinct count is scaled up with the GEE estimator: values seen once in
+ * the sample stand for sqrt(rows / sample) distinct values each.
+ **/
+void analyze_column(Column* col) {
+  ColumnStats* stats = &col->stats;
+  memset(stats, 0, sizeof(ColumnStats));
+  if (col->size == 0) return;
+
+  int* sorted = NULL;
+  int* sample = NULL;
+  size_t length = col->size;
+  if (col->clustered) {
+    sorted = col->data;
+  } else if ((col->index.type == SORTED || col->index.type == CSS) &&
+             index_ready(col)) {
+    sorted = ((SortedIndex*)col->index.payload)->vals;
+  } else {
+    size_t step = col->size > STATS_SAMPLE ? col->size / STATS_SAMPLE : 1;
+    length = (col->size + step - 1) / step;
+    sample = malloc(sizeof(int) * length);
+    for (size_t i = 0; i < length; i++) sample[i] = col->data[i * step];
+    qsort(sample, length, sizeof(int), compare_ints);
+    sorted = sample;
+  }
+
+  for (size_t b = 0; b <= HISTOGRAM_BUCKETS; b++)
+    stats->bounds[b] = sorted[b * (length - 1) / HISTOGRAM_BUCKETS];
+
+  size_t distinct = 0;
+  size_t singletons = 0;
+  for (size_t i = 0, j; i < length; i = j) {
+    for (j = i + 1; j < length && sorted[j] == sorted[i]; j++)
+      ;
+    distinct++;
+    singletons += j - i == 1;
+  }
+  if (length < col->size) {
+    double scaled =
+        sqrt((double)col->size / length) * singletons + (distinct - singletons);
+    distinct = scaled > col->size ? col->size : (size_t)scaled;
+  }
+
+  stats->rows = col->size;
+  stats->distinct = distinct > 0 ? distinct : 1;
+
+  cs165_log(stdout, "ANALYZE: %s rows=%zu distinct=%zu min=%d max=%d%s\n",
+            col->name, stats->rows, stats->distinct, stats->bounds[0],
+            stats->bounds[HISTOGRAM_BUCKETS], sample ? " sampled" : "");
+  free(sample);
+}
+
+/*=== Estimate ===*/
+
+/**
+ * Fraction of rows in [low, high]: every bucket the range overlaps adds its
+ * share of the rows, scaled by the overlapped part of its value range. No
+ * non-empty range that meets the data is estimated below one distinct
+ * value's worth of rows.
+ **/
+double estimate_range(ColumnStats* stats, int low, int high) {
+  if (stats->rows == 0 || low > high) return 0;
+  if (high < stats->bounds[0] || low > stats->bounds[HISTOGRAM_BUCKETS])
+    return 0;
+
+  double fraction = 0;
+  for (size_t b = 0; b < HISTOGRAM_BUCKETS; b++) {
+    long bucket_low = stats->bounds[b];
+    long bucket_high = stats->bounds[b + 1];
+    long overlap_low = low > bucket_low ? low : bucket_low;
+    long overlap_high = high < bucket_high ? high : bucket_high;
+    if (overlap_low > overlap_high) continue;
+    fraction += (double)(overlap_high - overlap_low + 1) /
+                (bucket_high - bucket_low + 1) / HISTOGRAM_BUCKETS;
+  }
+
+  double floor = 1.0 / stats->distinct;
+  if (fraction < floor) fraction = floor;
+  return fraction < 1 ? fraction : 1;
+}
+
+// Fraction of rows holding one of the values of an IN list.
+double estimate_in_list(ColumnStats* stats, const ValueSet* set) {
+  double fraction = 0;
+  for (size_t k = 0; k < set->num_vals; k++)
+    fraction += estimate_range(stats, set->vals[k], set->vals[k]);
+  return fraction < 1 ? fraction : 1;
+}
+
+/*=== Access Path ===*/
+
+const char* access_path_name(AccessPath path) {
+  switch (path) {
+    case SORTED_SEARCH:
+      return "sorted";
+    case BTREE_WALK:
+      return "btree";
+    case BITMAP_OR:
+      return "bitmap";
+    case CSS_SEARCH:
+      return "css";
+    case HASH_PROBE:
+      return "hash";
+    case CRACK_SEARCH:
+      return "crack";
+    case PROJECTION:
+      return "projection";
+    default:
+      return "scan";
+  }
+}
+
+/**
+ * What a bitmap index would read for a predicate: the bitmaps to OR and
+ * their compressed words. Both are exact, counted from the index itself.
+ **/
+typedef struct BitmapWork {
+  size_t bitmaps;
+  size_t words;
+} BitmapWork;
+
+/**
+ * A lazy bitmap index not built yet is costed from the statistics: a
+ * bitmap per distinct value in the predicate, one compressed word per
+ * matching row.
+ **/
+static BitmapWork bitmap_work_estimate(Column* col, double selectivity) {
+  BitmapWork work = {0, 0};
+  double bitmaps = selectivity * col->stats.distinct;
+  work.bitmaps = bitmaps > 1 ? (size_t)bitmaps : 1;
+  work.words = (size_t)(selectivity * col->size);
+  return work;
+}
+
+static BitmapWork bitmap_work_range(Column* col, int low, int high,
+                                    double selectivity) {
+  BitmapWork work = {0, 0};
+  if (col->index.type != BITMAP) return work;
+  if (!index_ready(col)) return bitmap_work_estimate(col, selectivity);
+  BitmapIndex* index = (BitmapIndex*)(col->index.payload);
+  for (size_t v = bitmap_lower_bound(index, low);
+       v < index->num_values && index->values[v] <= high; v++) {
+    work.bitmaps++;
+    work.words += index->bitmaps[v].num_words;
+  }
+  return work;
+}
+
+static BitmapWork bitmap_work_in(Column* col, const ValueSet* set,
+                                 double selectivity) {
+  BitmapWork work = {0, 0};
+  if (col->index.type != BITMAP) return work;
+  if (!index_ready(col)) return bitmap_work_estimate(col, selectivity);
+  BitmapIndex* index = (BitmapIndex*)(col->index.payload);
+  for (size_t k = 0; k < set->num_vals; k++) {
+    size_t v = bitmap_lower_bound(index, set->vals[k]);
+    if (v < index->num_values && index->values[v] == set->vals[k]) {
+      work.bitmaps++;
+      work.words += index->bitmaps[v].num_words;
+    }
+  }
+  return work;
+}
+
+// Cache lines a CSS-tree search reads: one per directory level and the
+// leaf block.
+static double css_levels(double rows) {
+  double levels = 1;
+  for (double blocks = rows / CSS_NODE_KEYS; blocks > 1;
+       blocks /= CSS_NODE_KEYS + 1)
+    levels++;
+  return levels;
+}
+
+/**
+ * Picks the cheapest way to answer a predicate on col among a (zone map
+ * assisted) scan reading scanned values, the column's index searched
+ * searches times (or its bitmaps ORed) and, when proj_searches is not 0,
+ * the projection sorted on col searched that many times, given the
+ * estimated selectivity. The costs of every candidate are reported on a
+ * PLAN: trace line. An index a builder thread is still filling in is left
+ * out; a lazy one is costed as if built, since choosing it builds it.
+ **/
+static AccessPath choose_path(Column* col, size_t scanned, size_t searches,
+                              size_t proj_searches, BitmapWork bitmaps,
+                              double selectivity) {
+  double rows = col->size;
+  double matches = selectivity * rows;
+  double search = rows > 1 ? searches * log2(rows) * SEARCH_STEP_COST : 0;
+  bool dense = selectivity >= BITVECTOR_SELECTIVITY;
+
+  double scan_cost = scanned * SCAN_VALUE_COST;
+  if (!dense) scan_cost += matches * POSITION_COST;
+
+  // A clustered column answers a single range with a slice and writes no
+  // positions at all.
+  double clustered_cost = searches == 1 ? 0 : matches * POSITION_COST;
+
+  IndexType type =
+      index_ready(col) || col->index.lazy ? col->index.type : NONE;
+  AccessPath path = FULL_SCAN;
+  double index_cost = 0;
+  switch (type) {
+    case SORTED:
+      index_cost = 2 * search + (col->clustered ? clustered_cost
+                                                : matches * SORTED_ENTRY_COST);
+      if (index_cost < scan_cost) path = SORTED_SEARCH;
+      break;
+    case BTREE:
+      index_cost = 2 * search + (col->clustered ? clustered_cost
+                                                : matches * BTREE_ENTRY_COST);
+      if (index_cost < scan_cost) path = BTREE_WALK;
+      break;
+    case CSS:
+      index_cost = 2 * searches * css_levels(rows) * CSS_LEVEL_COST +
+                   (col->clustered ? clustered_cost
+                                   : matches * SORTED_ENTRY_COST);
+      if (index_cost < scan_cost) path = CSS_SEARCH;
+      break;
+    case HASH:
+      index_cost = searches * HASH_PROBE_COST + matches * POSITION_COST;
+      if (index_cost < scan_cost) path = HASH_PROBE;
+      break;
+    case CRACKED:
+      index_cost = 2 * search + matches * SORTED_ENTRY_COST;
+      if (index_cost < scan_cost) path = CRACK_SEARCH;
+      break;
+    case BITMAP:
+      index_cost = bitmaps.words * BITMAP_WORD_COST;
+      if (bitmaps.bitmaps > 1 || dense)
+        index_cost += rows / 64 * BITVECTOR_WORD_COST;
+      if (!dense) index_cost += matches * POSITION_COST;
+      if (index_cost < scan_cost) path = BITMAP_OR;
+      break;
+    default:
+      break;
+  }
+
+  double proj_cost = 0;
+  if (proj_searches > 0) {
+    double best_cost = path == FULL_SCAN ? scan_cost : index_cost;
+    proj_cost = rows > 1 ? 2 * proj_searches * log2(rows) * SEARCH_STEP_COST
+                         : 0;
+    proj_cost += matches * PROJECTION_ROW_COST;
+    if (proj_cost < best_cost) path = PROJECTION;
+  }
+
+  cs165_log(stdout, "PLAN: %s est=%.3f scan=%.0f", col->name, selectivity,
+            scan_cost);
+  if (type != NONE)
+    cs165_log(stdout, " %s=%.0f",
+              type == SORTED   ? "sorted"
+              : type == BTREE  ? "btree"
+              : type == BITMAP ? "bitmap"
+              : type == HASH   ? "hash"
+              : type == CSS    ? "css"
+                               : "cracked",
+              index_cost);
+  if (proj_searches > 0) cs165_log(stdout, " projection=%.0f", proj_cost);
+  cs165_log(stdout, " chosen=%s\n", access_path_name(path));
+  return path;
+}
+
+AccessPath choose_access_path(Column* col, int low, int high,
+                              bool projected, double selectivity) {
+  size_t scanned = zonemap_scanned(&col->zones, col->size, low, high);
+  // A hash index answers a range by probing every value in it.
+  size_t searches = 1;
+  if (col->index.type == HASH)
+    searches = low <= high ? (long)high - low + 1 : 0;
+  return choose_path(col, scanned, searches, projected ? 1 : 0,
+                     bitmap_work_range(col, low, high, selectivity),
+                     selectivity);
+}
+
+AccessPath choose_in_list_path(Column* col, const ValueSet* set,
+                               bool projected, double selectivity) {
+  size_t scanned = zonemap_scanned_in(&col->zones, col->size, set);
+  return choose_path(col, scanned, set->num_vals,
+                     projected ? set->num_vals : 0,
+                     bitmap_work_in(col, set, selectivity), selectivity);
+}
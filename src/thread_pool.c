@@ -0,0 +1,280 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "thread_pool.h"
+#include "utils.h"
+
+#define DEQUE_CAPACITY 64
+#define HELP_WAIT_NS 1000000
+
+typedef struct Task {
+  TaskFunction fn;
+  void* args;
+  TaskGroup* group;
+} Task;
+
+/**
+ * A ring buffer of tasks. The owning worker pushes and pops at the bottom
+ * (tail), thieves take from the top (head), so the owner keeps working on
+ * the tasks it spawned most recently while the oldest ones move away.
+ **/
+typedef struct TaskDeque {
+  pthread_mutex_t lock;
+  Task* tasks;
+  size_t head;
+  size_t tail;
+  size_t capacity;
+  size_t tasks_run;
+  size_t steals;
+  double idle_ms;
+} TaskDeque;
+
+typedef struct ThreadPool {
+  size_t size;
+  pthread_t* threads;
+  TaskDeque* deques;
+  size_t queued;
+  size_t next_deque;
+  bool stopping;
+  pthread_mutex_t idle_lock;
+  pthread_cond_t idle;
+} ThreadPool;
+
+static ThreadPool pool;
+static __thread long worker_id = -1;
+
+static double now_ms() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/*=== Deque ===*/
+
+static void push_bottom(TaskDeque* deque, Task task) {
+  pthread_mutex_lock(&deque->lock);
+  if (deque->tail - deque->head == deque->capacity) {
+    Task* tasks = malloc(sizeof(Task) * deque->capacity * 2);
+    for (size_t i = deque->head; i < deque->tail; i++)
+      tasks[i - deque->head] = deque->tasks[i % deque->capacity];
+    free(deque->tasks);
+    deque->tasks = tasks;
+    deque->tail -= deque->head;
+    deque->head = 0;
+    deque->capacity *= 2;
+  }
+  deque->tasks[deque->tail++ % deque->capacity] = task;
+  pthread_mutex_unlock(&deque->lock);
+}
+
+static bool pop_bottom(TaskDeque* deque, Task* task) {
+  bool found = false;
+  pthread_mutex_lock(&deque->lock);
+  if (deque->tail > deque->head) {
+    *task = deque->tasks[--deque->tail % deque->capacity];
+    found = true;
+  }
+  pthread_mutex_unlock(&deque->lock);
+  return found;
+}
+
+static bool steal_top(TaskDeque* deque, Task* task) {
+  bool found = false;
+  pthread_mutex_lock(&deque->lock);
+  if (deque->tail > deque->head) {
+    *task = deque->tasks[deque->head++ % deque->capacity];
+    found = true;
+  }
+  pthread_mutex_unlock(&deque->lock);
+  return found;
+}
+
+/*=== Scheduling ===*/
+
+// Takes a task from the caller's own deque, otherwise steals one from the
+// other workers starting at the caller's right-hand neighbour.
+static bool take_task(Task* task) {
+  size_t self = worker_id >= 0 ? (size_t)worker_id : 0;
+  if (worker_id >= 0 && pop_bottom(&pool.deques[self], task)) goto taken;
+  for (size_t i = 1; i <= pool.size; i++) {
+    size_t victim = (self + i) % pool.size;
+    if (steal_top(&pool.deques[victim], task)) {
+      if (worker_id >= 0) __sync_fetch_and_add(&pool.deques[self].steals, 1);
+      goto taken;
+    }
+  }
+  return false;
+taken:
+  __sync_fetch_and_sub(&pool.queued, 1);
+  return true;
+}
+
+static void run_task(Task* task) {
+  task->fn(task->args);
+  if (worker_id >= 0) pool.deques[worker_id].tasks_run++;
+
+  TaskGroup* group = task->group;
+  pthread_mutex_lock(&group->lock);
+  if (--group->pending == 0) pthread_cond_broadcast(&group->done);
+  pthread_mutex_unlock(&group->lock);
+}
+
+static void* worker(void* args) {
+  worker_id = (long)args;
+  TaskDeque* deque = &pool.deques[worker_id];
+  Task task;
+
+  while (true) {
+    if (take_task(&task)) {
+      run_task(&task);
+      continue;
+    }
+    pthread_mutex_lock(&pool.idle_lock);
+    double start = now_ms();
+    while (pool.queued == 0 && !pool.stopping)
+      pthread_cond_wait(&pool.idle, &pool.idle_lock);
+    deque->idle_ms += now_ms() - start;
+    bool done = pool.stopping && pool.queued == 0;
+    pthread_mutex_unlock(&pool.idle_lock);
+    if (done) break;
+  }
+  return NULL;
+}
+
+/*=== Pool ===*/
+
+void init_thread_pool() {
+  long procs = sysconf(_SC_NPROCESSORS_ONLN);
+  pool.size = procs > 0 ? procs : 1;
+  pool.threads = malloc(sizeof(pthread_t) * pool.size);
+  pool.deques = calloc(sizeof(TaskDeque), pool.size);
+  pool.queued = 0;
+  pool.next_deque = 0;
+  pool.stopping = false;
+  pthread_mutex_init(&pool.idle_lock, NULL);
+  pthread_cond_init(&pool.idle, NULL);
+
+  for (size_t i = 0; i < pool.size; i++) {
+    TaskDeque* deque = &pool.deques[i];
+    pthread_mutex_init(&deque->lock, NULL);
+    deque->capacity = DEQUE_CAPACITY;
+    deque->tasks = malloc(sizeof(Task) * deque->capacity);
+  }
+  for (size_t i = 0; i < pool.size; i++)
+    pthread_create(&pool.threads[i], NULL, worker, (void*)(long)i);
+
+  cs165_log(stdout, "POOL: started %zu workers\n", pool.size);
+}
+
+void shutdown_thread_pool() {
+  pthread_mutex_lock(&pool.idle_lock);
+  pool.stopping = true;
+  pthread_cond_broadcast(&pool.idle);
+  pthread_mutex_unlock(&pool.idle_lock);
+  for (size_t i = 0; i < pool.size; i++) pthread_join(pool.threads[i], NULL);
+
+  log_thread_pool_stats();
+
+  for (size_t i = 0; i < pool.size; i++) {
+    pthread_mutex_destroy(&pool.deques[i].lock);
+    free(pool.deques[i].tasks);
+  }
+  free(pool.deques);
+  free(pool.threads);
+  pthread_mutex_destroy(&pool.idle_lock);
+  pthread_cond_destroy(&pool.idle);
+}
+
+size_t thread_pool_size() { return pool.size; }
+
+/**
+ * Number of tasks to split work items into: one per grain items, at least
+ * one and at most one per worker. Small inputs therefore stay on a single
+ * task instead of paying for a fan-out they cannot amortize.
+ **/
+size_t parallel_degree(size_t work, size_t grain) {
+  size_t degree = grain > 0 ? (work + grain - 1) / grain : 1;
+  if (degree > pool.size) degree = pool.size;
+  return degree > 0 ? degree : 1;
+}
+
+/*=== Task Group ===*/
+
+void task_group_init(TaskGroup* group) {
+  group->pending = 0;
+  pthread_mutex_init(&group->lock, NULL);
+  pthread_cond_init(&group->done, NULL);
+}
+
+void task_group_spawn(TaskGroup* group, TaskFunction fn, void* args) {
+  Task task = {fn, args, group};
+  pthread_mutex_lock(&group->lock);
+  group->pending++;
+  pthread_mutex_unlock(&group->lock);
+
+  // Workers push onto their own deque; other threads spread their tasks
+  // round robin so that every worker starts with something to pop.
+  size_t target = worker_id >= 0
+                      ? (size_t)worker_id
+                      : __sync_fetch_and_add(&pool.next_deque, 1) % pool.size;
+  push_bottom(&pool.deques[target], task);
+  __sync_fetch_and_add(&pool.queued, 1);
+
+  pthread_mutex_lock(&pool.idle_lock);
+  pthread_cond_signal(&pool.idle);
+  pthread_mutex_unlock(&pool.idle_lock);
+}
+
+// Runs queued tasks while the group is unfinished. When nothing is left to
+// take, sleeps briefly so tasks spawned by the group's own tasks are still
+// picked up even if every worker is busy.
+void task_group_wait(TaskGroup* group) {
+  Task task;
+  while (true) {
+    pthread_mutex_lock(&group->lock);
+    bool finished = group->pending == 0;
+    pthread_mutex_unlock(&group->lock);
+    if (finished) break;
+
+    if (take_task(&task)) {
+      run_task(&task);
+      continue;
+    }
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += HELP_WAIT_NS;
+    if (deadline.tv_nsec >= 1000000000) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000;
+    }
+    pthread_mutex_lock(&group->lock);
+    if (group->pending > 0)
+      pthread_cond_timedwait(&group->done, &group->lock, &deadline);
+    pthread_mutex_unlock(&group->lock);
+  }
+  pthread_mutex_destroy(&group->lock);
+  pthread_cond_destroy(&group->done);
+}
+
+/*=== Stats ===*/
+
+ThreadPoolStats thread_pool_stats() {
+  ThreadPoolStats stats = {pool.size, 0, 0, 0};
+  for (size_t i = 0; i < pool.size; i++) {
+    stats.tasks += pool.deques[i].tasks_run;
+    stats.steals += pool.deques[i].steals;
+    stats.idle_ms += pool.deques[i].idle_ms;
+  }
+  return stats;
+}
+
+void log_thread_pool_stats() {
+  ThreadPoolStats stats = thread_pool_stats();
+  cs165_log(stdout, "POOL: workers=%zu tasks=%zu steals=%zu idle=%.1fms\n",
+            stats.workers, stats.tasks, stats.steals, stats.idle_ms);
+}
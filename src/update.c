@@ -1,36 +1,70 @@
 #include <stdio.h>
+#include <string.h>
 
 #include "client_context.h"
 #include "cs165_api.h"
 #include "index.h"
 #include "insert.h"
+#include "positions.h"
 #include "utils.h"
 
 void column_delete(Column* col, int* pos, size_t size) {
-  for (size_t i = 0; i < size; i++) {
-    array_delete(col->data, col->size, pos[i]);
+  // Deleting from the highest position down keeps the ones still to go
+  // valid. The RowMap still holds every row until the table drops them.
+  size_t first_changed = col->size;
+  for (size_t i = size; i-- > 0;) {
     delete_index(col, pos[i]);
+    array_delete(col->data, col->size, pos[i]);
     col->size--;
+    if ((size_t)pos[i] < first_changed) first_changed = pos[i];
   }
+  col->writes++;
+  refresh_zonemap(col, first_changed);
+  refresh_byteslices(col, first_changed);
+}
+
+static int compare_positions(const void* a, const void* b) {
+  return *(const int*)a - *(const int*)b;
 }
 
 void delete_scheduler(Table* table, Result* pos_del) {
-  int* pos = (int*)(pos_del->payload);
+  wait_index_builds(table);
   size_t size = pos_del->num_tuples;
+  int* positions = materialize_positions(pos_del);
+  int* pos = malloc(sizeof(int) * (size + 1));
+  memcpy(pos, positions, sizeof(int) * size);
+  release_positions(pos_del, positions);
+  qsort(pos, size, sizeof(int), compare_positions);
+
+  // The rows keep their ids in every projection.
+  for (size_t p = 0; p < table->num_projections; p++) {
+    Table* proj = table->projections[p];
+    int* proj_pos = malloc(sizeof(int) * (size + 1));
+    for (size_t i = 0; i < size; i++)
+      proj_pos[i] = proj->rows->pos[table->rows->ids[pos[i]]];
+    Result proj_del = {.payload = proj_pos, .num_tuples = size,
+                       .data_type = INT};
+    delete_scheduler(proj, &proj_del);
+    free(proj_pos);
+  }
 
   for (size_t i = 0; i < table->col_count; i++)
     column_delete(table->columns + i, pos, size);
+  row_map_delete(table->rows, pos, size, table->size);
 
+  free(pos);
   table->size -= size;
 }
 
 void update_scheduler(Table* tbl, size_t col_idx, Result* pos, int val) {
   int vals[pos->num_tuples][tbl->col_count];
+  int* positions = materialize_positions(pos);
 
   for (size_t i = 0; i < pos->num_tuples; i++)
     for (size_t j = 0; j < tbl->col_count; j++)
-      vals[i][j] =
-          j == col_idx ? val : tbl->columns[j].data[((int*)pos->payload)[i]];
+      vals[i][j] = j == col_idx ? val : tbl->columns[j].data[positions[i]];
+
+  release_positions(pos, positions);
 
   delete_scheduler(tbl, pos);
 
@@ -62,7 +62,8 @@ void resize_table(Table* tbl) {
     Column* col = tbl->columns + i;
     col->data =
         resize_mmap(col->data, col->data_fd, sizeof(int) * new_capacity);
-    if (col->index.type == SORTED && !col->clustered)
+    if ((col->index.type == SORTED || col->index.type == CSS) &&
+        !col->clustered)
       resize_sorted_index(col, new_capacity);
   }
   tbl->capacity = new_capacity;
@@ -95,22 +96,19 @@ void resize_buffer(char** buffer, size_t* buffer_capacity) {
 
 /*=== ARRAY UTILS ===*/
 
+// Returns the first position of sorted vals whose value is >= val, or the
+// last position when every value is smaller.
 size_t binary_search(int* vals, size_t length, int val) {
   if (length == 0) return 0;
   size_t low = 0;
   size_t high = length - 1;
-  size_t mid = (low + high) / 2;
   while (low < high) {
-    if (vals[mid] < val) {
+    size_t mid = low + (high - low) / 2;
+    if (vals[mid] < val)
       low = mid + 1;
-    } else if (vals[mid] == val) {
-      return mid;
-    } else {
-      high = mid > 0 ? mid - 1 : mid;
-    }
-    mid = (low + high) / 2;
+    else
+      high = mid;
   }
-  while (low > 0 && vals[low - 1] == val) low--;
   return low;
 }
 
@@ -122,12 +120,15 @@ size_t pos_in_sorted(int* vals, size_t length, int new_val) {
 }
 
 void array_insert(int* vals, size_t length, int new_val, size_t pos) {
-  if (length > pos) memmove(vals + pos + 1, vals + pos, (length - pos));
+  if (length > pos)
+    memmove(vals + pos + 1, vals + pos, sizeof(int) * (length - pos));
   vals[pos] = new_val;
 }
 
 void array_delete(int* vals, size_t length, size_t pos) {
-  if (length > pos + 1) memmove(vals + pos, vals + pos + 1, (length - pos - 1));
+  if (length > pos + 1)
+    memmove(vals + pos, vals + pos + 1,
+            sizeof(int) * (length - pos - 1));
 }
 
 void array_reorder(int* vals, size_t* pos, size_t length) {
@@ -216,6 +217,14 @@ char* trim_quotes(char* str) {
   return str;
 }
 
+// Writes dir/name into path, a PATH_SIZE buffer, cutting it short rather
+// than overflowing it.
+char* path_join(char* path, const char* dir, const char* name) {
+  if (snprintf(path, PATH_SIZE, "%s/%s", dir, name) >= PATH_SIZE)
+    log_err("path too long: %s/%s\n", dir, name);
+  return path;
+}
+
 /*=== LOGGING UTILS ===*/
 
 /* The following three functions will show output on the terminal
@@ -0,0 +1,226 @@
+#include <string.h>
+
+#include "cs165_api.h"
+#include "zonemap.h"
+
+/*=== Maintenance ===*/
+
+void init_zonemap(ZoneMap* zones) {
+  zones->num_zones = 0;
+  zones->capacity = 0;
+  zones->mins = NULL;
+  zones->maxs = NULL;
+  zones->sums = NULL;
+}
+
+void free_zonemap(ZoneMap* zones) {
+  free(zones->mins);
+  free(zones->maxs);
+  free(zones->sums);
+  init_zonemap(zones);
+}
+
+/**
+ * Recomputes the zones of col from the one holding position from to the
+ * end of the column. Inserts and deletes shift every later value, so every
+ * zone from the first changed position on has to be redone; appends only
+ * touch the last zone or two.
+ **/
+void refresh_zonemap(Column* col, size_t from) {
+  ZoneMap* zones = &col->zones;
+  size_t num_zones = ZONE_COUNT(col->size);
+  if (num_zones > zones->capacity) {
+    size_t capacity = zones->capacity ? zones->capacity : DEFAULT_CAPACITY;
+    while (capacity < num_zones) capacity *= 2;
+    zones->mins = realloc(zones->mins, sizeof(int) * capacity);
+    zones->maxs = realloc(zones->maxs, sizeof(int) * capacity);
+    zones->sums = realloc(zones->sums, sizeof(long) * capacity);
+    zones->capacity = capacity;
+  }
+  zones->num_zones = num_zones;
+
+  for (size_t z = from / ZONE_SIZE; z < num_zones; z++) {
+    size_t start = z * ZONE_SIZE;
+    size_t end = start + ZONE_SIZE < col->size ? start + ZONE_SIZE : col->size;
+    int min = col->data[start];
+    int max = col->data[start];
+    long sum = 0;
+    for (size_t i = start; i < end; i++) {
+      int val = col->data[i];
+      min = val < min ? val : min;
+      max = val > max ? val : max;
+      sum += val;
+    }
+    zones->mins[z] = min;
+    zones->maxs[z] = max;
+    zones->sums[z] = sum;
+  }
+}
+
+long zonemap_sum(ZoneMap* zones) {
+  long sum = 0;
+  for (size_t z = 0; z < zones->num_zones; z++) sum += zones->sums[z];
+  return sum;
+}
+
+/*=== Zone Scan ===*/
+
+typedef enum ZoneMatch { NO_MATCH, PARTIAL_MATCH, FULL_MATCH } ZoneMatch;
+
+static ZoneMatch zone_match(ZoneMap* zones, size_t z, int low, int high) {
+  if (zones->maxs[z] < low || zones->mins[z] > high) return NO_MATCH;
+  if (zones->mins[z] >= low && zones->maxs[z] <= high) return FULL_MATCH;
+  return PARTIAL_MATCH;
+}
+
+/**
+ * An IN list skips zones whose [min, max] holds none of its values, and
+ * accepts constant zones whose single value it holds.
+ **/
+static ZoneMatch zone_match_in(ZoneMap* zones, size_t z, const ValueSet* set) {
+  size_t low = 0;
+  size_t high = set->num_vals;
+  while (low < high) {
+    size_t mid = low + (high - low) / 2;
+    if (set->vals[mid] < zones->mins[z])
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  if (low == set->num_vals || set->vals[low] > zones->maxs[z]) return NO_MATCH;
+  if (zones->mins[z] == zones->maxs[z]) return FULL_MATCH;
+  return PARTIAL_MATCH;
+}
+
+static size_t zone_length(size_t length, size_t z) {
+  return length - z * ZONE_SIZE < ZONE_SIZE ? length - z * ZONE_SIZE
+                                            : ZONE_SIZE;
+}
+
+// Number of values a zone scan for [low, high] has to read.
+size_t zonemap_scanned(ZoneMap* zones, size_t length, int low, int high) {
+  size_t scanned = 0;
+  for (size_t z = 0; z < zones->num_zones; z++)
+    if (zone_match(zones, z, low, high) == PARTIAL_MATCH)
+      scanned += zone_length(length, z);
+  return scanned;
+}
+
+size_t zonemap_scanned_in(ZoneMap* zones, size_t length, const ValueSet* set) {
+  size_t scanned = 0;
+  for (size_t z = 0; z < zones->num_zones; z++)
+    if (zone_match_in(zones, z, set) == PARTIAL_MATCH)
+      scanned += zone_length(length, z);
+  return scanned;
+}
+
+/**
+ * Range scan kernels over positions [start, end) of a column (start on a
+ * zone boundary) that consult the zone map first: zones outside the range
+ * are skipped, zones inside it qualify without reading their values, and
+ * only the rest go through the scan kernels (the byte-sliced ones when the
+ * column keeps byte slices). Output contracts match
+ * scan_range and scan_range_bits, with words covering [start, end).
+ **/
+size_t scan_zones(Column* col, size_t start, size_t end, int low, int high,
+                  ScanKernel kernel, int* output) {
+  ZoneMap* zones = &col->zones;
+  size_t res_size = 0;
+  for (size_t pos = start; pos < end; pos += ZONE_SIZE) {
+    size_t length = end - pos < ZONE_SIZE ? end - pos : ZONE_SIZE;
+    switch (zone_match(zones, pos / ZONE_SIZE, low, high)) {
+      case NO_MATCH:
+        break;
+      case FULL_MATCH:
+        for (size_t i = 0; i < length; i++) output[res_size + i] = pos + i;
+        res_size += length;
+        break;
+      case PARTIAL_MATCH:
+        if (col->byte_sliced)
+          res_size += scan_byteslices(&col->slices, pos, length, low, high,
+                                      output + res_size);
+        else if (kernel == BRANCHING)
+          res_size += scan_range_branching(col->data + pos, length, low, high,
+                                           pos, output + res_size);
+        else
+          res_size += scan_range(col->data + pos, length, low, high, pos,
+                                 output + res_size);
+    }
+  }
+  return res_size;
+}
+
+size_t scan_zones_bits(Column* col, size_t start, size_t end, int low,
+                       int high, uint64_t* words) {
+  ZoneMap* zones = &col->zones;
+  size_t res_size = 0;
+  for (size_t pos = start; pos < end; pos += ZONE_SIZE) {
+    size_t length = end - pos < ZONE_SIZE ? end - pos : ZONE_SIZE;
+    uint64_t* zone_words = words + (pos - start) / 64;
+    switch (zone_match(zones, pos / ZONE_SIZE, low, high)) {
+      case NO_MATCH:
+        memset(zone_words, 0, sizeof(uint64_t) * ((length + 63) / 64));
+        break;
+      case FULL_MATCH:
+        memset(zone_words, 0xff, sizeof(uint64_t) * (length / 64));
+        if (length % 64)
+          zone_words[length / 64] = (UINT64_C(1) << (length % 64)) - 1;
+        res_size += length;
+        break;
+      case PARTIAL_MATCH:
+        res_size +=
+            col->byte_sliced
+                ? scan_byteslices_bits(&col->slices, pos, length, low, high,
+                                       zone_words)
+                : scan_range_bits(col->data + pos, length, low, high,
+                                  zone_words);
+    }
+  }
+  return res_size;
+}
+
+// IN-list counterparts of scan_zones and scan_zones_bits.
+size_t scan_zones_in(Column* col, size_t start, size_t end,
+                     const ValueSet* set, int* output) {
+  ZoneMap* zones = &col->zones;
+  size_t res_size = 0;
+  for (size_t pos = start; pos < end; pos += ZONE_SIZE) {
+    size_t length = end - pos < ZONE_SIZE ? end - pos : ZONE_SIZE;
+    switch (zone_match_in(zones, pos / ZONE_SIZE, set)) {
+      case NO_MATCH:
+        break;
+      case FULL_MATCH:
+        for (size_t i = 0; i < length; i++) output[res_size + i] = pos + i;
+        res_size += length;
+        break;
+      case PARTIAL_MATCH:
+        res_size +=
+            scan_in(col->data + pos, length, set, pos, output + res_size);
+    }
+  }
+  return res_size;
+}
+
+size_t scan_zones_in_bits(Column* col, size_t start, size_t end,
+                          const ValueSet* set, uint64_t* words) {
+  ZoneMap* zones = &col->zones;
+  size_t res_size = 0;
+  for (size_t pos = start; pos < end; pos += ZONE_SIZE) {
+    size_t length = end - pos < ZONE_SIZE ? end - pos : ZONE_SIZE;
+    uint64_t* zone_words = words + (pos - start) / 64;
+    switch (zone_match_in(zones, pos / ZONE_SIZE, set)) {
+      case NO_MATCH:
+        memset(zone_words, 0, sizeof(uint64_t) * ((length + 63) / 64));
+        break;
+      case FULL_MATCH:
+        memset(zone_words, 0xff, sizeof(uint64_t) * (length / 64));
+        if (length % 64)
+          zone_words[length / 64] = (UINT64_C(1) << (length % 64)) - 1;
+        res_size += length;
+        break;
+      case PARTIAL_MATCH:
+        res_size += scan_in_bits(col->data + pos, length, set, zone_words);
+    }
+  }
+  return res_size;
+}
@@ -4,19 +4,23 @@ import timeit
 import shutil
 import subprocess
 import difflib
+import sys
 
 ROOT_DIR = "./"
 
 EXEC_DIR = os.path.join(ROOT_DIR, "src")
 TEST_DIR = os.path.join(ROOT_DIR, "project_tests_1M")
+# Tests missing from TEST_DIR, like the extension tests, are read from here.
+EXTRA_TEST_DIR = os.path.join(ROOT_DIR, "project_tests")
 TEST_LOG_DIR = os.path.join(ROOT_DIR, "logs")
+SOCKET = os.path.join(EXEC_DIR, "cs165_unix_socket")
 
 CONTROL = [16, 20, 22, 26, 28, 31]
-SHUTDOWN = [1, 2, 10, 18, 19, 24, 25, 30]
+SHUTDOWN = [1, 2, 10, 18, 19, 24, 25, 30, 47, 49, 51, 53, 55, 57, 59]
 SKIP = []
 CLEAN = "distclean"
 START_AT = 1
-END_AT = 42
+END_AT = 62
 
 def makefile(args):
     if args:
@@ -25,13 +29,27 @@ def makefile(args):
         subprocess.call(["make"], cwd=EXEC_DIR, stdout=subprocess.PIPE)
 
 def start_server():
+    if os.path.exists(SOCKET):
+        os.remove(SOCKET)
     output = open(os.path.join(TEST_LOG_DIR, "output.server"), "w")
-    return subprocess.Popen("./server", cwd=EXEC_DIR, stdout=output)
+    server = subprocess.Popen("./server", cwd=EXEC_DIR, stdout=output)
+    # A client started before the server listens gives up at once, so wait
+    # for the socket, e.g. while the server reloads after a shutdown test.
+    while not os.path.exists(SOCKET) and server.poll() is None:
+        time.sleep(0.01)
+    time.sleep(0.05)
+    return server
+
+def test_dir(test):
+    if os.path.exists(os.path.join(TEST_DIR, test + ".dsl")):
+        return TEST_DIR
+    return EXTRA_TEST_DIR
 
 def start_client(i):
     test = "test%02d" % i    
+    test_path = os.path.join(test_dir(test), test)
 
-    with open(os.path.join(TEST_DIR, test + ".dsl"), "r") as fin:
+    with open(test_path + ".dsl", "r") as fin:
         with open(os.path.join(TEST_LOG_DIR, test + ".res"), "w") as fout:
             start_time = timeit.default_timer()
             client = subprocess.Popen(
@@ -39,8 +57,7 @@ def start_client(i):
             client.wait()
             elapsed = timeit.default_timer() - start_time
 
-    explines = [line for line in open(
-        os.path.join(TEST_DIR, test + ".exp"), "r")]
+    explines = [line for line in open(test_path + ".exp", "r")]
     reslines = [line for line in open(
         os.path.join(TEST_LOG_DIR, test + ".res"), "r")]
     explines = filter(lambda x: x.strip(), explines)
@@ -69,6 +86,10 @@ def start_client(i):
         return False
 
 def main(): 
+    global TEST_DIR
+    if len(sys.argv) > 1:
+        TEST_DIR = sys.argv[1]
+
     print "Compiling..."
     makefile(CLEAN)
     makefile(None)